@@ -0,0 +1,43 @@
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET  = IRPIBench
+VERSION = 1.0.0.0
+
+DEFINES += APP_NAME=\\\"$${TARGET}\\\" \
+           APP_VERSION=\\\"$${VERSION}\\\"
+
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# allocations.cpp replaces the aligned operator new of C++17 code as well
+gcc|clang: QMAKE_CXXFLAGS += -faligned-new
+
+SOURCES += \
+        main.cpp \
+        allocations.cpp
+
+HEADERS += \
+    benchmark.h \
+    $${PWD}/../irpiproc.h \
+    $${PWD}/../nullImpl/blockedscoring.h \
+    $${PWD}/../nullImpl/binarysketch.h \
+    $${PWD}/../nullImpl/galleryfile.h \
+    $${PWD}/../nullImpl/numanodes.h \
+    $${PWD}/../IRPITest/irpihelper.h \
+    $${PWD}/../IRPITest/baselinevendor.h \
+    $${PWD}/../IRPITest/imagepool.h \
+    $${PWD}/../IRPITest/outofcore.h
+
+INCLUDEPATH += $${PWD}/.. \
+               $${PWD}/../nullImpl
+
+# Direct reads of the gallery file and NUMA workers go in background threads
+linux: LIBS += -lpthread
+# Linked Vendor's API is asked for irpiGetImplementation() at run time
+linux: LIBS += -ldl
+
+# Stage 8 measures the Vendor's API selected for IRPITest, it is the reference implementation by default
+include($${PWD}/../IRPITest/Vendor.pri)
+# computeDET runs in parallel as in IRPITest
+include($${PWD}/../IRPITest/openmp.pri)
+include($${PWD}/../IRPITest/simd.pri)
@@ -0,0 +1,145 @@
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+// Replacement of the global operator new counts allocations of the whole program, so benchmarks can report
+// allocations per operation. Vendor's API library is counted too when it is an ELF shared object (Linux),
+// its references go to the executable's definitions. A Windows DLL or a static build of the C++ runtime
+// inside the library keeps its own operator new, and such allocations are not counted
+std::atomic<size_t> allocationcount(0);
+
+namespace {
+
+void *countedAllocation(std::size_t _size)
+{
+    allocationcount++;
+    return std::malloc(_size > 0 ? _size : 1);
+}
+
+#ifdef __cpp_aligned_new
+void *countedAlignedAllocation(std::size_t _size, std::align_val_t _alignment)
+{
+    allocationcount++;
+    std::size_t _align = static_cast<std::size_t>(_alignment);
+    if(_align < sizeof(void*))
+        _align = sizeof(void*);
+    void *_ptr = nullptr;
+    if(posix_memalign(&_ptr, _align, _size > 0 ? _size : 1) != 0)
+        return nullptr;
+    return _ptr;
+}
+#endif
+
+}
+
+void *operator new(std::size_t _size)
+{
+    if(void *_ptr = countedAllocation(_size))
+        return _ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t _size)
+{
+    if(void *_ptr = countedAllocation(_size))
+        return _ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t _size, const std::nothrow_t &) noexcept
+{
+    return countedAllocation(_size);
+}
+
+void *operator new[](std::size_t _size, const std::nothrow_t &) noexcept
+{
+    return countedAllocation(_size);
+}
+
+void operator delete(void *_ptr) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete[](void *_ptr) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete(void *_ptr, const std::nothrow_t &) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete[](void *_ptr, const std::nothrow_t &) noexcept
+{
+    std::free(_ptr);
+}
+
+// Sized versions are called by code built with C++14 or later
+void operator delete(void *_ptr, std::size_t) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::size_t) noexcept
+{
+    std::free(_ptr);
+}
+
+// Over-aligned types of C++17 code, std::align_val_t is declared with -faligned-new (see IRPIBench.pro)
+#ifdef __cpp_aligned_new
+void *operator new(std::size_t _size, std::align_val_t _alignment)
+{
+    if(void *_ptr = countedAlignedAllocation(_size, _alignment))
+        return _ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t _size, std::align_val_t _alignment)
+{
+    if(void *_ptr = countedAlignedAllocation(_size, _alignment))
+        return _ptr;
+    throw std::bad_alloc();
+}
+
+void *operator new(std::size_t _size, std::align_val_t _alignment, const std::nothrow_t &) noexcept
+{
+    return countedAlignedAllocation(_size, _alignment);
+}
+
+void *operator new[](std::size_t _size, std::align_val_t _alignment, const std::nothrow_t &) noexcept
+{
+    return countedAlignedAllocation(_size, _alignment);
+}
+
+void operator delete(void *_ptr, std::align_val_t) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::align_val_t) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete(void *_ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete(void *_ptr, std::size_t, std::align_val_t) noexcept
+{
+    std::free(_ptr);
+}
+
+void operator delete[](void *_ptr, std::size_t, std::align_val_t) noexcept
+{
+    std::free(_ptr);
+}
+#endif
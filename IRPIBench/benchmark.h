@@ -0,0 +1,90 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+
+// Number of calls of the global operator new (all its variants) so far, see allocations.cpp
+extern std::atomic<size_t> allocationcount;
+
+//--------------------------------------------------
+struct BenchResult
+{
+    BenchResult() : iterations(0), nsperop(0), bytesperop(0), allocsperop(0) {}
+    std::string name;
+    std::string stage;
+    std::vector<std::pair<std::string,qint64>> parameters; // i.e. gallery size and K, they go to JSON
+    size_t iterations;
+    double nsperop;
+    double bytesperop;
+    double allocsperop;
+    // MB/s of the processed input
+    double throughput() const { return nsperop > 0 ? 1.e3 * bytesperop / nsperop : 0.0; }
+};
+
+//--------------------------------------------------
+/* Calls _call in batches, batch size doubles until the batch takes at least _mintimems,
+ * the last batch gives the time per operation */
+template <typename Call>
+BenchResult runBenchmark(const std::string &_name, Call _call, double _bytesperop, qint64 _mintimems)
+{
+    BenchResult _result;
+    _result.name = _name;
+    _result.bytesperop = _bytesperop;
+    _call(); // untimed, to touch the memory and fill the caches
+    QElapsedTimer _elapsedtimer;
+    for(size_t _iterations = 1; ; _iterations *= 2) {
+        const size_t _allocations = allocationcount;
+        _elapsedtimer.start();
+        for(size_t i = 0; i < _iterations; ++i)
+            _call();
+        const qint64 _ns = _elapsedtimer.nsecsElapsed();
+        if(_ns >= 1000000 * _mintimems || _iterations >= (static_cast<size_t>(1) << 30)) {
+            _result.iterations = _iterations;
+            _result.nsperop = static_cast<double>(_ns) / _iterations;
+            _result.allocsperop = static_cast<double>(allocationcount - _allocations) / _iterations;
+            break;
+        }
+    }
+    return _result;
+}
+
+//--------------------------------------------------
+void showBenchResult(const BenchResult &_result)
+{
+    std::cout << "  " << std::left << std::setw(32) << _result.name << std::right
+              << std::setw(14) << std::fixed << std::setprecision(1) << _result.nsperop << " ns/op"
+              << std::setw(12) << std::setprecision(1) << _result.throughput() << " MB/s"
+              << std::setw(10) << std::setprecision(1) << _result.allocsperop << " allocs/op"
+              << std::setw(12) << _result.iterations << " it" << std::endl;
+}
+
+QJsonArray serializeBenchResults(const std::vector<BenchResult> &_vresults)
+{
+    QJsonArray _jsonarr;
+    for(size_t i = 0; i < _vresults.size(); ++i) {
+        QJsonObject _parameters;
+        for(size_t j = 0; j < _vresults[i].parameters.size(); ++j)
+            _parameters[QString::fromStdString(_vresults[i].parameters[j].first)] = _vresults[i].parameters[j].second;
+        QJsonObject _jsonobj;
+        _jsonobj["Name"]          = QString::fromStdString(_vresults[i].name);
+        _jsonobj["Stage"]         = QString::fromStdString(_vresults[i].stage);
+        _jsonobj["Parameters"]    = _parameters;
+        _jsonobj["Iterations"]    = static_cast<qint64>(_vresults[i].iterations);
+        _jsonobj["ns_per_op"]     = _vresults[i].nsperop;
+        _jsonobj["MB_per_s"]      = _vresults[i].throughput();
+        _jsonobj["Allocs_per_op"] = _vresults[i].allocsperop;
+        _jsonarr.push_back(_jsonobj);
+    }
+    return _jsonarr;
+}
+
+#endif // BENCHMARK_H
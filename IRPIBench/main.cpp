@@ -0,0 +1,862 @@
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+#include <QDir>
+#include <QFile>
+#include <QImage>
+#include <QJsonDocument>
+#include <QString>
+#include <QStringList>
+
+#include "irpiproc.h"
+#include "blockedscoring.h"
+#include "binarysketch.h"
+#include "galleryfile.h"
+#include "numanodes.h"
+#include "IRPITest/irpihelper.h"
+#include "IRPITest/baselinevendor.h"
+#include "IRPITest/outofcore.h"
+#include "benchmark.h"
+
+//--------------------------------------------------
+// Makes pseudo random RGB image, the same for each run with the same _seed
+IRPI::Image makeRandomImage(uint16_t _width, uint16_t _height, unsigned int _seed=1)
+{
+    const size_t _bytes = static_cast<size_t>(_width) * _height * 3;
+    std::shared_ptr<uint8_t> _ptr(new uint8_t[_bytes], std::default_delete<uint8_t[]>());
+    std::mt19937 _gen(_seed);
+    for(size_t i = 0; i < _bytes; ++i)
+        _ptr.get()[i] = static_cast<uint8_t>(_gen() & 0xFF);
+    return IRPI::Image(_width,_height,24,_ptr);
+}
+
+//--------------------------------------------------
+// Compares SIMD kernels with the scalar ones for all row lengths up to _maxlength, so each tail is covered
+bool verifyKernels(const uint8_t *_rgb, size_t _maxlength)
+{
+    std::vector<uint8_t> _simd(3 * _maxlength), _scalar(3 * _maxlength);
+    std::vector<float> _simdf(_maxlength), _scalarf(_maxlength);
+    std::vector<uint32_t> _simdsum(_maxlength), _scalarsum(_maxlength);
+    // Horizontally interpolated rows hold up to 255 * 2048
+    std::vector<int32_t> _top(_maxlength), _bottom(_maxlength);
+    for(size_t i = 0; i < _maxlength; ++i) {
+        _top[i] = _rgb[i] * 2047 + _rgb[_maxlength + i];
+        _bottom[i] = _rgb[2*_maxlength + i] * 2047 + _rgb[i];
+    }
+    for(size_t n = 0; n <= _maxlength; ++n) {
+        IRPI::proc::rgbToGrayRow(_rgb,_simd.data(),n);
+        IRPI::proc::scalar::rgbToGrayRow(_rgb,_scalar.data(),n);
+        if(!std::equal(_simd.begin(),_simd.begin() + n,_scalar.begin())) {
+            std::cerr << "rgbToGrayRow mismatch for " << n << " pixels" << std::endl;
+            return false;
+        }
+        IRPI::proc::deinterleaveRow(_rgb,&_simd[0],&_simd[_maxlength],&_simd[2*_maxlength],n);
+        IRPI::proc::scalar::deinterleaveRow(_rgb,&_scalar[0],&_scalar[_maxlength],&_scalar[2*_maxlength],n);
+        if(_simd != _scalar) {
+            std::cerr << "deinterleaveRow mismatch for " << n << " pixels" << std::endl;
+            return false;
+        }
+        IRPI::proc::normalizeRow(_rgb,_simdf.data(),n,127.5f,1.0f/128.0f);
+        IRPI::proc::scalar::normalizeRow(_rgb,_scalarf.data(),n,127.5f,1.0f/128.0f);
+        if(!std::equal(_simdf.begin(),_simdf.begin() + n,_scalarf.begin())) {
+            std::cerr << "normalizeRow mismatch for " << n << " values" << std::endl;
+            return false;
+        }
+        IRPI::proc::accumulateRow(_rgb,_simdsum.data(),n);
+        IRPI::proc::scalar::accumulateRow(_rgb,_scalarsum.data(),n);
+        if(_simdsum != _scalarsum) {
+            std::cerr << "accumulateRow mismatch for " << n << " values" << std::endl;
+            return false;
+        }
+        const int32_t _fy = static_cast<int32_t>((n * 97) % 2049);
+        IRPI::proc::blendRows(_top.data(),_bottom.data(),_fy,_simd.data(),n);
+        IRPI::proc::scalar::blendRows(_top.data(),_bottom.data(),_fy,_scalar.data(),n);
+        if(!std::equal(_simd.begin(),_simd.begin() + n,_scalar.begin())) {
+            std::cerr << "blendRows mismatch for " << n << " values" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+//--------------------------------------------------
+// Makes _count pseudo random vectors of _dim floats with unit L2 norm
+std::vector<float> makeRandomVectors(size_t _count, size_t _dim, unsigned int _seed)
+{
+    std::vector<float> _vectors(_count * _dim);
+    std::mt19937 _gen(_seed);
+    std::normal_distribution<float> _dist;
+    for(size_t i = 0; i < _count; ++i) {
+        float _norm = 0.0f;
+        for(size_t k = 0; k < _dim; ++k) {
+            _vectors[i * _dim + k] = _dist(_gen);
+            _norm += _vectors[i * _dim + k] * _vectors[i * _dim + k];
+        }
+        for(size_t k = 0; k < _dim; ++k)
+            _vectors[i * _dim + k] /= std::sqrt(_norm);
+    }
+    return _vectors;
+}
+
+//--------------------------------------------------
+// Makes unit vectors close to the randomly chosen _gallery rows, so each of them has a mate in the gallery
+std::vector<float> makeMates(const std::vector<float> &_gallery, size_t _dim, size_t _count, float _noise, unsigned int _seed)
+{
+    const size_t _rows = _gallery.size() / _dim;
+    std::vector<float> _noisevectors = makeRandomVectors(_count,_dim,_seed), _mates(_count * _dim);
+    std::mt19937 _gen(_seed);
+    for(size_t i = 0; i < _count; ++i) {
+        const float *_row = &_gallery[(_gen() % _rows) * _dim];
+        float _norm = 0.0f;
+        for(size_t k = 0; k < _dim; ++k) {
+            _mates[i * _dim + k] = _row[k] + _noise * _noisevectors[i * _dim + k];
+            _norm += _mates[i * _dim + k] * _mates[i * _dim + k];
+        }
+        for(size_t k = 0; k < _dim; ++k)
+            _mates[i * _dim + k] /= std::sqrt(_norm);
+    }
+    return _mates;
+}
+
+//--------------------------------------------------
+// Batched search shall give the same top-K as the search of each probe alone
+bool verifyBatchSearch(const IRPI::scoring::PackedGallery &_gallery, const float *const *_probes, size_t _count, size_t _k)
+{
+    std::vector<IRPI::scoring::TopK> _batch(_count), _single(1);
+    for(size_t i = 0; i < _count; ++i)
+        _batch[i].reset(_k);
+    IRPI::scoring::searchBatch(_gallery,_probes,_count,_batch.data());
+    for(size_t i = 0; i < _count; ++i) {
+        _single[0].reset(_k);
+        IRPI::scoring::searchBatch(_gallery,_probes + i,1,_single.data());
+        if(_single[0].size() != _batch[i].size())
+            return false;
+        const float *_bscores, *_sscores;
+        const uint32_t *_bindices, *_sindices;
+        const size_t _length = _batch[i].size();
+        _batch[i].sortDescending(_bscores,_bindices);
+        _single[0].sortDescending(_sscores,_sindices);
+        if(!std::equal(_bscores,_bscores + _length,_sscores) || !std::equal(_bindices,_bindices + _length,_sindices))
+            return false;
+    }
+    return true;
+}
+
+//--------------------------------------------------
+// Positive integers separated by commas, i.e. 1000,10000. Returns empty vector if the list can not be parsed
+std::vector<size_t> parseSizeList(const QString &_list)
+{
+    std::vector<size_t> _vsizes;
+    const QStringList _items = _list.split(',');
+    for(int i = 0; i < _items.size(); ++i) {
+        bool _ok = false;
+        const size_t _size = _items[i].toUInt(&_ok);
+        if(!_ok || _size == 0)
+            return std::vector<size_t>();
+        _vsizes.push_back(_size);
+    }
+    return _vsizes;
+}
+
+// Image sizes as WxH separated by commas, i.e. 640x480,1280x720
+std::vector<std::pair<uint16_t,uint16_t>> parseImageSizes(const QString &_list)
+{
+    std::vector<std::pair<uint16_t,uint16_t>> _vsizes;
+    const QStringList _items = _list.split(',');
+    for(int i = 0; i < _items.size(); ++i) {
+        const QStringList _sides = _items[i].split('x');
+        bool _okw = false, _okh = false;
+        const uint _width = _sides.size() == 2 ? _sides[0].toUInt(&_okw) : 0;
+        const uint _height = _sides.size() == 2 ? _sides[1].toUInt(&_okh) : 0;
+        if(!_okw || !_okh || _width == 0 || _height == 0 || _width > 0xFFFF || _height > 0xFFFF)
+            return std::vector<std::pair<uint16_t,uint16_t>>();
+        _vsizes.push_back(std::make_pair(static_cast<uint16_t>(_width),static_cast<uint16_t>(_height)));
+    }
+    return _vsizes;
+}
+
+//--------------------------------------------------
+// Smooth gradients with some noise, so image codecs compress it about as well as a photo
+QImage makeTestImage(uint16_t _width, uint16_t _height)
+{
+    QImage _qimg(_width,_height,QImage::Format_RGB888);
+    std::mt19937 _gen(5);
+    for(int y = 0; y < _qimg.height(); ++y) {
+        uint8_t *_line = _qimg.scanLine(y);
+        for(int x = 0; x < _qimg.width(); ++x) {
+            const int _noise = static_cast<int>(_gen() % 16);
+            _line[3*x]     = static_cast<uint8_t>((255 * x / _width + _noise) & 0xFF);
+            _line[3*x + 1] = static_cast<uint8_t>((255 * y / _height + _noise) & 0xFF);
+            _line[3*x + 2] = static_cast<uint8_t>((128 + (x ^ y) % 64 + _noise) & 0xFF);
+        }
+    }
+    return _qimg;
+}
+
+//--------------------------------------------------
+/* Low contrast random image of the _subject with its own noise for each _variant, so templates of one
+ * subject are alike but far from equal: the noise is about twice as strong as the pattern */
+IRPI::Image makeSubjectImage(uint16_t _side, unsigned int _subject, unsigned int _variant)
+{
+    const size_t _bytes = static_cast<size_t>(_side) * _side * 3;
+    std::shared_ptr<uint8_t> _ptr(new uint8_t[_bytes], std::default_delete<uint8_t[]>());
+    std::mt19937 _pattern(_subject);
+    std::seed_seq _seedseq{_subject, _variant};
+    std::mt19937 _noise(_seedseq);
+    for(size_t i = 0; i < _bytes; ++i)
+        _ptr.get()[i] = static_cast<uint8_t>(96 + (_pattern() & 63) + (_noise() & 127) - 64);
+    return IRPI::Image(_side,_side,24,_ptr);
+}
+
+//--------------------------------------------------
+/* Synthetic search results for _probes probes with _k candidates each: 3 of 4 probes have mates
+ * among _probes enrolled labels, 9 of 10 of the mated ones find them at rank 1 */
+void makeSearchResults(size_t _probes, size_t _k, std::vector<std::vector<IRPI::Candidate>> &_vcandidates, std::vector<size_t> &_vtruelabels)
+{
+    std::mt19937 _gen(6);
+    std::uniform_real_distribution<double> _score(0.0,1.0);
+    _vcandidates.assign(_probes,std::vector<IRPI::Candidate>(_k));
+    _vtruelabels.resize(_probes);
+    for(size_t i = 0; i < _probes; ++i) {
+        const bool _mated = (i % 4) != 3;
+        _vtruelabels[i] = _mated ? 1 + _gen() % _probes : _probes + 1 + i;
+        double _top = _mated ? 0.5 + 0.5 * _score(_gen) : 0.6 * _score(_gen);
+        for(size_t j = 0; j < _k; ++j) {
+            const size_t _label = (j == 0 && _mated && _gen() % 10 != 0) ? _vtruelabels[i] : 1 + _gen() % _probes;
+            _vcandidates[i][j] = IRPI::Candidate(true,_label,_top);
+            _top *= _score(_gen);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    uint16_t width = 1280, height = 720, outwidth = 112, outheight = 112;
+    qint64 mintimems = 200;
+    size_t gallerysize = 100000, batchsize = 32, candidates = 64, shortlist = 1000;
+    const size_t dim = 256;
+    std::string galleryfile; // empty means no out-of-core search
+    std::string outputfile; // empty means no JSON output
+    std::string apiresourcespath;
+    size_t detpoints = 10000;
+    std::vector<std::pair<uint16_t,uint16_t>> imagesizes = parseImageSizes("320x240,1280x720,1920x1080");
+    std::vector<size_t> probecounts = parseSizeList("1000,10000");
+    std::vector<size_t> gallerysizes = parseSizeList("1000,10000,100000");
+    std::vector<size_t> candidatelists = parseSizeList("1,16,64");
+    std::vector<size_t> etpps = parseSizeList("1,2,4,8");
+    // Let's parse user's command input
+    while((--argc > 0) && ((*++argv)[0] == '-'))
+        switch(*++argv[0]) {
+            case 'x':
+                width = static_cast<uint16_t>(QString(++argv[0]).toUInt());
+                break;
+            case 'y':
+                height = static_cast<uint16_t>(QString(++argv[0]).toUInt());
+                break;
+            case 's':
+                outwidth = outheight = static_cast<uint16_t>(QString(++argv[0]).toUInt());
+                break;
+            case 'm':
+                mintimems = QString(++argv[0]).toLongLong();
+                break;
+            case 'g':
+                gallerysize = QString(++argv[0]).toUInt();
+                break;
+            case 'q':
+                batchsize = QString(++argv[0]).toUInt();
+                break;
+            case 'j':
+                shortlist = QString(++argv[0]).toUInt();
+                break;
+            case 'O':
+                galleryfile = QString(++argv[0]).toStdString();
+                break;
+            case 'o':
+                outputfile = QString(++argv[0]).toStdString();
+                break;
+            case 'r':
+                apiresourcespath = ++argv[0];
+                break;
+            case 'p':
+                detpoints = QString(++argv[0]).toUInt();
+                break;
+            case 'S':
+                imagesizes = parseImageSizes(QString(++argv[0]));
+                break;
+            case 'P':
+                probecounts = parseSizeList(QString(++argv[0]));
+                break;
+            case 'G':
+                gallerysizes = parseSizeList(QString(++argv[0]));
+                break;
+            case 'K':
+                candidatelists = parseSizeList(QString(++argv[0]));
+                break;
+            case 'E':
+                etpps = parseSizeList(QString(++argv[0]));
+                break;
+            case 'h':
+                std::cout << APP_NAME << " version " << APP_VERSION << std::endl;
+                std::cout << "Options:" << std::endl
+                          << "\t-x[int] - width of the test image (default: " << width << ")" << std::endl
+                          << "\t-y[int] - height of the test image (default: " << height << ")" << std::endl
+                          << "\t-s[int] - side of the resized image (default: " << outwidth << ")" << std::endl
+                          << "\t-m[int] - minimum time of each benchmark in milliseconds (default: " << mintimems << ")" << std::endl
+                          << "\t-g[int] - number of gallery vectors for the reference search (default: " << gallerysize << ")" << std::endl
+                          << "\t-q[int] - number of probes in the batched reference search (default: " << batchsize << ")" << std::endl
+                          << "\t-j[int] - shortlist size of the two-stage reference search (default: " << shortlist << ")" << std::endl
+                          << "\t-S[list] - sizes of the images decoded by readimage, i.e. -S640x480,1280x720 (default: 320x240,1280x720,1920x1080)" << std::endl
+                          << "\t-P[list] - numbers of probes of CMC and DET computation (default: 1000,10000)" << std::endl
+                          << "\t-p[int] - number of points to compute DET curve (default: " << detpoints << ")" << std::endl
+                          << "\t-G[list] - gallery sizes of Vendor's API identifyTemplate (default: 1000,10000,100000)" << std::endl
+                          << "\t-K[list] - candidate list lengths of metrics and Vendor's API identifyTemplate (default: 1,16,64)" << std::endl
+                          << "\t-E[list] - enrollment templates per subject of Vendor's API multi-template search (default: 1,2,4,8)" << std::endl
+                          << "\t-r[str] - path where Vendor's API should search resources" << std::endl
+                          << "\t-O[str] - write the gallery to the file at given path and search it from there (Linux only)" << std::endl
+                          << "\t-o[str] - save all results to the JSON file at given path, so runs may be compared" << std::endl
+                          << "\t-h      - show this help" << std::endl;
+                return 0;
+        }
+    if(width == 0 || height == 0 || outwidth == 0 || outheight == 0) {
+        std::cerr << "Image sizes should be positive! Abort...";
+        return 1;
+    }
+    if(gallerysize == 0 || batchsize == 0 || shortlist == 0) {
+        std::cerr << "Gallery, batch and shortlist sizes should be positive! Abort...";
+        return 1;
+    }
+    if(imagesizes.size() == 0 || probecounts.size() == 0 || gallerysizes.size() == 0 || candidatelists.size() == 0 || etpps.size() == 0 || detpoints == 0) {
+        std::cerr << "Can not parse list of benchmark parameters! Abort...";
+        return 5;
+    }
+    std::cout << APP_NAME << " version " << APP_VERSION << ", kernels: " << IRPI::proc::simdName()
+              << ", scoring: " << IRPI::scoring::simdName() << std::endl;
+
+    const IRPI::Image rgbimg = makeRandomImage(width,height);
+    const size_t pixels = static_cast<size_t>(width) * height;
+    // Every measurement goes to the JSON with the stage and parameters it was taken with
+    std::vector<BenchResult> vresults;
+    std::string stage;
+    std::vector<std::pair<std::string,qint64>> parameters;
+    auto record = [&](BenchResult _result) -> BenchResult {
+        _result.stage = stage;
+        _result.parameters = parameters;
+        showBenchResult(_result);
+        vresults.push_back(_result);
+        return _result;
+    };
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 1 - SIMD vs scalar verification" << std::endl;
+    if(!verifyKernels(rgbimg.data.get(),std::min<size_t>(pixels,256))) {
+        std::cerr << "SIMD kernels give different result! Abort...";
+        return 2;
+    }
+    std::cout << "  all kernels match" << std::endl;
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 2 - row kernels (" << width << "x" << height << ")" << std::endl;
+    stage = "kernels";
+    parameters = {{"Width",width},{"Height",height}};
+    std::vector<uint8_t> vgray(pixels), vplanes(3 * pixels);
+    std::vector<float> vtensor(3 * pixels);
+    record(runBenchmark("rgbToGray scalar",[&](){
+        IRPI::proc::scalar::rgbToGrayRow(rgbimg.data.get(),vgray.data(),pixels);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("rgbToGray simd",[&](){
+        IRPI::proc::rgbToGrayRow(rgbimg.data.get(),vgray.data(),pixels);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("deinterleave scalar",[&](){
+        IRPI::proc::scalar::deinterleaveRow(rgbimg.data.get(),&vplanes[0],&vplanes[pixels],&vplanes[2*pixels],pixels);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("deinterleave simd",[&](){
+        IRPI::proc::deinterleaveRow(rgbimg.data.get(),&vplanes[0],&vplanes[pixels],&vplanes[2*pixels],pixels);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("normalize scalar",[&](){
+        IRPI::proc::scalar::normalizeRow(rgbimg.data.get(),vtensor.data(),3 * pixels,127.5f,1.0f/128.0f);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("normalize simd",[&](){
+        IRPI::proc::normalizeRow(rgbimg.data.get(),vtensor.data(),3 * pixels,127.5f,1.0f/128.0f);
+    },3.0 * pixels,mintimems));
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 3 - image routines (" << width << "x" << height << " -> " << outwidth << "x" << outheight << ")" << std::endl;
+    stage = "image";
+    parameters = {{"Width",width},{"Height",height},{"Side",outwidth}};
+    const IRPI::Image grayimg = IRPI::proc::toGray(rgbimg);
+    const uint16_t cropwidth = width / 2, cropheight = height / 2;
+    const float mean[3] = {127.5f, 127.5f, 127.5f}, scale[3] = {1.0f/128.0f, 1.0f/128.0f, 1.0f/128.0f};
+    std::vector<float> vsmalltensor(3 * static_cast<size_t>(outwidth) * outheight);
+    const IRPI::Image smallimg = IRPI::proc::resizeArea(rgbimg,outwidth,outheight);
+    record(runBenchmark("toGray",[&](){
+        IRPI::proc::toGray(rgbimg);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("crop rgb",[&](){
+        IRPI::proc::crop(rgbimg,width / 4,height / 4,cropwidth,cropheight);
+    },3.0 * cropwidth * cropheight,mintimems));
+    record(runBenchmark("resizeBilinear rgb",[&](){
+        IRPI::proc::resizeBilinear(rgbimg,outwidth,outheight);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("resizeBilinear gray",[&](){
+        IRPI::proc::resizeBilinear(grayimg,outwidth,outheight);
+    },1.0 * pixels,mintimems));
+    record(runBenchmark("resizeArea rgb",[&](){
+        IRPI::proc::resizeArea(rgbimg,outwidth,outheight);
+    },3.0 * pixels,mintimems));
+    record(runBenchmark("resizeArea gray",[&](){
+        IRPI::proc::resizeArea(grayimg,outwidth,outheight);
+    },1.0 * pixels,mintimems));
+    record(runBenchmark("toTensorCHW rgb (resized)",[&](){
+        IRPI::proc::toTensorCHW(smallimg,vsmalltensor.data(),mean,scale);
+    },3.0 * outwidth * outheight,mintimems));
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 4 - reference search (" << gallerysize << " x " << dim << " gallery, top-" << candidates << ")" << std::endl;
+    stage = "search";
+    parameters = {{"Gallery",static_cast<qint64>(gallerysize)},{"K",static_cast<qint64>(candidates)},{"Batch",static_cast<qint64>(batchsize)}};
+    const std::vector<float> vgallery = makeRandomVectors(gallerysize,dim,2);
+    IRPI::scoring::PackedGallery gallery;
+    gallery.pack(vgallery.data(),gallerysize,dim);
+    const std::vector<float> vprobes = makeRandomVectors(batchsize,dim,3);
+    std::vector<const float*> vprobeptrs(batchsize);
+    for(size_t i = 0; i < batchsize; ++i)
+        vprobeptrs[i] = &vprobes[i * dim];
+    if(!verifyBatchSearch(gallery,vprobeptrs.data(),batchsize,candidates)) {
+        std::cerr << "Batched search gives different result! Abort...";
+        return 3;
+    }
+    std::vector<IRPI::scoring::TopK> vheaps(batchsize);
+    // Both searches read the whole gallery once per call, hence MB/s is the memory traffic
+    const BenchResult singleresult = record(runBenchmark("search 1 probe",[&](){
+        vheaps[0].reset(candidates);
+        IRPI::scoring::searchBatch(gallery,vprobeptrs.data(),1,vheaps.data());
+    },gallery.bytes(),mintimems));
+    const BenchResult batchresult = record(runBenchmark("search " + std::to_string(batchsize) + " probes",[&](){
+        for(size_t i = 0; i < batchsize; ++i)
+            vheaps[i].reset(candidates);
+        IRPI::scoring::searchBatch(gallery,vprobeptrs.data(),batchsize,vheaps.data());
+    },gallery.bytes(),mintimems));
+    std::cout << "  Throughput: " << 1.e9 / singleresult.nsperop << " probes/s one by one, "
+              << 1.e9 * batchsize / batchresult.nsperop << " probes/s in batches" << std::endl;
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 5 - two-stage reference search (" << IRPI::scoring::SketchBits << "-bit sketches, shortlist of " << shortlist << ")" << std::endl;
+    stage = "twostage";
+    parameters = {{"Gallery",static_cast<qint64>(gallerysize)},{"K",static_cast<qint64>(candidates)},{"Shortlist",static_cast<qint64>(shortlist)}};
+    IRPI::scoring::SketchProjector projector;
+    projector.init(dim);
+    std::vector<const float*> vgalleryptrs(gallerysize);
+    for(size_t i = 0; i < gallerysize; ++i)
+        vgalleryptrs[i] = &vgallery[i * dim];
+    std::vector<uint64_t> vsketches(gallerysize * IRPI::scoring::SketchWords);
+    projector.sketch(vgalleryptrs.data(),gallerysize,vsketches.data());
+    // Mates have cosine similarity about 0.7 with their gallery rows, random pairs are near 0
+    const std::vector<float> vmates = makeMates(vgallery,dim,batchsize,1.0f,4);
+    std::vector<uint16_t> vdistances(gallerysize);
+    std::vector<uint32_t> vselected(gallerysize);
+    IRPI::scoring::PackedGallery selectedrows;
+    // Returns gallery index of the best entry found by the two-stage search
+    auto twostage = [&](const float *_probe, IRPI::scoring::TopK &_heap) -> uint32_t {
+        uint64_t _sketch[IRPI::scoring::SketchWords];
+        projector.sketch(&_probe,1,_sketch);
+        const size_t _count = IRPI::scoring::hammingShortlist(vsketches.data(),gallerysize,_sketch,shortlist,vdistances.data(),vselected.data());
+        selectedrows.pack(vgallery.data(),vselected.data(),_count,dim);
+        _heap.reset(candidates);
+        IRPI::scoring::searchBatch(selectedrows,&_probe,1,&_heap);
+        const float *_scores;
+        const uint32_t *_positions;
+        _heap.sortDescending(_scores,_positions);
+        return vselected[_positions[0]];
+    };
+    size_t agreements = 0;
+    for(size_t i = 0; i < batchsize; ++i) {
+        const float *_probe = &vmates[i * dim];
+        vheaps[0].reset(candidates);
+        IRPI::scoring::searchBatch(gallery,&_probe,1,vheaps.data());
+        const float *_scores;
+        const uint32_t *_indices;
+        vheaps[0].sortDescending(_scores,_indices);
+        if(twostage(_probe,vheaps[1 % batchsize]) == _indices[0])
+            agreements++;
+    }
+    size_t mate = 0;
+    const BenchResult exactresult = record(runBenchmark("exhaustive 1 probe",[&](){
+        const float *_probe = &vmates[(mate++ % batchsize) * dim];
+        vheaps[0].reset(candidates);
+        IRPI::scoring::searchBatch(gallery,&_probe,1,vheaps.data());
+    },gallery.bytes(),mintimems));
+    const BenchResult twostageresult = record(runBenchmark("two-stage 1 probe",[&](){
+        twostage(&vmates[(mate++ % batchsize) * dim],vheaps[0]);
+    },vsketches.size() * sizeof(uint64_t),mintimems));
+    std::cout << "  Speed-up: " << exactresult.nsperop / twostageresult.nsperop << "x, top-1 agrees with exhaustive search for "
+              << agreements << " of " << batchsize << " probes" << std::endl;
+
+    //-----------------------------------------------------------
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 6 - readimage" << std::endl;
+    stage = "readimage";
+    ImagePool imagepool;
+    for(size_t i = 0; i < imagesizes.size(); ++i) {
+        const uint16_t _width = imagesizes[i].first, _height = imagesizes[i].second;
+        const QImage _qimg = makeTestImage(_width,_height);
+        const char *_formats[] = {"jpg", "png"};
+        for(const char *_format : _formats) {
+            const QString _filename = QDir::tempPath() + QString("/%1_%2x%3.%4").arg(APP_NAME).arg(_width).arg(_height).arg(_format);
+            if(!_qimg.save(_filename,_format)) {
+                std::cout << "  " << _format << ": can not be encoded" << std::endl;
+                continue;
+            }
+            parameters = {{"Width",_width},{"Height",_height}};
+            const std::string _name = std::string("readimage ") + _format + " " + std::to_string(_width) + "x" + std::to_string(_height);
+            record(runBenchmark(_name,[&](){
+                readimage(_filename);
+            },3.0 * _width * _height,mintimems));
+            record(runBenchmark(_name + " pool",[&](){
+                readimage(_filename,QImage::Format_RGB888,false,&imagepool);
+            },3.0 * _width * _height,mintimems));
+            QFile::remove(_filename);
+        }
+    }
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 7 - CMC and DET computation (" << detpoints << " DET points)" << std::endl;
+    stage = "metrics";
+    for(size_t i = 0; i < probecounts.size(); ++i)
+        for(size_t j = 0; j < candidatelists.size(); ++j) {
+            std::vector<std::vector<IRPI::Candidate>> _vcandidates;
+            std::vector<size_t> _vtruelabels;
+            makeSearchResults(probecounts[i],candidatelists[j],_vcandidates,_vtruelabels);
+            const std::vector<DETPoint> _vdet = computeDET(_vcandidates,_vtruelabels,probecounts[i],detpoints);
+            parameters = {{"Probes",static_cast<qint64>(probecounts[i])},{"K",static_cast<qint64>(candidatelists[j])},{"DET_points",static_cast<qint64>(detpoints)}};
+            const std::string _suffix = " " + std::to_string(probecounts[i]) + " x top-" + std::to_string(candidatelists[j]);
+            // MB/s is the size of the search results
+            const double _bytes = static_cast<double>(probecounts[i]) * candidatelists[j] * sizeof(IRPI::Candidate);
+            record(runBenchmark("computeCMC" + _suffix,[&](){
+                computeCMC(_vcandidates,_vtruelabels,probecounts[i]);
+            },_bytes,mintimems));
+            record(runBenchmark("computeDET" + _suffix,[&](){
+                computeDET(_vcandidates,_vtruelabels,probecounts[i],detpoints);
+            },_bytes,mintimems));
+            // FPIR changes from call to call and the result is stored, so the search is not optimized out
+            volatile double _fnir = 0.0;
+            size_t _calls = 0;
+            record(runBenchmark("findFNIR" + _suffix,[&](){
+                _fnir = findFNIR(_vdet,0.01 / (1 + (_calls++ & 7)));
+            },_vdet.size() * sizeof(DETPoint),mintimems));
+        }
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 8 - Vendor's API identifyTemplate (" << VENDOR_API_NAME << ")" << std::endl;
+    stage = "identify";
+    {
+        std::shared_ptr<IRPI::IdentInterface> _recognizer;
+        const int _version = getLinkedImplementation(_recognizer);
+        if(!_recognizer) {
+            std::cerr << "Vendor's API built with interface version " << _version << " is not supported! Abort...";
+            return 7;
+        }
+        if(_version == 0)
+            std::cout << "  Vendor's API is built against baseline irpi.h, only its baseline members are called" << std::endl;
+    }
+    // Templates are made of small random images, so they do not depend on the Vendor's template format
+    const uint16_t templateside = 32;
+    const size_t probetemplates = 64;
+    for(size_t i = 0; i < gallerysizes.size(); ++i) {
+        std::shared_ptr<IRPI::IdentInterface> _recognizer;
+        getLinkedImplementation(_recognizer);
+        IRPI::ReturnStatus _status = _recognizer->initializeEnrollmentSession(apiresourcespath);
+        std::vector<std::vector<uint8_t>> _vetempl(gallerysizes[i]), _vitempl(probetemplates);
+        for(size_t t = 0; t < _vetempl.size() && _status.code == IRPI::ReturnCode::Success; ++t)
+            _status = _recognizer->createTemplate(makeRandomImage(templateside,templateside,static_cast<unsigned int>(100 + t)),
+                                                  IRPI::TemplateRole::Enrollment_1N,_vetempl[t]);
+        std::vector<std::pair<size_t,IRPI::TemplateView>> _vgallery(_vetempl.size());
+        size_t _gallerybytes = 0;
+        for(size_t t = 0; t < _vetempl.size(); ++t) {
+            _vgallery[t] = std::make_pair(t + 1,IRPI::TemplateView(_vetempl[t]));
+            _gallerybytes += _vetempl[t].size();
+        }
+        if(_status.code == IRPI::ReturnCode::Success)
+            _status = _recognizer->finalizeEnrollment(_vgallery);
+        if(_status.code == IRPI::ReturnCode::Success)
+            _status = _recognizer->initializeIdentificationSession(apiresourcespath);
+        for(size_t t = 0; t < _vitempl.size() && _status.code == IRPI::ReturnCode::Success; ++t)
+            _status = _recognizer->createTemplate(makeRandomImage(templateside,templateside,static_cast<unsigned int>(7 + t)),
+                                                  IRPI::TemplateRole::Search_1N,_vitempl[t]);
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cerr << "Vendor's error description: " << _status.info << std::endl
+                      << "Can not prepare Vendor's API search! Abort...";
+            return 6;
+        }
+        // Enrollment templates are kept by Vendor's API, their copies are not needed any longer
+        _vgallery.clear();
+        _vetempl.clear();
+        for(size_t j = 0; j < candidatelists.size(); ++j) {
+            IRPI::CandidateList _candidatelist(candidatelists[j]);
+            std::vector<IRPI::CandidateList> _vlists(batchsize,IRPI::CandidateList(candidatelists[j]));
+            std::vector<IRPI::TemplateView> _vprobes(batchsize);
+            for(size_t b = 0; b < batchsize; ++b)
+                _vprobes[b] = IRPI::TemplateView(_vitempl[b % _vitempl.size()]);
+            std::unique_ptr<bool[]> _decisions(new bool[batchsize]);
+            size_t _probe = 0;
+            bool _decision;
+            parameters = {{"Gallery",static_cast<qint64>(gallerysizes[i])},{"K",static_cast<qint64>(candidatelists[j])}};
+            const std::string _suffix = " " + std::to_string(gallerysizes[i]) + " top-" + std::to_string(candidatelists[j]);
+            // MB/s is the size of enrollment templates searched per call
+            const BenchResult _singleresult = record(runBenchmark("identifyTemplate" + _suffix,[&](){
+                _candidatelist.clear();
+                _recognizer->identifyTemplate(IRPI::TemplateView(_vitempl[_probe++ % _vitempl.size()]),_candidatelist,_decision);
+            },_gallerybytes,mintimems));
+            parameters.push_back(std::make_pair(std::string("Batch"),static_cast<qint64>(batchsize)));
+            const BenchResult _batchresult = record(runBenchmark("identifyTemplates" + _suffix + " x" + std::to_string(batchsize),[&](){
+                _recognizer->identifyTemplates(_vprobes.data(),batchsize,_vlists.data(),_decisions.get());
+            },_gallerybytes,mintimems));
+            std::cout << "  Throughput: " << 1.e9 / _singleresult.nsperop << " probes/s one by one, "
+                      << 1.e9 * batchsize / _batchresult.nsperop << " probes/s in batches" << std::endl;
+        }
+    }
+
+    //-----------------------------------------------------------
+    std::cout << std::endl << "Stage 9 - Vendor's API multi-template search (" << VENDOR_API_NAME << ")" << std::endl;
+    stage = "fusion";
+    /* Subjects are enrolled with several templates each, in rounds of one template per subject, so the
+     * Vendor's API gets them mixed. Latency and CMC are measured for each way the scores of one subject
+     * are fused, as the number of templates per subject grows */
+    const size_t subjects = 1000, fusionprobes = 256;
+    const size_t fusionK = *std::max_element(candidatelists.begin(),candidatelists.end());
+    const char *fusions[] = {"none", "max", "mean"};
+    QJsonArray fusionpoints;
+    std::vector<std::vector<uint8_t>> vfusionprobes(fusionprobes);
+    std::vector<size_t> vfusiontruelabels(fusionprobes);
+    for(size_t i = 0; i < etpps.size(); ++i) {
+        std::shared_ptr<IRPI::IdentInterface> _recognizer;
+        getLinkedImplementation(_recognizer);
+        IRPI::ReturnStatus _status = _recognizer->initializeEnrollmentSession(apiresourcespath);
+        std::vector<std::vector<uint8_t>> _vetempl(subjects * etpps[i]);
+        std::vector<std::pair<size_t,IRPI::TemplateView>> _vgallery(_vetempl.size());
+        size_t _gallerybytes = 0;
+        for(size_t t = 0; t < _vetempl.size() && _status.code == IRPI::ReturnCode::Success; ++t) {
+            const size_t _subject = t % subjects;
+            _status = _recognizer->createTemplate(makeSubjectImage(templateside,static_cast<unsigned int>(_subject),static_cast<unsigned int>(t / subjects)),
+                                                  IRPI::TemplateRole::Enrollment_1N,_vetempl[t]);
+            _vgallery[t] = std::make_pair(_subject + 1,IRPI::TemplateView(_vetempl[t]));
+            _gallerybytes += _vetempl[t].size();
+        }
+        if(_status.code == IRPI::ReturnCode::Success)
+            _status = _recognizer->finalizeEnrollment(_vgallery);
+        if(_status.code == IRPI::ReturnCode::Success)
+            _status = _recognizer->initializeIdentificationSession(apiresourcespath);
+        // Probes are the variants no enrollment template has
+        for(size_t t = 0; t < fusionprobes && _status.code == IRPI::ReturnCode::Success; ++t) {
+            vfusiontruelabels[t] = t % subjects + 1;
+            _status = _recognizer->createTemplate(makeSubjectImage(templateside,static_cast<unsigned int>(t % subjects),static_cast<unsigned int>(1000 + t)),
+                                                  IRPI::TemplateRole::Search_1N,vfusionprobes[t]);
+        }
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cerr << "Vendor's error description: " << _status.info << std::endl
+                      << "Can not prepare Vendor's API multi-template search! Abort...";
+            return 6;
+        }
+        _vgallery.clear();
+        _vetempl.clear();
+        IRPI::CandidateList _candidatelist(fusionK);
+        bool _decision;
+        for(size_t f = 0; f < sizeof(fusions) / sizeof(fusions[0]); ++f) {
+            if(_recognizer->setParameter("fusion",fusions[f]).code != IRPI::ReturnCode::Success) {
+                std::cout << "  fusion " << fusions[f] << ": not supported by Vendor's API" << std::endl;
+                continue;
+            }
+            std::vector<std::vector<IRPI::Candidate>> _vcandidates(fusionprobes);
+            for(size_t t = 0; t < fusionprobes; ++t) {
+                _candidatelist.clear();
+                _recognizer->identifyTemplate(IRPI::TemplateView(vfusionprobes[t]),_candidatelist,_decision);
+                copyCandidates(_candidatelist,_vcandidates[t]);
+            }
+            const std::vector<CMCPoint> _vCMC = computeCMC(_vcandidates,vfusiontruelabels,subjects);
+            size_t _probe = 0;
+            parameters = {{"Subjects",static_cast<qint64>(subjects)},{"Templates_per_subject",static_cast<qint64>(etpps[i])},{"K",static_cast<qint64>(fusionK)}};
+            const BenchResult _result = record(runBenchmark("identifyTemplate " + std::to_string(etpps[i]) + " per subject " + fusions[f],[&](){
+                _candidatelist.clear();
+                _recognizer->identifyTemplate(IRPI::TemplateView(vfusionprobes[_probe++ % fusionprobes]),_candidatelist,_decision);
+            },_gallerybytes,mintimems));
+            QJsonObject _jsonobj;
+            _jsonobj["Templates_per_subject"] = static_cast<qint64>(etpps[i]);
+            _jsonobj["Fusion"]                = fusions[f];
+            _jsonobj["Mean_us"]               = 1.e-3 * _result.nsperop;
+            _jsonobj["TPIR1"]                 = _vCMC.front().mTPIR;
+            _jsonobj["TPIRK"]                 = _vCMC.back().mTPIR;
+            fusionpoints.push_back(_jsonobj);
+            std::cout << std::setprecision(4) << "  TPIR[1]: " << _vCMC.front().mTPIR << ", TPIR[" << fusionK << "]: " << _vCMC.back().mTPIR << std::endl;
+        }
+    }
+
+    //-----------------------------------------------------------
+    const std::vector<IRPI::scoring::NumaNode> numanodes = IRPI::scoring::numaNodes();
+    std::cout << std::endl << "Stage 10 - NUMA placement (" << numanodes.size() << " nodes)" << std::endl;
+    stage = "numa";
+    {
+        /* Each node gets its copy of the gallery of Stage 4, written by the worker pinned there, so its pages are
+         * on that node. Then the worker of every node scans the copy of every node: the diagonal is local memory,
+         * the rest goes over the interconnect */
+        std::vector<std::unique_ptr<IRPI::scoring::NodeWorker>> _vworkers;
+        std::vector<IRPI::scoring::PackedGallery> _vreplicas(numanodes.size());
+        for(size_t n = 0; n < numanodes.size(); ++n) {
+            _vworkers.emplace_back(new IRPI::scoring::NodeWorker(numanodes[n]));
+            const std::function<void()> _place = [&,n]() { _vreplicas[n] = gallery; };
+            _vworkers[n]->run(_place);
+            _vworkers[n]->wait();
+            std::cout << "  Node " << numanodes[n].id << ": " << numanodes[n].cpus.size() << " CPUs, worker "
+                      << (_vworkers[n]->isPinned() ? "pinned" : "not pinned") << std::endl;
+        }
+        for(size_t c = 0; c < numanodes.size(); ++c)
+            for(size_t m = 0; m < numanodes.size(); ++m) {
+                IRPI::scoring::TopK _heap;
+                const std::function<void()> _scan = [&]() {
+                    _heap.reset(candidates);
+                    IRPI::scoring::searchBatch(_vreplicas[m],vprobeptrs.data(),1,&_heap);
+                };
+                parameters = {{"Gallery",static_cast<qint64>(gallerysize)},{"K",static_cast<qint64>(candidates)},
+                              {"CPU_node",static_cast<qint64>(numanodes[c].id)},{"Memory_node",static_cast<qint64>(numanodes[m].id)}};
+                // MB/s is the memory traffic of the node's worker, ns/op the latency of one probe
+                record(runBenchmark("search cpu " + std::to_string(numanodes[c].id) + " memory " + std::to_string(numanodes[m].id),[&](){
+                    _vworkers[c]->run(_scan);
+                    _vworkers[c]->wait();
+                },gallery.bytes(),mintimems));
+            }
+    }
+    // Vendor's API with its gallery in one piece and split between the nodes
+    {
+        const size_t _gallerysize = *std::max_element(gallerysizes.begin(),gallerysizes.end());
+        std::shared_ptr<IRPI::IdentInterface> _recognizer;
+        getLinkedImplementation(_recognizer);
+        IRPI::ReturnStatus _status = _recognizer->initializeEnrollmentSession(apiresourcespath);
+        std::vector<std::vector<uint8_t>> _vetempl(_gallerysize), _vitempl(probetemplates);
+        std::vector<std::pair<size_t,IRPI::TemplateView>> _vgallery(_vetempl.size());
+        size_t _gallerybytes = 0;
+        for(size_t t = 0; t < _vetempl.size() && _status.code == IRPI::ReturnCode::Success; ++t) {
+            _status = _recognizer->createTemplate(makeRandomImage(templateside,templateside,static_cast<unsigned int>(100 + t)),
+                                                  IRPI::TemplateRole::Enrollment_1N,_vetempl[t]);
+            _vgallery[t] = std::make_pair(t + 1,IRPI::TemplateView(_vetempl[t]));
+            _gallerybytes += _vetempl[t].size();
+        }
+        if(_status.code == IRPI::ReturnCode::Success)
+            _status = _recognizer->finalizeEnrollment(_vgallery);
+        if(_status.code == IRPI::ReturnCode::Success)
+            _status = _recognizer->initializeIdentificationSession(apiresourcespath);
+        for(size_t t = 0; t < _vitempl.size() && _status.code == IRPI::ReturnCode::Success; ++t)
+            _status = _recognizer->createTemplate(makeRandomImage(templateside,templateside,static_cast<unsigned int>(7 + t)),
+                                                  IRPI::TemplateRole::Search_1N,_vitempl[t]);
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cerr << "Vendor's error description: " << _status.info << std::endl
+                      << "Can not prepare Vendor's API search! Abort...";
+            return 6;
+        }
+        _vgallery.clear();
+        _vetempl.clear();
+        IRPI::CandidateList _candidatelist(candidates);
+        bool _decision;
+        const char *_modes[] = {"off", "on"};
+        for(size_t m = 0; m < 2; ++m) {
+            if(_recognizer->setParameter("numa",_modes[m]).code != IRPI::ReturnCode::Success) {
+                std::cout << "  numa " << _modes[m] << ": not supported by Vendor's API" << std::endl;
+                continue;
+            }
+            size_t _probe = 0;
+            parameters = {{"Gallery",static_cast<qint64>(_gallerysize)},{"K",static_cast<qint64>(candidates)},
+                          {"Nodes",static_cast<qint64>(m == 0 ? 0 : numanodes.size())}};
+            record(runBenchmark("identifyTemplate numa " + std::string(_modes[m]),[&](){
+                _candidatelist.clear();
+                _recognizer->identifyTemplate(IRPI::TemplateView(_vitempl[_probe++ % _vitempl.size()]),_candidatelist,_decision);
+            },_gallerybytes,mintimems));
+        }
+    }
+
+    // Results are saved at any exit point after the benchmarks
+    auto saveresults = [&]() -> int {
+        if(outputfile.empty())
+            return 0;
+        QJsonObject _jsonobj;
+        _jsonobj["Application"] = APP_NAME;
+        _jsonobj["Version"]     = APP_VERSION;
+        _jsonobj["Vendor"]      = VENDOR_API_NAME;
+        _jsonobj["Kernels"]     = QString::fromStdString(IRPI::proc::simdName());
+        _jsonobj["Scoring"]     = QString::fromStdString(IRPI::scoring::simdName());
+        _jsonobj["Min_time_ms"] = mintimems;
+        _jsonobj["Numa_nodes"]  = static_cast<qint64>(numanodes.size());
+        _jsonobj["Results"]     = serializeBenchResults(vresults);
+        QJsonObject _fusionobj;
+        _fusionobj["Subjects"]  = static_cast<qint64>(subjects);
+        _fusionobj["K"]         = static_cast<qint64>(fusionK);
+        _fusionobj["Points"]    = fusionpoints;
+        _jsonobj["Fusion"]      = _fusionobj;
+        QFile _file(QString::fromStdString(outputfile));
+        if(!_file.open(QFile::WriteOnly)) {
+            std::cerr << "Can not open output file for writing! Abort...";
+            return 7;
+        }
+        _file.write(QJsonDocument(_jsonobj).toJson());
+        _file.close();
+        std::cout << std::endl << "Results saved in " << outputfile << std::endl;
+        return 0;
+    };
+
+    //-----------------------------------------------------------
+    if(galleryfile.empty())
+        return saveresults();
+    std::cout << std::endl << "Stage 11 - out-of-core reference search (" << galleryfile << ")" << std::endl;
+    stage = "outofcore";
+    parameters = {{"Gallery",static_cast<qint64>(gallerysize)},{"K",static_cast<qint64>(candidates)}};
+    IRPI::scoring::GalleryFile file;
+    std::string error;
+    if(!file.create(galleryfile,gallery,error)) {
+        std::cerr << error << "! Abort...";
+        return 4;
+    }
+    // Scan of the file shall give the same candidates as the search in memory
+    vheaps[0].reset(candidates);
+    IRPI::scoring::searchBatch(gallery,vprobeptrs.data(),1,vheaps.data());
+    const float *expectedscores;
+    const uint32_t *expectedindices;
+    const size_t expectedlength = vheaps[0].size();
+    vheaps[0].sortDescending(expectedscores,expectedindices);
+    const std::vector<float> vexpectedscores(expectedscores,expectedscores + expectedlength);
+    const std::vector<uint32_t> vexpectedindices(expectedindices,expectedindices + expectedlength);
+    auto scanfile = [&]() {
+        vheaps[1 % batchsize].reset(candidates);
+        file.scan([&](const float *_panels, size_t _firstpanel, size_t _panelcount) {
+            IRPI::scoring::searchPanels(_panels,_firstpanel,_panelcount,file.rows(),dim,vprobeptrs.data(),1,&vheaps[1 % batchsize]);
+            return true;
+        });
+    };
+    const IRPI::scoring::GalleryFile::Access accesses[] = {IRPI::scoring::GalleryFile::Access::Mapped, IRPI::scoring::GalleryFile::Access::Direct};
+    const char *modes[] = {"mmap", "direct"};
+    for(size_t m = 0; m < 2; ++m) {
+        if(!file.setAccess(accesses[m],error)) {
+            std::cout << "  " << modes[m] << ": not supported (" << error << ")" << std::endl;
+            continue;
+        }
+        OutOfCorePoint _point;
+        _point.mode = modes[m];
+        evictFileCache(galleryfile);
+        QElapsedTimer _timer;
+        _timer.start();
+        scanfile();
+        _point.coldns = _timer.nsecsElapsed();
+        const float *_scores;
+        const uint32_t *_indices;
+        const size_t _length = vheaps[1 % batchsize].size();
+        vheaps[1 % batchsize].sortDescending(_scores,_indices);
+        if(_length != expectedlength || !std::equal(vexpectedindices.begin(),vexpectedindices.end(),_indices)
+                                     || !std::equal(vexpectedscores.begin(),vexpectedscores.end(),_scores)) {
+            std::cerr << "Search of the gallery file gives different result! Abort...";
+            return 4;
+        }
+        const BenchResult _warmresult = record(runBenchmark("search 1 probe " + _point.mode,scanfile,file.bytes(),mintimems));
+        _point.warmns = _warmresult.nsperop;
+        showOutOfCore(_point,file.bytes());
+    }
+    file.close();
+    std::remove(galleryfile.c_str());
+    return saveresults();
+}
@@ -23,10 +23,34 @@ SOURCES += \
         main.cpp
 
 HEADERS += \
-    irpihelper.h
+    irpihelper.h \
+    imagepool.h \
+    perfcounters.h \
+    cputime.h \
+    cpuaffinity.h \
+    scalingsweep.h \
+    warmup.h \
+    tracing.h \
+    templatearena.h \
+    isolation.h \
+    pipeline.h \
+    multivendor.h \
+    baselinevendor.h \
+    sharding.h \
+    shortlist.h \
+    outofcore.h \
+    updates.h \
+    resultcache.h \
+    deadline.h \
+    bootstrap.h \
+    $${PWD}/../irpiproc.h
 
 INCLUDEPATH += $${PWD}/..
 
+# Vendors' APIs may also be loaded at run time (-l option)
+linux: LIBS += -ldl
+
 include($${PWD}/Vendor.pri)
 include($${PWD}/openmp.pri)
+include($${PWD}/simd.pri)
 
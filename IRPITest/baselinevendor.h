@@ -0,0 +1,79 @@
+#ifndef BASELINEVENDOR_H
+#define BASELINEVENDOR_H
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+    #include <dlfcn.h>
+#endif
+
+#include "irpi.h"
+
+//--------------------------------------------------
+/* Vendor's API built against irpi.h without irpiGetImplementation(). Its vtable has
+ * the baseline members only, so just they are called, while the optional members
+ * run their default implementations here and go through the baseline ones */
+class BaselineIdentInterface : public IRPI::IdentInterface
+{
+public:
+    explicit BaselineIdentInterface(const std::shared_ptr<IRPI::IdentInterface> &_vendor) :
+        vendor(_vendor) {}
+
+    IRPI::ReturnStatus initializeEnrollmentSession(const std::string &configDir) override {
+        return vendor->initializeEnrollmentSession(configDir);
+    }
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, std::vector<uint8_t> &templ) override {
+        return vendor->createTemplate(img,role,templ);
+    }
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,std::vector<uint8_t>>> &vtempl) override {
+        return vendor->finalizeEnrollment(vtempl);
+    }
+    IRPI::ReturnStatus initializeIdentificationSession(const std::string &configDir) override {
+        return vendor->initializeIdentificationSession(configDir);
+    }
+    IRPI::ReturnStatus identifyTemplate(const std::vector<uint8_t> &idTemplate, const size_t candidateListLength,
+                                        std::vector<IRPI::Candidate> &candidateList, bool &decision) override {
+        return vendor->identifyTemplate(idTemplate,candidateListLength,candidateList,decision);
+    }
+    using IRPI::IdentInterface::createTemplate;
+    using IRPI::IdentInterface::finalizeEnrollment;
+    using IRPI::IdentInterface::identifyTemplate;
+
+private:
+    std::shared_ptr<IRPI::IdentInterface> vendor;
+};
+
+//--------------------------------------------------
+/* Vendor's API linked into the binary (see Vendor.pri). Calling the optional members of a library
+ * built against the baseline irpi.h would run past the end of its vtable, so the library is asked
+ * how it has been built: irpiGetImplementation() is looked up among the loaded objects and, if it is
+ * not there, the implementation is wrapped into BaselineIdentInterface. Returns the interface version
+ * the library has been built with, 0 for the baseline one. Implementation is reset for the versions
+ * this harness does not know. On Windows irpi.h demands libraries to be rebuilt with it, so the
+ * factory is called as is */
+int getLinkedImplementation(std::shared_ptr<IRPI::IdentInterface> &_implementation)
+{
+    _implementation.reset();
+#ifdef Q_OS_LINUX
+    typedef int (*Entry)(std::shared_ptr<IRPI::IdentInterface> *);
+    Entry _entry = reinterpret_cast<Entry>(dlsym(RTLD_DEFAULT, "irpiGetImplementation"));
+    if(_entry != nullptr) {
+        // Newer interface only appends members, so its vtable starts with ours
+        const int _version = _entry(&_implementation);
+        if(_version < IRPI_INTERFACE_VERSION)
+            _implementation.reset();
+        return _version;
+    }
+    const std::shared_ptr<IRPI::IdentInterface> _baseline = IRPI::IdentInterface::getImplementation();
+    if(_baseline)
+        _implementation = std::make_shared<BaselineIdentInterface>(_baseline);
+    return 0;
+#else
+    _implementation = IRPI::IdentInterface::getImplementation();
+    return IRPI_INTERFACE_VERSION;
+#endif
+}
+
+#endif // BASELINEVENDOR_H
@@ -0,0 +1,198 @@
+#ifndef BOOTSTRAP_H
+#define BOOTSTRAP_H
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <QJsonObject>
+
+#ifdef _OPENMP
+    #include <omp.h>
+#endif
+
+#include "irpi.h"
+#include "warmup.h"
+
+//--------------------------------------------------
+/* Search results reduced to what TPIR[1] and FNIR at fixed FPIR need: rank of the mate and
+ * the score of the first candidate of each search. Probes are sorted by that score once and
+ * all arrays go in that order, so a replicate is a single sequential pass over them, O(N)
+ * instead of O(points x N) of computeDET */
+struct BootstrapSample
+{
+    std::vector<uint32_t> vmaterank; // 1-based rank of the mate, 0 if it is not in the list
+    std::vector<float> vtopscore;    // score of the first candidate, lowest float if there is none
+    std::vector<uint8_t> vismated;   // 1 if the probe has a mate in the enrollment set
+    std::vector<uint32_t> vmated, vnonmated; // positions of the probes with and without mate
+};
+
+BootstrapSample makeBootstrapSample(const std::vector<std::vector<IRPI::Candidate>> &_vcandidates,
+                                    const std::vector<size_t> &_vtruelabels,
+                                    const size_t _enrolllabelmax)
+{
+    // Searches with empty candidate list are not counted, as computeDET does not count them
+    std::vector<float> _vtopscore(_vcandidates.size(),std::numeric_limits<float>::lowest());
+    std::vector<uint32_t> _vorder;
+    _vorder.reserve(_vcandidates.size());
+    for(size_t i = 0; i < _vcandidates.size(); ++i) {
+        if(_vcandidates[i].size() == 0)
+            continue;
+        if(_vcandidates[i][0].isAssigned)
+            _vtopscore[i] = static_cast<float>(_vcandidates[i][0].similarityScore);
+        _vorder.push_back(static_cast<uint32_t>(i));
+    }
+    std::stable_sort(_vorder.begin(),_vorder.end(),[&_vtopscore](uint32_t _a, uint32_t _b) {
+        return _vtopscore[_a] > _vtopscore[_b];
+    });
+    BootstrapSample _sample;
+    _sample.vmaterank.assign(_vorder.size(),0);
+    _sample.vtopscore.resize(_vorder.size());
+    _sample.vismated.assign(_vorder.size(),0);
+    for(size_t p = 0; p < _vorder.size(); ++p) {
+        const size_t i = _vorder[p];
+        const std::vector<IRPI::Candidate> &_candidates = _vcandidates[i];
+        _sample.vtopscore[p] = _vtopscore[i];
+        if(_vtruelabels[i] <= _enrolllabelmax) {
+            _sample.vismated[p] = 1;
+            _sample.vmated.push_back(static_cast<uint32_t>(p));
+            for(size_t j = 0; j < _candidates.size(); ++j)
+                if(_candidates[j].isAssigned && _candidates[j].label == _vtruelabels[i]) {
+                    _sample.vmaterank[p] = static_cast<uint32_t>(j + 1);
+                    break;
+                }
+        } else {
+            _sample.vnonmated.push_back(static_cast<uint32_t>(p));
+        }
+    }
+    return _sample;
+}
+
+//--------------------------------------------------
+/* TPIR[1] and FNIR at _fpir of the sample where probe at position p is taken _vweights[p] times.
+ * Threshold is the lowest top score at which at most _fpir of the non-mated searches pass;
+ * mated search counts as a miss the same way computeDET counts it: the mate goes first with
+ * a score below the threshold */
+void bootstrapStatistics(const BootstrapSample &_sample, const std::vector<uint32_t> &_vweights, double _fpir,
+                         double &_tpir, double &_fnir)
+{
+    double _mated = 0, _rankone = 0, _nonmated = 0;
+    for(size_t i = 0; i < _sample.vmated.size(); ++i) {
+        const uint32_t _probe = _sample.vmated[i];
+        _mated += _vweights[_probe];
+        if(_sample.vmaterank[_probe] == 1)
+            _rankone += _vweights[_probe];
+    }
+    for(size_t i = 0; i < _sample.vnonmated.size(); ++i)
+        _nonmated += _vweights[_sample.vnonmated[i]];
+    _tpir = _mated > 0 ? _rankone / _mated : 0.0;
+    // Probes of equal score pass or fail together, so the walk goes by groups of them
+    const double _limit = _fpir * _nonmated;
+    double _passednonmated = 0, _passedrankone = 0;
+    for(size_t i = 0; i < _sample.vtopscore.size();) {
+        const float _score = _sample.vtopscore[i];
+        double _groupnonmated = 0, _grouprankone = 0;
+        size_t j = i;
+        for(; j < _sample.vtopscore.size() && _sample.vtopscore[j] == _score; ++j) {
+            if(!_sample.vismated[j])
+                _groupnonmated += _vweights[j];
+            else if(_sample.vmaterank[j] == 1)
+                _grouprankone += _vweights[j];
+        }
+        if(_score == std::numeric_limits<float>::lowest() || _passednonmated + _groupnonmated > _limit)
+            break;
+        _passednonmated += _groupnonmated;
+        _passedrankone += _grouprankone;
+        i = j;
+    }
+    // Rank-1 mates that pass the threshold are hits, the rest of rank-1 mates are misses
+    _fnir = _mated > 0 ? (_rankone - _passedrankone) / _mated : 1.0;
+}
+
+//--------------------------------------------------
+struct BootstrapResult
+{
+    BootstrapResult() : replicates(0), threads(1), fpir(0), tpir(0), fnir(1) {}
+    size_t replicates;
+    size_t threads;
+    double fpir;
+    double tpir, fnir; // estimates of the whole sample
+    std::vector<double> vtpir, vfnir; // estimates of the replicates
+};
+
+/* Mated and non-mated probes are resampled with replacement separately, so each replicate has
+ * as many of them as the sample. Replicate r draws from its own stream seeded by (_seed, r),
+ * so the bands do not depend on the number of threads */
+BootstrapResult runBootstrap(const BootstrapSample &_sample, size_t _replicates, double _fpir, unsigned int _seed=1)
+{
+    BootstrapResult _result;
+    _result.replicates = _replicates;
+    _result.fpir = _fpir;
+    _result.vtpir.resize(_replicates);
+    _result.vfnir.resize(_replicates);
+    std::vector<uint32_t> _vones(_sample.vtopscore.size(),1);
+    bootstrapStatistics(_sample,_vones,_fpir,_result.tpir,_result.fnir);
+#ifdef _OPENMP
+    _result.threads = static_cast<size_t>(omp_get_max_threads());
+#endif
+    #pragma omp parallel
+    {
+        std::vector<uint32_t> _vweights(_sample.vtopscore.size());
+        std::mt19937 _gen;
+        #pragma omp for schedule(static)
+        for(int r = 0; r < static_cast<int>(_replicates); ++r) { // openmp demands signed integral type to be used
+            std::seed_seq _seedseq{_seed, static_cast<unsigned int>(r)};
+            _gen.seed(_seedseq);
+            std::fill(_vweights.begin(),_vweights.end(),0);
+            const std::vector<uint32_t> *_groups[] = {&_sample.vmated, &_sample.vnonmated};
+            for(const std::vector<uint32_t> *_group : _groups) {
+                const uint64_t _size = _group->size();
+                // Multiply-shift maps 32-bit draw to [0, _size) without division
+                for(size_t i = 0; i < _size; ++i)
+                    _vweights[(*_group)[(static_cast<uint64_t>(_gen()) * _size) >> 32]]++;
+            }
+            bootstrapStatistics(_sample,_vweights,_fpir,_result.vtpir[r],_result.vfnir[r]);
+        }
+    }
+    return _result;
+}
+
+//--------------------------------------------------
+QJsonObject serializeBand(const std::vector<double> &_values, double _estimate)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Estimate"] = _estimate;
+    _jsonobj["P2.5"]     = percentile(_values, 0.025);
+    _jsonobj["P5"]       = percentile(_values, 0.05);
+    _jsonobj["P50"]      = percentile(_values, 0.50);
+    _jsonobj["P95"]      = percentile(_values, 0.95);
+    _jsonobj["P97.5"]    = percentile(_values, 0.975);
+    return _jsonobj;
+}
+
+QJsonObject serializeBootstrap(const BootstrapResult &_result, bool _withFNIR)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Replicates"] = static_cast<qint64>(_result.replicates);
+    _jsonobj["Threads"]    = static_cast<qint64>(_result.threads);
+    _jsonobj["TPIR1"]      = serializeBand(_result.vtpir,_result.tpir);
+    if(_withFNIR) {
+        _jsonobj["FPIR"]   = _result.fpir;
+        _jsonobj["FNIR"]   = serializeBand(_result.vfnir,_result.fnir);
+    }
+    return _jsonobj;
+}
+
+void showBootstrap(const BootstrapResult &_result, bool _withFNIR)
+{
+    std::cout << "  TPIR[1]: " << _result.tpir << ", 95% band ["
+              << percentile(_result.vtpir,0.025) << ", " << percentile(_result.vtpir,0.975) << "]" << std::endl;
+    if(_withFNIR)
+        std::cout << "  FNIR (FPIR " << _result.fpir << "): " << _result.fnir << ", 95% band ["
+                  << percentile(_result.vfnir,0.025) << ", " << percentile(_result.vfnir,0.975) << "]" << std::endl;
+}
+
+#endif // BOOTSTRAP_H
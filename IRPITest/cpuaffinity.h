@@ -0,0 +1,215 @@
+#ifndef CPUAFFINITY_H
+#define CPUAFFINITY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+#include <iostream>
+
+#include <QString>
+#include <QStringList>
+#include <QDir>
+#include <QFile>
+
+#ifdef Q_OS_LINUX
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+//--------------------------------------------------
+// Parses cpu list in the form '0-3,8,10-11', returns empty vector if list is malformed
+std::vector<int> parseCPUList(const QString &_list)
+{
+    std::vector<int> _cpus;
+    const QStringList _ranges = _list.split(',');
+    for(int i = 0; i < _ranges.size(); ++i) {
+        const QStringList _bounds = _ranges.at(i).split('-');
+        bool _ok1 = false, _ok2 = false;
+        const int _first = _bounds.at(0).toInt(&_ok1);
+        const int _last  = (_bounds.size() > 1) ? _bounds.at(1).toInt(&_ok2) : _first;
+        if(!_ok1 || (_bounds.size() > 1 && !_ok2) || _bounds.size() > 2 || _first < 0 || _last < _first)
+            return std::vector<int>();
+        for(int _cpu = _first; _cpu <= _last; ++_cpu)
+            _cpus.push_back(_cpu);
+    }
+    return _cpus;
+}
+
+//--------------------------------------------------
+// Returns cpus the process is allowed to run on
+std::vector<int> allowedCPUs()
+{
+    std::vector<int> _cpus;
+#ifdef Q_OS_LINUX
+    cpu_set_t _set;
+    CPU_ZERO(&_set);
+    if(sched_getaffinity(0, sizeof(_set), &_set) == 0) {
+        for(int i = 0; i < CPU_SETSIZE; ++i)
+            if(CPU_ISSET(i, &_set))
+                _cpus.push_back(i);
+    }
+#endif
+    return _cpus;
+}
+
+//--------------------------------------------------
+/* Restricts all threads of the process (including those already started by
+ * Vendor's API or OpenMP runtime) to the given cpus. Threads created later inherit the mask */
+bool setProcessAffinity(const std::vector<int> &_cpus)
+{
+#ifdef Q_OS_LINUX
+    if(_cpus.size() == 0)
+        return false;
+    cpu_set_t _set;
+    CPU_ZERO(&_set);
+    for(size_t i = 0; i < _cpus.size(); ++i)
+        if(_cpus[i] < CPU_SETSIZE)
+            CPU_SET(_cpus[i], &_set);
+    bool _success = (sched_setaffinity(0, sizeof(_set), &_set) == 0);
+    const QStringList _tasks = QDir("/proc/self/task").entryList(QDir::Dirs | QDir::NoDotAndDotDot);
+    for(int i = 0; i < _tasks.size(); ++i)
+        _success &= (sched_setaffinity(static_cast<pid_t>(_tasks.at(i).toInt()), sizeof(_set), &_set) == 0);
+    return _success;
+#else
+    (void)_cpus;
+    return false;
+#endif
+}
+
+//--------------------------------------------------
+std::vector<int> numaNodeCPUs(int _node)
+{
+    QFile _file(QString("/sys/devices/system/node/node%1/cpulist").arg(_node));
+    if(!_file.open(QFile::ReadOnly))
+        return std::vector<int>();
+    return parseCPUList(QString(_file.readAll()).trimmed());
+}
+
+//--------------------------------------------------
+// Returns NUMA nodes that have cpus, on non-NUMA systems there is one node with index 0
+std::vector<int> numaNodes()
+{
+    std::vector<int> _nodes;
+    const QStringList _entries = QDir("/sys/devices/system/node").entryList(QStringList() << "node*", QDir::Dirs | QDir::NoDotAndDotDot);
+    for(int i = 0; i < _entries.size(); ++i) {
+        bool _ok = false;
+        const int _node = _entries.at(i).mid(4).toInt(&_ok);
+        if(_ok && numaNodeCPUs(_node).size() > 0)
+            _nodes.push_back(_node);
+    }
+    if(_nodes.size() == 0)
+        _nodes.push_back(0);
+    std::sort(_nodes.begin(),_nodes.end());
+    return _nodes;
+}
+
+//--------------------------------------------------
+/* Orders cpus so that all cpus of the first NUMA node go first, then cpus of the second node and so on.
+ * This way core-count sweep fills one socket before it crosses the interconnect */
+std::vector<int> orderCPUsByNode(const std::vector<int> &_cpus)
+{
+    std::vector<int> _ordered;
+    const std::vector<int> _nodes = numaNodes();
+    for(size_t i = 0; i < _nodes.size(); ++i) {
+        const std::vector<int> _nodecpus = numaNodeCPUs(_nodes[i]);
+        for(size_t j = 0; j < _nodecpus.size(); ++j)
+            if(std::find(_cpus.begin(),_cpus.end(),_nodecpus[j]) != _cpus.end())
+                _ordered.push_back(_nodecpus[j]);
+    }
+    // Cpus that we could not attribute to any node go last
+    for(size_t i = 0; i < _cpus.size(); ++i)
+        if(std::find(_ordered.begin(),_ordered.end(),_cpus[i]) == _ordered.end())
+            _ordered.push_back(_cpus[i]);
+    return _ordered;
+}
+
+//--------------------------------------------------
+// Address ranges [first, second) of the process memory
+typedef std::vector<std::pair<uintptr_t,uintptr_t>> MemoryRanges;
+
+// Private writable mappings of the process: heap and anonymous ones, where Vendor's API keeps its data
+MemoryRanges anonymousMemory()
+{
+    MemoryRanges _ranges;
+#ifdef Q_OS_LINUX
+    QFile _file("/proc/self/maps");
+    if(!_file.open(QFile::ReadOnly))
+        return _ranges;
+    const QStringList _lines = QString(_file.readAll()).split('\n');
+    for(int i = 0; i < _lines.size(); ++i) {
+        const std::string _line = _lines.at(i).toStdString();
+        unsigned long long _begin = 0, _end = 0;
+        char _perms[5] = {0};
+        int _pathpos = 0;
+        if(std::sscanf(_line.c_str(), "%llx-%llx %4s %*s %*s %*s %n", &_begin, &_end, _perms, &_pathpos) < 3 || _pathpos == 0)
+            continue;
+        const std::string _path = _line.substr(static_cast<size_t>(_pathpos));
+        if(_perms[0] == 'r' && _perms[1] == 'w' && _perms[3] == 'p' && (_path.empty() || _path == "[heap]"))
+            _ranges.push_back(std::make_pair(static_cast<uintptr_t>(_begin), static_cast<uintptr_t>(_end)));
+    }
+#endif
+    return _ranges;
+}
+
+// Parts of _after ranges not covered by _before ones, that is memory mapped or grown in between
+MemoryRanges newMemory(const MemoryRanges &_before, const MemoryRanges &_after)
+{
+    MemoryRanges _ranges;
+    for(size_t i = 0; i < _after.size(); ++i) {
+        MemoryRanges _parts(1, _after[i]);
+        for(size_t j = 0; j < _before.size(); ++j) {
+            MemoryRanges _rest;
+            for(size_t k = 0; k < _parts.size(); ++k) {
+                if(_before[j].second <= _parts[k].first || _before[j].first >= _parts[k].second) {
+                    _rest.push_back(_parts[k]);
+                    continue;
+                }
+                if(_parts[k].first < _before[j].first)
+                    _rest.push_back(std::make_pair(_parts[k].first, _before[j].first));
+                if(_before[j].second < _parts[k].second)
+                    _rest.push_back(std::make_pair(_before[j].second, _parts[k].second));
+            }
+            _parts.swap(_rest);
+        }
+        _ranges.insert(_ranges.end(), _parts.begin(), _parts.end());
+    }
+    return _ranges;
+}
+
+/* Moves pages of the ranges to the given NUMA node with move_pages(), other memory of the process stays where
+ * it is. We use it to place enrollment data that Vendor's API holds on a local or remote node */
+bool moveMemoryToNode(const MemoryRanges &_ranges, int _node)
+{
+#ifdef Q_OS_LINUX
+    const int _mpolmfmove = 1 << 1; // MPOL_MF_MOVE of <numaif.h>
+    const uintptr_t _pagesize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const size_t _batch = 4096;
+    std::vector<void*> _pages;
+    std::vector<int> _nodes, _status;
+    _pages.reserve(_batch);
+    for(size_t i = 0; i < _ranges.size(); ++i)
+        for(uintptr_t _page = _ranges[i].first & ~(_pagesize - 1); _page < _ranges[i].second; _page += _pagesize) {
+            _pages.push_back(reinterpret_cast<void*>(_page));
+            const bool _last = (_page + _pagesize >= _ranges[i].second) && (i + 1 == _ranges.size());
+            if(_pages.size() < _batch && !_last)
+                continue;
+            // Pages that have never been touched come back with -ENOENT in their status, that is fine
+            _nodes.assign(_pages.size(), _node);
+            _status.resize(_pages.size());
+            if(syscall(SYS_move_pages, 0, _pages.size(), _pages.data(), _nodes.data(), _status.data(), _mpolmfmove) < 0)
+                return false;
+            _pages.clear();
+        }
+    return _ranges.size() > 0;
+#else
+    (void)_ranges;
+    (void)_node;
+    return false;
+#endif
+}
+
+#endif // CPUAFFINITY_H
@@ -0,0 +1,138 @@
+#ifndef CPUTIME_H
+#define CPUTIME_H
+
+#include <cstdint>
+#include <ctime>
+#include <iostream>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+#ifdef Q_OS_LINUX
+#include <sys/resource.h>
+#endif
+#ifdef Q_OS_WIN
+// Keeps min() and max() macros of windows.h off std::min() and std::max() of the other headers
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#endif
+
+//--------------------------------------------------
+struct CPUStage
+{
+    CPUStage() : calls(0), wallns(0), processns(0), threadns(0) {}
+    size_t calls;
+    double wallns;    // wall clock time
+    double processns; // CPU time consumed by all threads of the process
+    double threadns;  // CPU time consumed by the calling thread only
+
+    // How many cores were busy on average while stage has been running
+    double parallelism() const { return wallns > 0 ? processns / wallns : 0.0; }
+};
+
+//--------------------------------------------------
+/* Measures wall time next to process and thread CPU time, so we can see
+ * if Vendor's API parallelizes work internally. On Linux we use
+ * CLOCK_PROCESS_CPUTIME_ID and CLOCK_THREAD_CPUTIME_ID, on Windows
+ * GetProcessTimes() and GetThreadTimes() (std::clock() is wall time there),
+ * elsewhere std::clock() gives process CPU time and thread time is 0 */
+class CPUTimer
+{
+public:
+    CPUTimer() : process0(0), thread0(0) {}
+
+    void start() {
+        process0 = processCPUTime();
+        thread0 = threadCPUTime();
+        walltimer.start();
+    }
+
+    void stop(CPUStage &_stage) {
+        const double _wall = walltimer.nsecsElapsed();
+        _stage.wallns += _wall;
+        _stage.threadns += threadCPUTime() - thread0;
+        _stage.processns += processCPUTime() - process0;
+        _stage.calls++;
+    }
+
+    static double processCPUTime() {
+#ifdef Q_OS_LINUX
+        timespec _ts;
+        clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &_ts);
+        return 1.e9 * _ts.tv_sec + _ts.tv_nsec;
+#elif defined(Q_OS_WIN)
+        FILETIME _creation, _exit, _kernel, _user;
+        if(GetProcessTimes(GetCurrentProcess(), &_creation, &_exit, &_kernel, &_user) == 0)
+            return 0.0;
+        return fileTimeNs(_kernel) + fileTimeNs(_user);
+#else
+        return 1.e9 * std::clock() / CLOCKS_PER_SEC;
+#endif
+    }
+
+    static double threadCPUTime() {
+#ifdef Q_OS_LINUX
+        timespec _ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &_ts);
+        return 1.e9 * _ts.tv_sec + _ts.tv_nsec;
+#elif defined(Q_OS_WIN)
+        FILETIME _creation, _exit, _kernel, _user;
+        if(GetThreadTimes(GetCurrentThread(), &_creation, &_exit, &_kernel, &_user) == 0)
+            return 0.0;
+        return fileTimeNs(_kernel) + fileTimeNs(_user);
+#else
+        return 0.0;
+#endif
+    }
+
+private:
+#ifdef Q_OS_WIN
+    // FILETIME counts 100 ns intervals
+    static double fileTimeNs(const FILETIME &_time) {
+        return 100.0 * ((static_cast<uint64_t>(_time.dwHighDateTime) << 32) | _time.dwLowDateTime);
+    }
+#endif
+
+    QElapsedTimer walltimer;
+    double process0, thread0;
+};
+
+//--------------------------------------------------
+// Minor plus major page faults of the process so far, 0 where getrusage() is not available
+qint64 processPageFaults()
+{
+#ifdef Q_OS_LINUX
+    rusage _usage;
+    if(getrusage(RUSAGE_SELF, &_usage) == 0)
+        return static_cast<qint64>(_usage.ru_minflt + _usage.ru_majflt);
+#endif
+    return 0;
+}
+
+//--------------------------------------------------
+QJsonObject serializeCPUStage(const CPUStage &_stage)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Calls"] = static_cast<qint64>(_stage.calls);
+    if(_stage.calls > 0) {
+        _jsonobj["Wall_ms_per_call"]   = 1.e-6 * _stage.wallns / _stage.calls;
+        _jsonobj["CPU_ms_per_call"]    = 1.e-6 * _stage.processns / _stage.calls;
+        _jsonobj["Thread_ms_per_call"] = 1.e-6 * _stage.threadns / _stage.calls;
+    }
+    _jsonobj["CPU_s_total"] = 1.e-9 * _stage.processns;
+    _jsonobj["Parallelism"] = _stage.parallelism();
+    return _jsonobj;
+}
+
+void showCPUStage(const char *_name, const CPUStage &_stage)
+{
+    std::cout << "  " << _name << ": ";
+    if(_stage.calls > 0)
+        std::cout << "wall " << 1.e-6 * _stage.wallns / _stage.calls << " ms/call, "
+                  << "cpu " << 1.e-6 * _stage.processns / _stage.calls << " ms/call, ";
+    std::cout << "parallelism " << _stage.parallelism() << std::endl;
+}
+
+#endif // CPUTIME_H
@@ -0,0 +1,104 @@
+#ifndef DEADLINE_H
+#define DEADLINE_H
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QStringList>
+
+#include "irpi.h"
+#include "irpihelper.h"
+
+//--------------------------------------------------
+// Search of all identification templates with one latency budget, accuracy is filled after CMC and DET computation
+struct DeadlinePoint
+{
+    DeadlinePoint() : budgetns(0), meanns(0), missed(0), partial(0), TPIR(0), FNIR(1) {}
+    double budgetns;
+    double meanns;
+    size_t missed;  // searches that returned after the deadline
+    size_t partial; // searches cut short by the deadline
+    double TPIR;    // TPIR[1]
+    double FNIR;    // FNIR at the best FPIR
+    std::vector<std::vector<IRPI::Candidate>> vcandidates;
+};
+
+// Budgets in microseconds separated by commas, i.e. 50,100,200. Returns empty vector if the list can not be parsed
+std::vector<double> parseBudgetList(const QString &_list)
+{
+    std::vector<double> _vbudgets;
+    const QStringList _items = _list.split(',');
+    for(int i = 0; i < _items.size(); ++i) {
+        bool _ok = false;
+        const double _budget = _items[i].toDouble(&_ok);
+        if(!_ok || _budget <= 0)
+            return std::vector<double>();
+        _vbudgets.push_back(1.e3 * _budget);
+    }
+    return _vbudgets;
+}
+
+//--------------------------------------------------
+// Searches go one by one, the deadline of each is set when it is called
+void deadlinePass(IRPI::IdentInterface *_recognizer,
+                  const std::vector<IRPI::TemplateView> &_vitempl,
+                  const size_t _candidates,
+                  DeadlinePoint &_point)
+{
+    IRPI::CandidateList _candidatelist(_candidates);
+    const std::chrono::nanoseconds _budget(static_cast<int64_t>(_point.budgetns));
+    _point.vcandidates.assign(_vitempl.size(),std::vector<IRPI::Candidate>(_candidates));
+    double _timens = 0;
+    for(size_t i = 0; i < _vitempl.size(); ++i) {
+        bool _decision = false, _partial = false;
+        _candidatelist.clear();
+        const std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+        if(_recognizer->identifyTemplate(_vitempl[i],_start + _budget,_candidatelist,_decision,_partial).code != IRPI::ReturnCode::Success)
+            _candidatelist.clear();
+        const std::chrono::nanoseconds _elapsed = std::chrono::steady_clock::now() - _start;
+        _timens += _elapsed.count();
+        if(_elapsed > _budget)
+            _point.missed++;
+        if(_partial)
+            _point.partial++;
+        copyCandidates(_candidatelist,_point.vcandidates[i]);
+    }
+    _point.meanns = _vitempl.size() > 0 ? _timens / _vitempl.size() : 0.0;
+}
+
+//--------------------------------------------------
+QJsonObject serializeDeadlines(const std::vector<DeadlinePoint> &_vpoints, size_t _searches, bool _withFNIR)
+{
+    QJsonArray _jsonarr;
+    for(size_t i = 0; i < _vpoints.size(); ++i) {
+        QJsonObject _jsonobj;
+        _jsonobj["Budget_us"]        = 1.e-3 * _vpoints[i].budgetns;
+        _jsonobj["Mean_us"]          = 1.e-3 * _vpoints[i].meanns;
+        _jsonobj["Deadline_misses"]  = _searches > 0 ? static_cast<double>(_vpoints[i].missed) / _searches : 0.0;
+        _jsonobj["Partial"]          = _searches > 0 ? static_cast<double>(_vpoints[i].partial) / _searches : 0.0;
+        _jsonobj["TPIR1"]            = _vpoints[i].TPIR;
+        if(_withFNIR)
+            _jsonobj["FNIR"]         = _vpoints[i].FNIR;
+        _jsonarr.push_back(_jsonobj);
+    }
+    QJsonObject _jsonobj;
+    _jsonobj["Searches"] = static_cast<qint64>(_searches);
+    _jsonobj["Budgets"]  = _jsonarr;
+    return _jsonobj;
+}
+
+void showDeadline(const DeadlinePoint &_point, size_t _searches, bool _withFNIR)
+{
+    std::cout << "  Budget " << 1.e-3 * _point.budgetns << " us: mean " << 1.e-3 * _point.meanns << " us, "
+              << "misses " << (_searches > 0 ? static_cast<double>(_point.missed) / _searches : 0.0) << ", "
+              << "partial " << (_searches > 0 ? static_cast<double>(_point.partial) / _searches : 0.0) << ", "
+              << "TPIR[1] " << _point.TPIR;
+    if(_withFNIR)
+        std::cout << ", FNIR " << _point.FNIR;
+    std::cout << std::endl;
+}
+
+#endif // DEADLINE_H
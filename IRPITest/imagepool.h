@@ -0,0 +1,89 @@
+#ifndef IMAGEPOOL_H
+#define IMAGEPOOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+//--------------------------------------------------
+/* Size-class pool for IRPI::Image pixel buffers. Buffer sizes are rounded up to the power of two,
+ * each class keeps a free list of up to maxcached buffers. Buffers go back to the pool
+ * from the shared_ptr deleter, so it is safe to release images from any thread */
+class ImagePool
+{
+public:
+    explicit ImagePool(size_t _maxcached=8) : state(std::make_shared<State>(_maxcached)) {}
+
+    // Returns buffer of at least _size bytes
+    std::shared_ptr<uint8_t> acquire(size_t _size) {
+        const size_t _sizeclass = sizeClass(_size);
+        uint8_t *_ptr = nullptr;
+        {
+            std::lock_guard<std::mutex> _lock(state->mutex);
+            std::vector<uint8_t*> &_freelist = state->freelists[_sizeclass];
+            if(_freelist.size() > 0) {
+                _ptr = _freelist.back();
+                _freelist.pop_back();
+            }
+        }
+        if(_ptr != nullptr) {
+            state->hits++;
+        } else {
+            state->misses++;
+            _ptr = new uint8_t[static_cast<size_t>(1) << _sizeclass];
+        }
+        return std::shared_ptr<uint8_t>(_ptr, Deleter(state, _sizeclass));
+    }
+
+    size_t hits() const { return state->hits.load(); }
+    size_t misses() const { return state->misses.load(); }
+
+private:
+    static const size_t sizeclasses = 8 * sizeof(size_t);
+
+    static size_t sizeClass(size_t _size) {
+        size_t _sizeclass = 0;
+        while((static_cast<size_t>(1) << _sizeclass) < _size)
+            _sizeclass++;
+        return _sizeclass;
+    }
+
+    struct State
+    {
+        explicit State(size_t _maxcached) : maxcached(_maxcached), freelists(sizeclasses), hits(0), misses(0) {}
+        ~State() {
+            for(size_t i = 0; i < freelists.size(); ++i)
+                for(size_t j = 0; j < freelists[i].size(); ++j)
+                    delete [] freelists[i][j];
+        }
+        const size_t maxcached;
+        std::mutex mutex;
+        std::vector<std::vector<uint8_t*>> freelists;
+        std::atomic<size_t> hits, misses;
+    };
+
+    // Deleter holds the pool state, so buffers may outlive the pool object itself
+    struct Deleter
+    {
+        Deleter(const std::shared_ptr<State> &_state, size_t _sizeclass) : state(_state), sizeclass(_sizeclass) {}
+        void operator()(uint8_t *_ptr) const {
+            {
+                std::lock_guard<std::mutex> _lock(state->mutex);
+                std::vector<uint8_t*> &_freelist = state->freelists[sizeclass];
+                if(_freelist.size() < state->maxcached) {
+                    _freelist.push_back(_ptr);
+                    return;
+                }
+            }
+            delete [] _ptr;
+        }
+        std::shared_ptr<State> state;
+        size_t sizeclass;
+    };
+
+    std::shared_ptr<State> state;
+};
+
+#endif // IMAGEPOOL_H
@@ -16,6 +16,8 @@
 #include <QDir>
 
 #include "irpi.h"
+#include "irpiproc.h"
+#include "imagepool.h"
 
 inline std::ostream&
 operator<<(
@@ -44,7 +46,8 @@ operator<<(
     return s << _qstring.toLocal8Bit().constData();
 }
 
-IRPI::Image readimage(const QString &_filename, QImage::Format _mTARgetformat=QImage::Format_RGB888, bool _verbose=false)
+// If _pool is provided, pixel buffer is taken from it and goes back to it when the last copy of the image is released
+IRPI::Image readimage(const QString &_filename, QImage::Format _mTARgetformat=QImage::Format_RGB888, bool _verbose=false, ImagePool *_pool=nullptr)
 {
     if(_verbose)
         std::cout << _filename << std::endl;
@@ -56,6 +59,11 @@ IRPI::Image readimage(const QString &_filename, QImage::Format _mTARgetformat=QI
         return IRPI::Image();
     }
 
+    // Gray target goes through RGB888 and shared irpiproc conversion, so IRPITest and Vendors' APIs get the same gray
+    const bool _togray = (_mTARgetformat == QImage::Format_Grayscale8) && (_qimg.format() != QImage::Format_Grayscale8);
+    if(_togray)
+        _mTARgetformat = QImage::Format_RGB888;
+
     QImage _tmpqimg;
     if(_qimg.format() == _mTARgetformat) {
         _tmpqimg = _qimg;
@@ -75,16 +83,37 @@ IRPI::Image readimage(const QString &_filename, QImage::Format _mTARgetformat=QI
     // extra bytes is added to the end of line to make length divisible by 4
     // Read more here: https://bugreports.qt.io/browse/QTBUG-68379?filter=-2
     // As we do not want to copy this extra bytes to IRPI::Image we should throw them out
-    int _validbytesperline = _tmpqimg.width()*_tmpqimg.depth() / 8;
-    std::shared_ptr<uint8_t>_ptr(new uint8_t[_tmpqimg.height() * _validbytesperline],std::default_delete<uint8_t[]>());
+    const int _depth = _togray ? 8 : _tmpqimg.depth();
+    int _validbytesperline = _tmpqimg.width()*_depth / 8;
+    const size_t _bytes = static_cast<size_t>(_tmpqimg.height() * _validbytesperline);
+    std::shared_ptr<uint8_t>_ptr = (_pool != nullptr) ? _pool->acquire(_bytes)
+                                                      : std::shared_ptr<uint8_t>(new uint8_t[_bytes],std::default_delete<uint8_t[]>());
     for(int i = 0; i < _tmpqimg.height(); ++i) {
-        std::memcpy(_ptr.get() + i * _validbytesperline,
-                    _tmpqimg.constScanLine(i),
-                    static_cast<size_t>(_validbytesperline));
+        if(_togray)
+            IRPI::proc::rgbToGrayRow(_tmpqimg.constScanLine(i),
+                                     _ptr.get() + i * _validbytesperline,
+                                     static_cast<size_t>(_tmpqimg.width()));
+        else
+            std::memcpy(_ptr.get() + i * _validbytesperline,
+                        _tmpqimg.constScanLine(i),
+                        static_cast<size_t>(_validbytesperline));
     }
     return IRPI::Image(static_cast<uint16_t>(_tmpqimg.width()),
                        static_cast<uint16_t>(_tmpqimg.height()),
-                       static_cast<uint8_t>(_tmpqimg.depth()),_ptr);
+                       static_cast<uint8_t>(_depth),_ptr);
+}
+
+//---------------------------------------------------
+// Converts caller allocated candidate list to the vector form that CMC and DET computation expects
+void copyCandidates(const IRPI::CandidateList &_list, std::vector<IRPI::Candidate> &_candidates)
+{
+    _candidates.resize(_list.capacity());
+    for(size_t i = 0; i < _candidates.size(); ++i) {
+        if(i < _list.length)
+            _candidates[i] = IRPI::Candidate(true, _list.labels[i], _list.scores[i]);
+        else
+            _candidates[i] = IRPI::Candidate();
+    }
 }
 
 //---------------------------------------------------
@@ -0,0 +1,1197 @@
+#ifndef ISOLATION_H
+#define ISOLATION_H
+
+#ifdef Q_OS_LINUX
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+#include "irpi.h"
+#include "baselinevendor.h"
+#include "tracing.h"
+
+extern char **environ;
+
+// IRPITest restarts itself as the worker, this variable passes the shared region descriptor to it
+#define ISOLATION_WORKER_ENV "IRPI_WORKER_FD"
+
+enum IsolationOp {
+    IsolationPing = 0,
+    IsolationInitEnrollment,
+    IsolationCreateTemplate,
+    IsolationFinalizeEnrollment,
+    IsolationInitIdentification,
+    IsolationIdentify,
+    IsolationInsertTemplates,
+    IsolationRemoveLabels,
+    IsolationSetParameter,
+    IsolationIdentifyBatch,
+    IsolationAck,
+    IsolationShutdown,
+    IsolationOpsTotal
+};
+
+inline const char *isolationOpName(int _op)
+{
+    static const char *_names[IsolationOpsTotal] = {"Ping", "Einit", "CreateTemplate", "Finalization",
+                                                    "Iinit", "Search", "Insert", "Remove", "Parameter", "BatchSearch",
+                                                    "Ack", "Shutdown"};
+    return (_op >= 0 && _op < IsolationOpsTotal) ? _names[_op] : "Unknown";
+}
+
+//--------------------------------------------------
+/* Control block at the beginning of the shared region. Doorbells are counters,
+ * each ring passes the turn to the peer which sleeps on the doorbell in futex.
+ * Region layout: control block, request area (IRPITest -> worker), response area (worker -> IRPITest) */
+struct IsolationControl
+{
+    alignas(64) std::atomic<uint32_t> request;  // rung by IRPITest
+    alignas(64) std::atomic<uint32_t> response; // rung by the worker
+    alignas(64) uint32_t op;
+    uint32_t flags;
+    uint64_t length;          // payload bytes of the current chunk
+    int32_t  code;            // IRPI::ReturnCode of the response
+    uint64_t vendorns;        // time spent inside Vendor's API
+    uint64_t responsens;      // CLOCK_MONOTONIC when the response has been sent
+    uint64_t maxtemplsize[2]; // maxTemplateSize() for enrollment and search roles
+    char     info[1024];      // IRPI::ReturnStatus::info
+};
+
+//--------------------------------------------------
+class PayloadWriter
+{
+public:
+    explicit PayloadWriter(uint8_t *_ptr) : ptr(_ptr), offset(0) {}
+    template <typename T>
+    void put(const T &_value) { std::memcpy(ptr + offset, &_value, sizeof(T)); offset += sizeof(T); }
+    void putBytes(const void *_data, size_t _size) {
+        if(_size > 0)
+            std::memcpy(ptr + offset, _data, _size);
+        offset += _size;
+    }
+    size_t size() const { return offset; }
+
+private:
+    uint8_t *ptr;
+    size_t offset;
+};
+
+class PayloadReader
+{
+public:
+    explicit PayloadReader(const uint8_t *_ptr) : ptr(_ptr), offset(0) {}
+    template <typename T>
+    T get() { T _value; std::memcpy(&_value, ptr + offset, sizeof(T)); offset += sizeof(T); return _value; }
+    const uint8_t *getBytes(size_t _size) { const uint8_t *_data = ptr + offset; offset += _size; return _data; }
+
+private:
+    const uint8_t *ptr;
+    size_t offset;
+};
+
+//--------------------------------------------------
+// Candidate list goes as the number of candidates followed by their labels and scores
+typedef decltype(IRPI::CandidateList::labels)::value_type IsolationLabel;
+typedef decltype(IRPI::CandidateList::scores)::value_type IsolationScore;
+
+inline size_t candidatesBytes(size_t _candidates)
+{
+    return sizeof(uint64_t) + _candidates * (sizeof(IsolationLabel) + sizeof(IsolationScore));
+}
+
+inline void putCandidates(PayloadWriter &_out, const IRPI::CandidateList &_list)
+{
+    const size_t _n = std::min(_list.length,_list.capacity());
+    _out.put<uint64_t>(_n);
+    _out.putBytes(_list.labels.data(),_n * sizeof(IsolationLabel));
+    _out.putBytes(_list.scores.data(),_n * sizeof(IsolationScore));
+}
+
+// Candidates that do not fit the list are skipped
+inline void getCandidates(PayloadReader &_in, IRPI::CandidateList &_list)
+{
+    const uint64_t _sent = _in.get<uint64_t>();
+    const size_t _n = static_cast<size_t>(std::min<uint64_t>(_sent,_list.capacity()));
+    const uint8_t *_labels = _in.getBytes(_sent * sizeof(IsolationLabel));
+    const uint8_t *_scores = _in.getBytes(_sent * sizeof(IsolationScore));
+    if(_n > 0) {
+        std::memcpy(_list.labels.data(),_labels,_n * sizeof(IsolationLabel));
+        std::memcpy(_list.scores.data(),_scores,_n * sizeof(IsolationScore));
+    }
+    _list.length = _n;
+}
+
+//--------------------------------------------------
+// System wide clock, so timestamps of IRPITest and workers can be compared
+inline uint64_t monotonicNs()
+{
+    timespec _ts;
+    clock_gettime(CLOCK_MONOTONIC, &_ts);
+    return static_cast<uint64_t>(_ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(_ts.tv_nsec);
+}
+
+//--------------------------------------------------
+/* Request/response channel over memfd shared memory. Messages bigger than the area
+ * go in chunks, the receiver acknowledges each chunk except the last one */
+class SharedChannel
+{
+public:
+    enum Side {Harness, Worker};
+
+    SharedChannel() :
+        fd(-1),
+        region(nullptr),
+        regionsize(0),
+        capacity(0),
+        control(nullptr),
+        outbox(nullptr),
+        inbox(nullptr),
+        side(Harness),
+        seen(0),
+        outlength(0),
+        staged(false),
+        timeoutns(0),
+        timedout(false),
+        peer(-1),
+        peerstatus(0),
+        peerexited(false) {}
+
+    ~SharedChannel() {
+        if(region != nullptr)
+            munmap(region, regionsize);
+        if(fd >= 0)
+            close(fd);
+    }
+
+    // IRPITest side, _capacity is the size of each of request and response areas
+    bool create(size_t _capacity) {
+        fd = static_cast<int>(syscall(SYS_memfd_create, "irpi-isolation", 0));
+        if(fd < 0)
+            return false;
+        capacity = _capacity;
+        regionsize = controlsize + 2 * capacity;
+        if(ftruncate(fd, static_cast<off_t>(regionsize)) != 0)
+            return false;
+        return map(Harness);
+    }
+
+    // Worker side, the descriptor is inherited from IRPITest
+    bool attach(int _fd) {
+        fd = _fd;
+        struct stat _stat;
+        if(fstat(fd, &_stat) != 0 || static_cast<size_t>(_stat.st_size) <= controlsize)
+            return false;
+        regionsize = static_cast<size_t>(_stat.st_size);
+        capacity = (regionsize - controlsize) / 2;
+        return map(Worker);
+    }
+
+    // Called by IRPITest before the new worker starts
+    void reset() {
+        control->request.store(0);
+        control->response.store(0);
+        control->maxtemplsize[0] = control->maxtemplsize[1] = 0;
+        seen = 0;
+    }
+
+    void setPeer(pid_t _peer) { peer = _peer; peerexited = false; }
+    // Longest wait for the peer, 0 means no limit
+    void setTimeout(uint64_t _ns) { timeoutns = _ns; }
+    // True if the last wait has failed because the peer did not answer in time
+    bool timedOut() const { return timedout; }
+    int descriptor() const { return fd; }
+    size_t areaSize() const { return capacity; }
+    IsolationControl *ctl() { return control; }
+    // Wait status of the worker after it has died
+    int peerStatus() const { return peerstatus; }
+
+    // Returns memory for the outgoing message of _size bytes, it is the shared area itself if the message fits
+    uint8_t *prepare(size_t _size) {
+        outlength = _size;
+        staged = (_size > capacity);
+        if(!staged)
+            return outbox;
+        staging.resize(_size);
+        return staging.data();
+    }
+
+    // Shrinks outgoing message prepared with the upper bound of the size
+    void setLength(size_t _size) { outlength = _size; }
+
+    bool send(uint32_t _op) {
+        if(!staged) {
+            control->op = _op;
+            control->flags = 0;
+            control->length = outlength;
+            ring();
+            return true;
+        }
+        size_t _offset = 0;
+        for(;;) {
+            const size_t _chunk = std::min(capacity, outlength - _offset);
+            std::memcpy(outbox, staging.data() + _offset, _chunk);
+            _offset += _chunk;
+            control->op = _op;
+            control->length = _chunk;
+            control->flags = (_offset < outlength) ? more : 0;
+            ring();
+            if(_offset >= outlength)
+                return true;
+            if(!waitPeer()) // acknowledgement of the chunk
+                return false;
+        }
+    }
+
+    // Data stays valid until the next receive(), returns false if the peer has died
+    bool receive(uint32_t &_op, const uint8_t *&_data, size_t &_length) {
+        if(!waitPeer())
+            return false;
+        if((control->flags & more) == 0) {
+            _op = control->op;
+            _data = inbox;
+            _length = control->length;
+            return true;
+        }
+        incoming.clear();
+        for(;;) {
+            incoming.insert(incoming.end(), inbox, inbox + control->length);
+            if((control->flags & more) == 0)
+                break;
+            control->op = IsolationAck;
+            control->flags = 0;
+            control->length = 0;
+            ring();
+            if(!waitPeer())
+                return false;
+        }
+        _op = control->op;
+        _data = incoming.data();
+        _length = incoming.size();
+        return true;
+    }
+
+    bool peerAlive() {
+        if(peer <= 0)
+            return true;
+        if(!peerexited) {
+            const pid_t _pid = waitpid(peer, &peerstatus, WNOHANG);
+            peerexited = (_pid == peer || _pid < 0);
+        }
+        return !peerexited;
+    }
+
+    // Kills the peer that does not answer and reaps it, so it does not stay a zombie
+    void killPeer() {
+        if(peer <= 0 || peerexited)
+            return;
+        kill(peer,SIGKILL);
+        while(waitpid(peer,&peerstatus,0) < 0 && errno == EINTR)
+            ;
+        peerexited = true;
+    }
+
+private:
+    SharedChannel(const SharedChannel &);
+    SharedChannel &operator=(const SharedChannel &);
+
+    static const size_t controlsize = 4096;
+    static const uint32_t more = 1;
+    static const size_t spins = 4096; // short calls are answered before futex sleep is needed
+
+    bool map(Side _side) {
+        void *_ptr = mmap(nullptr, regionsize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(_ptr == MAP_FAILED)
+            return false;
+        region = static_cast<uint8_t*>(_ptr);
+        control = reinterpret_cast<IsolationControl*>(region);
+        side = _side;
+        uint8_t *_requestarea = region + controlsize, *_responsearea = region + controlsize + capacity;
+        outbox = (side == Harness) ? _requestarea : _responsearea;
+        inbox  = (side == Harness) ? _responsearea : _requestarea;
+        return true;
+    }
+
+    std::atomic<uint32_t> &ownBell() { return side == Harness ? control->request : control->response; }
+    std::atomic<uint32_t> &peerBell() { return side == Harness ? control->response : control->request; }
+
+    void ring() {
+        ownBell().fetch_add(1);
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&ownBell()), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+    bool waitPeer() {
+        std::atomic<uint32_t> &_bell = peerBell();
+        timedout = false;
+        uint64_t _startns = 0;
+        for(size_t i = 0; ; ++i) {
+            const uint32_t _value = _bell.load(std::memory_order_acquire);
+            if(_value != seen) {
+                seen = _value;
+                return true;
+            }
+            if(i < spins)
+                continue;
+            if(i == spins && timeoutns > 0)
+                _startns = monotonicNs();
+            // Sleep is limited, so death of the peer is noticed
+            timespec _timeout = {0, 20000000};
+            syscall(SYS_futex, reinterpret_cast<uint32_t*>(&_bell), FUTEX_WAIT, _value, &_timeout, nullptr, 0);
+            if(!peerAlive())
+                return false;
+            if(timeoutns > 0 && monotonicNs() - _startns > timeoutns) {
+                timedout = true;
+                return false;
+            }
+        }
+    }
+
+    int fd;
+    uint8_t *region;
+    size_t regionsize, capacity;
+    IsolationControl *control;
+    uint8_t *outbox, *inbox;
+    Side side;
+    uint32_t seen;
+    size_t outlength;
+    bool staged;
+    std::vector<uint8_t> staging, incoming;
+    uint64_t timeoutns;
+    bool timedout;
+    pid_t peer;
+    int peerstatus;
+    bool peerexited;
+};
+
+//--------------------------------------------------
+/* Requests that have built the gallery of the worker: finalization followed by the updates.
+ * They are written to a memfd file instead of the heap of IRPITest and read back only when
+ * the worker is restarted, so kernel is free to swap these pages out in the meantime */
+class ReplayLog
+{
+public:
+    ReplayLog() :
+        fd(-1),
+        length(0),
+        count(0),
+        intact(true) {}
+
+    ~ReplayLog() {
+        if(fd >= 0)
+            close(fd);
+    }
+
+    // Drops all records, the next finalization starts the log again
+    void clear() {
+        if(fd < 0)
+            fd = static_cast<int>(syscall(SYS_memfd_create, "irpi-replay", 0));
+        length = 0;
+        count = 0;
+        intact = (fd >= 0 && ftruncate(fd, 0) == 0);
+    }
+
+    // Log that has failed to take a record can not restore the gallery any more
+    void append(uint32_t _op, const uint8_t *_data, size_t _size) {
+        if(!intact)
+            return;
+        const uint64_t _header[2] = {_op, _size};
+        intact = writeAll(reinterpret_cast<const uint8_t*>(_header), sizeof(_header)) && writeAll(_data, _size);
+        if(intact)
+            count++;
+    }
+
+    size_t records() const { return count; }
+    size_t bytes() const { return length; }
+    bool isIntact() const { return intact; }
+
+    // Reads the record at _offset and moves _offset to the next one, payload goes to the memory given by _prepare(size)
+    template<typename Prepare>
+    bool read(size_t &_offset, uint32_t &_op, Prepare _prepare) {
+        uint64_t _header[2];
+        if(!readAll(reinterpret_cast<uint8_t*>(_header), sizeof(_header), _offset))
+            return false;
+        _op = static_cast<uint32_t>(_header[0]);
+        return readAll(_prepare(static_cast<size_t>(_header[1])), static_cast<size_t>(_header[1]), _offset);
+    }
+
+private:
+    ReplayLog(const ReplayLog &);
+    ReplayLog &operator=(const ReplayLog &);
+
+    bool writeAll(const uint8_t *_data, size_t _size) {
+        while(_size > 0) {
+            const ssize_t _written = pwrite(fd, _data, _size, static_cast<off_t>(length));
+            if(_written < 0 && errno == EINTR)
+                continue;
+            if(_written <= 0)
+                return false;
+            _data += _written;
+            _size -= static_cast<size_t>(_written);
+            length += static_cast<size_t>(_written);
+        }
+        return true;
+    }
+
+    bool readAll(uint8_t *_data, size_t _size, size_t &_offset) {
+        while(_size > 0) {
+            const ssize_t _read = pread(fd, _data, _size, static_cast<off_t>(_offset));
+            if(_read < 0 && errno == EINTR)
+                continue;
+            if(_read <= 0)
+                return false;
+            _data += _read;
+            _size -= static_cast<size_t>(_read);
+            _offset += static_cast<size_t>(_read);
+        }
+        return true;
+    }
+
+    int fd;
+    size_t length, count;
+    bool intact;
+};
+
+//--------------------------------------------------
+/* Returns descriptor of the shared region if process has been started as the isolation worker,
+ * -1 if it has not, -2 if the variable does not hold an open descriptor */
+int isolationWorkerFD()
+{
+    const char *_value = std::getenv(ISOLATION_WORKER_ENV);
+    if(_value == nullptr)
+        return -1;
+    char *_end = nullptr;
+    errno = 0;
+    const long _fd = std::strtol(_value,&_end,10);
+    if(errno != 0 || _end == _value || *_end != '\0' || _fd < 0 || _fd > INT_MAX || fcntl(static_cast<int>(_fd),F_GETFD) < 0)
+        return -2;
+    return static_cast<int>(_fd);
+}
+
+//--------------------------------------------------
+/* Worker loop: serves requests of IRPITest with Vendor's API linked into the same binary.
+ * Images and templates are passed to Vendor's API straight from the shared memory */
+int runIsolationWorker(int _fd)
+{
+    SharedChannel _channel;
+    if(_fd < 0 || !_channel.attach(_fd)) {
+        std::cerr << ISOLATION_WORKER_ENV << " does not hold the shared region descriptor! Abort...";
+        return 1;
+    }
+    std::shared_ptr<IRPI::IdentInterface> _recognizer;
+    getLinkedImplementation(_recognizer);
+    if(!_recognizer) {
+        std::cerr << "Vendor's API interface version is not supported! Abort...";
+        return 17;
+    }
+    IRPI::CandidateList _candidatelist;
+    std::vector<IRPI::TemplateView> _vbatchtempl;
+    std::vector<IRPI::CandidateList> _vbatchlists;
+    std::unique_ptr<bool[]> _batchdecisions;
+    size_t _batchcapacity = 0;
+    QElapsedTimer _timer;
+    uint32_t _op;
+    const uint8_t *_data;
+    size_t _length;
+    while(_channel.receive(_op,_data,_length)) {
+        IsolationControl *_ctl = _channel.ctl();
+        IRPI::ReturnStatus _status(IRPI::ReturnCode::Success);
+        PayloadReader _in(_data);
+        _ctl->vendorns = 0;
+        switch(_op) {
+            case IsolationPing:
+                _channel.prepare(0);
+                break;
+            case IsolationInitEnrollment:
+            case IsolationInitIdentification: {
+                const uint64_t _size = _in.get<uint64_t>();
+                const std::string _configdir(reinterpret_cast<const char*>(_in.getBytes(_size)), _size);
+                _timer.start();
+                _status = (_op == IsolationInitEnrollment) ? _recognizer->initializeEnrollmentSession(_configdir)
+                                                           : _recognizer->initializeIdentificationSession(_configdir);
+                _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                _ctl->maxtemplsize[0] = _recognizer->maxTemplateSize(IRPI::TemplateRole::Enrollment_1N);
+                _ctl->maxtemplsize[1] = _recognizer->maxTemplateSize(IRPI::TemplateRole::Search_1N);
+                _channel.prepare(0);
+            } break;
+            case IsolationCreateTemplate: {
+                const uint32_t _role = _in.get<uint32_t>();
+                const uint16_t _width = _in.get<uint16_t>();
+                const uint16_t _height = _in.get<uint16_t>();
+                const uint8_t _depth = _in.get<uint8_t>();
+                const size_t _bytes = static_cast<size_t>(_width) * _height * (_depth / 8);
+                // Image points to the shared memory, it is not owned by anyone
+                const IRPI::Image _img(_width,_height,_depth,
+                                       std::shared_ptr<uint8_t>(const_cast<uint8_t*>(_in.getBytes(_bytes)),[](uint8_t*){}));
+                const size_t _maxsize = _ctl->maxtemplsize[_role];
+                if(_maxsize > 0) {
+                    uint8_t *_out = _channel.prepare(sizeof(uint64_t) + _maxsize);
+                    size_t _templsize = 0;
+                    _timer.start();
+                    _status = _recognizer->createTemplate(_img,static_cast<IRPI::TemplateRole>(_role),_out + sizeof(uint64_t),_maxsize,_templsize);
+                    _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                    PayloadWriter(_out).put<uint64_t>(_templsize);
+                    _channel.setLength(sizeof(uint64_t) + _templsize);
+                } else {
+                    std::vector<uint8_t> _templ;
+                    _timer.start();
+                    _status = _recognizer->createTemplate(_img,static_cast<IRPI::TemplateRole>(_role),_templ);
+                    _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                    PayloadWriter _out(_channel.prepare(sizeof(uint64_t) + _templ.size()));
+                    _out.put<uint64_t>(_templ.size());
+                    _out.putBytes(_templ.data(),_templ.size());
+                }
+            } break;
+            case IsolationFinalizeEnrollment:
+            case IsolationInsertTemplates: {
+                const uint64_t _count = _in.get<uint64_t>();
+                std::vector<std::pair<size_t,IRPI::TemplateView>> _vtempl;
+                _vtempl.reserve(_count);
+                for(uint64_t i = 0; i < _count; ++i) {
+                    const uint64_t _label = _in.get<uint64_t>();
+                    const uint64_t _size = _in.get<uint64_t>();
+                    _vtempl.push_back(std::make_pair(static_cast<size_t>(_label),IRPI::TemplateView(_in.getBytes(_size),_size)));
+                }
+                _timer.start();
+                _status = (_op == IsolationFinalizeEnrollment) ? _recognizer->finalizeEnrollment(_vtempl)
+                                                               : _recognizer->insertTemplates(_vtempl);
+                _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                _channel.prepare(0);
+            } break;
+            case IsolationRemoveLabels: {
+                const uint64_t _count = _in.get<uint64_t>();
+                std::vector<size_t> _labels(_count);
+                for(uint64_t i = 0; i < _count; ++i)
+                    _labels[i] = static_cast<size_t>(_in.get<uint64_t>());
+                _timer.start();
+                _status = _recognizer->removeLabels(_labels);
+                _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                _channel.prepare(0);
+            } break;
+            case IsolationIdentify: {
+                const uint64_t _candidates = _in.get<uint64_t>();
+                // steady_clock is CLOCK_MONOTONIC, so the deadline of IRPITest holds here as well
+                const int64_t _deadline = _in.get<int64_t>();
+                const uint64_t _size = _in.get<uint64_t>();
+                const IRPI::TemplateView _templ(_in.getBytes(_size),_size);
+                if(_candidatelist.capacity() != _candidates)
+                    _candidatelist = IRPI::CandidateList(_candidates);
+                _candidatelist.clear();
+                bool _decision = false, _partial = false;
+                _timer.start();
+                if(_deadline != 0)
+                    _status = _recognizer->identifyTemplate(_templ,
+                                                            std::chrono::steady_clock::time_point(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(_deadline))),
+                                                            _candidatelist,_decision,_partial);
+                else
+                    _status = _recognizer->identifyTemplate(_templ,_candidatelist,_decision);
+                _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                PayloadWriter _out(_channel.prepare(2 * sizeof(uint8_t) + candidatesBytes(std::min(_candidatelist.length,_candidatelist.capacity()))));
+                _out.put<uint8_t>(_decision ? 1 : 0);
+                _out.put<uint8_t>(_partial ? 1 : 0);
+                putCandidates(_out,_candidatelist);
+            } break;
+            case IsolationIdentifyBatch: {
+                const uint64_t _count = _in.get<uint64_t>();
+                const uint64_t _candidates = _in.get<uint64_t>();
+                _vbatchtempl.clear();
+                for(uint64_t i = 0; i < _count; ++i) {
+                    const uint64_t _size = _in.get<uint64_t>();
+                    _vbatchtempl.push_back(IRPI::TemplateView(_in.getBytes(_size),_size));
+                }
+                if(_vbatchlists.size() < _count || (_count > 0 && _vbatchlists[0].capacity() != _candidates))
+                    _vbatchlists.assign(_count,IRPI::CandidateList(_candidates));
+                if(_batchcapacity < _count) {
+                    _batchdecisions.reset(new bool[_count]);
+                    _batchcapacity = _count;
+                }
+                _timer.start();
+                _status = _recognizer->identifyTemplates(_vbatchtempl.data(),_count,_vbatchlists.data(),_batchdecisions.get());
+                _ctl->vendorns = static_cast<uint64_t>(_timer.nsecsElapsed());
+                PayloadWriter _out(_channel.prepare(_count * (sizeof(uint8_t) + candidatesBytes(_candidates))));
+                for(uint64_t i = 0; i < _count; ++i) {
+                    _out.put<uint8_t>(_batchdecisions[i] ? 1 : 0);
+                    putCandidates(_out,_vbatchlists[i]);
+                }
+                _channel.setLength(_out.size());
+            } break;
+            case IsolationSetParameter: {
+                const uint64_t _namesize = _in.get<uint64_t>();
+                const std::string _name(reinterpret_cast<const char*>(_in.getBytes(_namesize)), _namesize);
+                const uint64_t _valuesize = _in.get<uint64_t>();
+                const std::string _value(reinterpret_cast<const char*>(_in.getBytes(_valuesize)), _valuesize);
+                _status = _recognizer->setParameter(_name,_value);
+                _channel.prepare(0);
+            } break;
+            case IsolationShutdown:
+                return 0;
+            default:
+                _status = IRPI::ReturnStatus(IRPI::ReturnCode::VendorError,"Unknown request");
+                _channel.prepare(0);
+                break;
+        }
+        _ctl->code = static_cast<int32_t>(_status.code);
+        std::strncpy(_ctl->info,_status.info.c_str(),sizeof(_ctl->info) - 1);
+        _ctl->info[sizeof(_ctl->info) - 1] = '\0';
+        _ctl->responsens = monotonicNs();
+        if(!_channel.send(_op))
+            break;
+    }
+    return 0;
+}
+
+//--------------------------------------------------
+struct IsolationCallStats
+{
+    IsolationCallStats() : calls(0), callns(0), vendorns(0) {}
+    size_t calls;
+    double callns;   // as seen by IRPITest
+    double vendorns; // inside Vendor's API
+    // IPC cost per call
+    double overheadns() const { return calls > 0 ? (callns - vendorns) / calls : 0.0; }
+};
+
+//--------------------------------------------------
+/* Proxy that runs Vendor's API in the worker process, so a crash inside Vendor's API
+ * does not kill IRPITest. Worker that does not answer in the call timeout is killed.
+ * Crashed or killed worker is restarted and gets the same parameters and sessions
+ * initialization again; the call that crashed returns VendorError. Finalization and
+ * successful updates of the gallery are kept in ReplayLog, so the restarted worker gets
+ * them again and searches go on. Only if the log could not be written, calls that need
+ * the gallery return VendorError after the restart.
+ * Note that CPU time accounting of IRPITest does not see CPU time of the worker */
+class IsolatedIdentInterface : public IRPI::IdentInterface
+{
+public:
+    explicit IsolatedIdentInterface(size_t _capacity=(static_cast<size_t>(64) << 20), size_t _timeoutms=0) :
+        areasize(_capacity),
+        timeoutms(_timeoutms),
+        pid(-1),
+        restartcount(0),
+        timeoutcount(0),
+        broken(false),
+        enrollmentinit(false),
+        identificationinit(false),
+        finalized(false),
+        enrollmentlost(false),
+        pingns(0),
+        responsedata(nullptr),
+        responselength(0),
+        vstats(IsolationOpsTotal),
+        postedop(IsolationPing),
+        posted(false),
+        postns(0),
+        lastlatencyns(0) {
+        maxtemplsize[0] = maxtemplsize[1] = 0;
+    }
+
+    ~IsolatedIdentInterface() {
+        if(pid > 0) {
+            channel.prepare(0);
+            channel.send(IsolationShutdown);
+            for(int i = 0; i < 100 && channel.peerAlive(); ++i)
+                usleep(10000);
+            if(channel.peerAlive()) {
+                kill(pid,SIGKILL);
+                waitpid(pid,nullptr,0);
+            }
+        }
+    }
+
+    // Starts the worker and checks that it answers
+    bool start() {
+        if(!channel.create(areasize) || !spawn())
+            return false;
+        channel.setTimeout(static_cast<uint64_t>(timeoutms) * 1000000ULL);
+        channel.prepare(0);
+        IRPI::ReturnStatus _status;
+        return call(IsolationPing,_status,false);
+    }
+
+    // Measures round trip of the empty request, it is the floor of IPC overhead per call
+    void calibrate(size_t _pings) {
+        QElapsedTimer _timer;
+        _timer.start();
+        IRPI::ReturnStatus _status;
+        for(size_t i = 0; i < _pings; ++i) {
+            channel.prepare(0);
+            call(IsolationPing,_status);
+        }
+        pingns = _pings > 0 ? static_cast<double>(_timer.nsecsElapsed()) / _pings : 0.0;
+    }
+
+    IRPI::ReturnStatus initializeEnrollmentSession(const std::string &configDir) override {
+        enrollmentconfig = configDir;
+        IRPI::ReturnStatus _status;
+        sendString(IsolationInitEnrollment,configDir,_status);
+        enrollmentinit = (_status.code == IRPI::ReturnCode::Success);
+        return _status;
+    }
+
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, std::vector<uint8_t> &templ) override {
+        IRPI::ReturnStatus _status;
+        if(requestTemplate(img,role,_status)) {
+            PayloadReader _in(responsedata);
+            const uint64_t _size = _in.get<uint64_t>();
+            const uint8_t *_templ = _in.getBytes(_size);
+            templ.assign(_templ,_templ + _size);
+        }
+        return _status;
+    }
+
+    size_t maxTemplateSize(IRPI::TemplateRole role) const override {
+        return maxtemplsize[static_cast<int>(role)];
+    }
+
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, uint8_t *templ, size_t capacity, size_t &length) override {
+        IRPI::ReturnStatus _status;
+        length = 0;
+        if(requestTemplate(img,role,_status)) {
+            PayloadReader _in(responsedata);
+            const uint64_t _size = _in.get<uint64_t>();
+            if(_size > capacity)
+                return IRPI::ReturnStatus(IRPI::ReturnCode::VendorError,"Template exceeds maxTemplateSize()");
+            std::memcpy(templ,_in.getBytes(_size),_size);
+            length = _size;
+        }
+        return _status;
+    }
+
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,std::vector<uint8_t>>> &vtempl) override {
+        std::vector<std::pair<size_t,IRPI::TemplateView>> _vtempl;
+        _vtempl.reserve(vtempl.size());
+        for(size_t i = 0; i < vtempl.size(); ++i)
+            _vtempl.push_back(std::make_pair(vtempl[i].first,IRPI::TemplateView(vtempl[i].second)));
+        return finalizeEnrollment(_vtempl);
+    }
+
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) override {
+        postFinalizeEnrollment(vtempl);
+        return completeFinalizeEnrollment();
+    }
+
+    /* Split forms of finalizeEnrollment() and identifyTemplate(): post*() sends the request and returns at once,
+     * complete*() waits for the response. So requests to several workers may run at the same time.
+     * Request starts the replay log, so the worker restarted while it finalizes or later gets the same templates.
+     * The log is written while the worker finalizes, the request stays in the outgoing area till the next one */
+    void postFinalizeEnrollment(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) {
+        size_t _bytes;
+        const uint8_t *_ptr = prepareTemplates(vtempl,_bytes);
+        finalized = enrollmentlost = false;
+        post(IsolationFinalizeEnrollment);
+        replaylog.clear();
+        replaylog.append(IsolationFinalizeEnrollment,_ptr,_bytes);
+    }
+
+    IRPI::ReturnStatus completeFinalizeEnrollment() {
+        IRPI::ReturnStatus _status;
+        complete(_status);
+        finalized = (_status.code == IRPI::ReturnCode::Success);
+        if(!finalized)
+            replaylog.clear();
+        return _status;
+    }
+
+    IRPI::ReturnStatus insertTemplates(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) override {
+        size_t _bytes;
+        const uint8_t *_ptr = prepareTemplates(vtempl,_bytes);
+        IRPI::ReturnStatus _status;
+        if(call(IsolationInsertTemplates,_status))
+            logUpdate(IsolationInsertTemplates,_ptr,_bytes,_status);
+        return _status;
+    }
+
+    IRPI::ReturnStatus removeLabels(const std::vector<size_t> &labels) override {
+        const size_t _bytes = sizeof(uint64_t) * (1 + labels.size());
+        uint8_t *_ptr = channel.prepare(_bytes);
+        PayloadWriter _out(_ptr);
+        _out.put<uint64_t>(labels.size());
+        for(size_t i = 0; i < labels.size(); ++i)
+            _out.put<uint64_t>(labels[i]);
+        IRPI::ReturnStatus _status;
+        if(call(IsolationRemoveLabels,_status))
+            logUpdate(IsolationRemoveLabels,_ptr,_bytes,_status);
+        return _status;
+    }
+
+    IRPI::ReturnStatus initializeIdentificationSession(const std::string &configDir) override {
+        identificationconfig = configDir;
+        IRPI::ReturnStatus _status;
+        sendString(IsolationInitIdentification,configDir,_status);
+        identificationinit = (_status.code == IRPI::ReturnCode::Success);
+        return _status;
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const std::vector<uint8_t> &idTemplate, const size_t candidateListLength,
+                                        std::vector<IRPI::Candidate> &candidateList, bool &decision) override {
+        IRPI::CandidateList _candidatelist(candidateListLength);
+        IRPI::ReturnStatus _status = identifyTemplate(IRPI::TemplateView(idTemplate),_candidatelist,decision);
+        for(size_t i = 0; i < _candidatelist.length; ++i)
+            candidateList.push_back(IRPI::Candidate(true,_candidatelist.labels[i],_candidatelist.scores[i]));
+        return _status;
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const IRPI::TemplateView &idTemplate, IRPI::CandidateList &candidateList, bool &decision) override {
+        postIdentifyTemplate(idTemplate,candidateList.capacity());
+        return completeIdentifyTemplate(candidateList,decision);
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const IRPI::TemplateView &idTemplate, std::chrono::steady_clock::time_point deadline,
+                                        IRPI::CandidateList &candidateList, bool &decision, bool &partial) override {
+        postIdentifyTemplate(idTemplate,candidateList.capacity(),
+                             std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count());
+        return completeIdentifyTemplate(candidateList,decision,partial);
+    }
+
+    IRPI::ReturnStatus identifyTemplates(const IRPI::TemplateView *idTemplates, size_t count,
+                                         IRPI::CandidateList *candidateLists, bool *decisions) override {
+        const size_t _k = count > 0 ? candidateLists[0].capacity() : 0;
+        size_t _bytes = 2 * sizeof(uint64_t);
+        for(size_t i = 0; i < count; ++i)
+            _bytes += sizeof(uint64_t) + idTemplates[i].size();
+        PayloadWriter _out(channel.prepare(_bytes));
+        _out.put<uint64_t>(count);
+        _out.put<uint64_t>(_k);
+        for(size_t i = 0; i < count; ++i) {
+            _out.put<uint64_t>(idTemplates[i].size());
+            _out.putBytes(idTemplates[i].data(),idTemplates[i].size());
+        }
+        for(size_t i = 0; i < count; ++i) {
+            candidateLists[i].clear();
+            decisions[i] = false;
+        }
+        IRPI::ReturnStatus _status;
+        if(call(IsolationIdentifyBatch,_status)) {
+            PayloadReader _in(responsedata);
+            for(size_t i = 0; i < count; ++i) {
+                decisions[i] = (_in.get<uint8_t>() != 0);
+                getCandidates(_in,candidateLists[i]);
+            }
+        }
+        return _status;
+    }
+
+    // _deadlinens is steady_clock time in ns, 0 means the search without deadline
+    void postIdentifyTemplate(const IRPI::TemplateView &idTemplate, size_t candidateListLength, int64_t _deadlinens=0) {
+        PayloadWriter _out(channel.prepare(3 * sizeof(uint64_t) + idTemplate.size()));
+        _out.put<uint64_t>(candidateListLength);
+        _out.put<int64_t>(_deadlinens);
+        _out.put<uint64_t>(idTemplate.size());
+        _out.putBytes(idTemplate.data(),idTemplate.size());
+        post(IsolationIdentify);
+    }
+
+    IRPI::ReturnStatus completeIdentifyTemplate(IRPI::CandidateList &candidateList, bool &decision) {
+        bool _partial = false;
+        return completeIdentifyTemplate(candidateList,decision,_partial);
+    }
+
+    IRPI::ReturnStatus completeIdentifyTemplate(IRPI::CandidateList &candidateList, bool &decision, bool &partial) {
+        IRPI::ReturnStatus _status;
+        candidateList.clear();
+        decision = partial = false;
+        if(complete(_status)) {
+            PayloadReader _in(responsedata);
+            decision = (_in.get<uint8_t>() != 0);
+            partial = (_in.get<uint8_t>() != 0);
+            getCandidates(_in,candidateList);
+        }
+        return _status;
+    }
+
+    IRPI::ReturnStatus setParameter(const std::string &name, const std::string &value) override {
+        IRPI::ReturnStatus _status;
+        sendParameter(name,value,_status);
+        if(_status.code == IRPI::ReturnCode::Success) {
+            size_t i = 0;
+            while(i < vparameters.size() && vparameters[i].first != name)
+                ++i;
+            if(i == vparameters.size())
+                vparameters.push_back(std::make_pair(name,value));
+            else
+                vparameters[i].second = value;
+        }
+        return _status;
+    }
+
+    size_t restarts() const { return restartcount; }
+    // Requests and bytes kept to rebuild the gallery of the restarted worker
+    size_t replayRecords() const { return replaylog.records(); }
+    size_t replayBytes() const { return replaylog.bytes(); }
+    size_t timeouts() const { return timeoutcount; }
+    double pingTime() const { return pingns; }
+    size_t areaSize() const { return areasize; }
+    const IsolationCallStats &stats(IsolationOp _op) const { return vstats[_op]; }
+    // From post() till the worker has sent the response of the last completed call
+    double lastLatency() const { return lastlatencyns; }
+
+private:
+    bool spawn() {
+        channel.reset();
+        // Environment is prepared before fork(), child does only exec
+        std::vector<std::string> _env;
+        for(char **_var = environ; *_var != nullptr; ++_var)
+            if(std::strncmp(*_var,ISOLATION_WORKER_ENV "=",std::strlen(ISOLATION_WORKER_ENV) + 1) != 0)
+                _env.push_back(*_var);
+        _env.push_back(std::string(ISOLATION_WORKER_ENV) + "=" + std::to_string(channel.descriptor()));
+        std::vector<char*> _envp;
+        for(size_t i = 0; i < _env.size(); ++i)
+            _envp.push_back(const_cast<char*>(_env[i].c_str()));
+        _envp.push_back(nullptr);
+        char _arg0[] = "IRPITest-worker";
+        char *_argv[] = {_arg0, nullptr};
+        const pid_t _parent = getpid();
+        pid = fork();
+        if(pid < 0)
+            return false;
+        if(pid == 0) {
+            // Worker must not outlive IRPITest
+            prctl(PR_SET_PDEATHSIG,SIGKILL);
+            if(getppid() != _parent)
+                _exit(1);
+            execve("/proc/self/exe",_argv,_envp.data());
+            _exit(127);
+        }
+        channel.setPeer(pid);
+        return true;
+    }
+
+    // Sends prepared request and waits for the response, restarts the worker if it has died
+    bool call(IsolationOp _op, IRPI::ReturnStatus &_status, bool _record=true) {
+        post(_op);
+        return complete(_status,_record);
+    }
+
+    // Worker restarted after finalization has no gallery
+    bool needsGallery(IsolationOp _op) const {
+        return _op == IsolationIdentify || _op == IsolationIdentifyBatch || _op == IsolationInsertTemplates || _op == IsolationRemoveLabels;
+    }
+
+    void post(IsolationOp _op) {
+        Tracer &_tracer = Tracer::instance();
+        const qint64 _tracebegin = _tracer.now();
+        postedop = _op;
+        postns = monotonicNs();
+        calltimer.start();
+        posted = !broken && !(enrollmentlost && needsGallery(_op)) && channel.send(_op);
+        _tracer.record(isolationOpName(_op),"ipc send",_tracebegin);
+    }
+
+    bool complete(IRPI::ReturnStatus &_status, bool _record=true) {
+        const IsolationOp _op = postedop;
+        if(broken) {
+            _status = IRPI::ReturnStatus(IRPI::ReturnCode::VendorError,"Worker process is not available");
+            return false;
+        }
+        if(enrollmentlost && needsGallery(_op)) {
+            _status = IRPI::ReturnStatus(IRPI::ReturnCode::VendorError,"Enrollment data has been lost with the restarted worker process");
+            return false;
+        }
+        uint32_t _responseop;
+        Tracer &_tracer = Tracer::instance();
+        const qint64 _tracebegin = _tracer.now();
+        const bool _received = posted && channel.receive(_responseop,responsedata,responselength);
+        _tracer.record(isolationOpName(_op),"ipc receive",_tracebegin);
+        if(_received) {
+            const double _callns = calltimer.nsecsElapsed();
+            IsolationControl *_ctl = channel.ctl();
+            lastlatencyns = static_cast<double>(_ctl->responsens - postns);
+            _status = IRPI::ReturnStatus(static_cast<IRPI::ReturnCode>(_ctl->code),std::string(_ctl->info));
+            if(_op == IsolationInitEnrollment || _op == IsolationInitIdentification) {
+                maxtemplsize[0] = _ctl->maxtemplsize[0];
+                maxtemplsize[1] = _ctl->maxtemplsize[1];
+            }
+            if(_record) {
+                vstats[_op].calls++;
+                vstats[_op].callns += _callns;
+                vstats[_op].vendorns += _ctl->vendorns;
+            }
+            return true;
+        }
+        if(channel.timedOut()) {
+            channel.killPeer();
+            timeoutcount++;
+            _status = IRPI::ReturnStatus(IRPI::ReturnCode::VendorError,"Vendor's API call timeout (" + std::to_string(timeoutms) + " ms)");
+            std::cout << "  Worker process timed out on " << isolationOpName(_op) << ", killed and restarting" << std::endl;
+        } else {
+            const int _wstatus = channel.peerStatus();
+            std::string _reason = WIFSIGNALED(_wstatus) ? std::string("signal ") + std::to_string(WTERMSIG(_wstatus))
+                                                        : std::string("exit code ") + std::to_string(WEXITSTATUS(_wstatus));
+            _status = IRPI::ReturnStatus(IRPI::ReturnCode::VendorError,"Vendor's API worker process died (" + _reason + ")");
+            std::cout << "  Worker process died on " << isolationOpName(_op) << " (" << _reason << "), restarting" << std::endl;
+        }
+        pid = -1;
+        if(_record && !restart()) {
+            broken = true;
+            std::cout << "  Worker process can not be restarted" << std::endl;
+        }
+        return false;
+    }
+
+    // New worker goes through the same initialization steps the crashed one went
+    bool restart() {
+        restartcount++;
+        if(!spawn())
+            return false;
+        IRPI::ReturnStatus _status;
+        for(size_t i = 0; i < vparameters.size(); ++i)
+            if(!sendParameter(vparameters[i].first,vparameters[i].second,_status,false))
+                return false;
+        if(enrollmentinit && !sendString(IsolationInitEnrollment,enrollmentconfig,_status,false))
+            return false;
+        // Gallery is rebuilt the way it has been built: finalization, identification init, then the updates
+        size_t _offset = 0;
+        const bool _replay = replaylog.isIntact() && replaylog.records() > 0;
+        if(_replay) {
+            if(!replayRecord(_offset,_status))
+                return false;
+        } else if(finalized && !enrollmentlost) {
+            enrollmentlost = true;
+            std::cout << "  Restarted worker process has no enrollment data, searches will fail" << std::endl;
+        }
+        if(identificationinit && !sendString(IsolationInitIdentification,identificationconfig,_status,false))
+            return false;
+        for(size_t i = 1; _replay && i < replaylog.records(); ++i)
+            if(!replayRecord(_offset,_status))
+                return false;
+        if(_replay)
+            std::cout << "  Restarted worker process got enrollment data and " << replaylog.records() - 1 << " update(s) again" << std::endl;
+        return true;
+    }
+
+    bool replayRecord(size_t &_offset, IRPI::ReturnStatus &_status) {
+        uint32_t _op = IsolationPing;
+        if(!replaylog.read(_offset,_op,[this](size_t _size) { return channel.prepare(_size); }))
+            return false;
+        return call(static_cast<IsolationOp>(_op),_status,false);
+    }
+
+    // Successful update of the finalized gallery goes to the replay log, request is still in the outgoing area
+    void logUpdate(IsolationOp _op, const uint8_t *_ptr, size_t _bytes, const IRPI::ReturnStatus &_status) {
+        if(finalized && _status.code == IRPI::ReturnCode::Success && replaylog.records() > 0)
+            replaylog.append(_op,_ptr,_bytes);
+    }
+
+    // Writes templates to the outgoing message, returns the message and its size
+    const uint8_t *prepareTemplates(const std::vector<std::pair<size_t,IRPI::TemplateView>> &_vtempl, size_t &_bytes) {
+        _bytes = sizeof(uint64_t);
+        for(size_t i = 0; i < _vtempl.size(); ++i)
+            _bytes += 2 * sizeof(uint64_t) + _vtempl[i].second.size();
+        uint8_t *_ptr = channel.prepare(_bytes);
+        PayloadWriter _out(_ptr);
+        _out.put<uint64_t>(_vtempl.size());
+        for(size_t i = 0; i < _vtempl.size(); ++i) {
+            _out.put<uint64_t>(_vtempl[i].first);
+            _out.put<uint64_t>(_vtempl[i].second.size());
+            _out.putBytes(_vtempl[i].second.data(),_vtempl[i].second.size());
+        }
+        return _ptr;
+    }
+
+    bool sendString(IsolationOp _op, const std::string &_string, IRPI::ReturnStatus &_status, bool _record=true) {
+        PayloadWriter _out(channel.prepare(sizeof(uint64_t) + _string.size()));
+        _out.put<uint64_t>(_string.size());
+        _out.putBytes(_string.data(),_string.size());
+        return call(_op,_status,_record);
+    }
+
+    bool sendParameter(const std::string &_name, const std::string &_value, IRPI::ReturnStatus &_status, bool _record=true) {
+        PayloadWriter _out(channel.prepare(2 * sizeof(uint64_t) + _name.size() + _value.size()));
+        _out.put<uint64_t>(_name.size());
+        _out.putBytes(_name.data(),_name.size());
+        _out.put<uint64_t>(_value.size());
+        _out.putBytes(_value.data(),_value.size());
+        return call(IsolationSetParameter,_status,_record);
+    }
+
+    bool requestTemplate(const IRPI::Image &_img, IRPI::TemplateRole _role, IRPI::ReturnStatus &_status) {
+        const size_t _bytes = _img.data ? static_cast<size_t>(_img.width) * _img.height * (_img.depth / 8) : 0;
+        PayloadWriter _out(channel.prepare(sizeof(uint32_t) + 2 * sizeof(uint16_t) + sizeof(uint8_t) + _bytes));
+        _out.put<uint32_t>(static_cast<uint32_t>(_role));
+        _out.put<uint16_t>(_bytes > 0 ? _img.width : 0);
+        _out.put<uint16_t>(_bytes > 0 ? _img.height : 0);
+        _out.put<uint8_t>(_img.depth);
+        _out.putBytes(_img.data.get(),_bytes);
+        return call(IsolationCreateTemplate,_status);
+    }
+
+    const size_t areasize, timeoutms;
+    SharedChannel channel;
+    pid_t pid;
+    size_t restartcount, timeoutcount;
+    bool broken, enrollmentinit, identificationinit, finalized, enrollmentlost;
+    std::string enrollmentconfig, identificationconfig;
+    std::vector<std::pair<std::string,std::string>> vparameters; // accepted ones, a restarted worker gets them again
+    ReplayLog replaylog;
+    size_t maxtemplsize[2];
+    double pingns;
+    const uint8_t *responsedata;
+    size_t responselength;
+    std::vector<IsolationCallStats> vstats;
+    IsolationOp postedop;
+    bool posted;
+    uint64_t postns;
+    QElapsedTimer calltimer;
+    double lastlatencyns;
+};
+
+//--------------------------------------------------
+QJsonObject serializeIsolation(const IsolatedIdentInterface &_isolated)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Restarts"] = static_cast<qint64>(_isolated.restarts());
+    _jsonobj["Timeouts"] = static_cast<qint64>(_isolated.timeouts());
+    _jsonobj["Ping_us"]  = 1.e-3 * _isolated.pingTime();
+    _jsonobj["Area_MB"]  = static_cast<qint64>(_isolated.areaSize() >> 20);
+    _jsonobj["Replay_records"] = static_cast<qint64>(_isolated.replayRecords());
+    _jsonobj["Replay_MB"] = static_cast<double>(_isolated.replayBytes()) / (1 << 20);
+    for(int _op = IsolationInitEnrollment; _op <= IsolationIdentifyBatch; ++_op) {
+        const IsolationCallStats &_stats = _isolated.stats(static_cast<IsolationOp>(_op));
+        if(_stats.calls == 0)
+            continue;
+        QJsonObject _opjson;
+        _opjson["Calls"]       = static_cast<qint64>(_stats.calls);
+        _opjson["Vendor_us"]   = 1.e-3 * _stats.vendorns / _stats.calls;
+        _opjson["Overhead_us"] = 1.e-3 * _stats.overheadns();
+        _jsonobj[isolationOpName(_op)] = _opjson;
+    }
+    return _jsonobj;
+}
+
+void showIsolation(const IsolatedIdentInterface &_isolated)
+{
+    std::cout << "  Worker restarts: " << _isolated.restarts() << " (" << _isolated.timeouts() << " on timeout)" << std::endl
+              << "  Empty round trip: " << 1.e-3 * _isolated.pingTime() << " us" << std::endl
+              << "  Replay log: " << _isolated.replayRecords() << " request(s), "
+              << static_cast<double>(_isolated.replayBytes()) / (1 << 20) << " MB" << std::endl;
+    for(int _op = IsolationInitEnrollment; _op <= IsolationIdentifyBatch; ++_op) {
+        const IsolationCallStats &_stats = _isolated.stats(static_cast<IsolationOp>(_op));
+        if(_stats.calls > 0)
+            std::cout << "  " << isolationOpName(_op) << ": " << _stats.calls << " calls"
+                      << ", IPC overhead " << 1.e-3 * _stats.overheadns() << " us per call" << std::endl;
+    }
+}
+
+#endif // Q_OS_LINUX
+
+#endif // ISOLATION_H
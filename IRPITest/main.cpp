@@ -1,19 +1,42 @@
 #include <iostream>
 
-#include "irpihelper.h"
+#include "pipeline.h"
+#include "multivendor.h"
 
 int main(int argc, char *argv[])
 {
 #ifdef Q_OS_WIN
     setlocale(LC_CTYPE,"Rus");
+#endif
+#ifdef Q_OS_LINUX
+    // In isolation mode IRPITest starts itself once more to serve Vendor's API calls
+    const int workerfd = isolationWorkerFD();
+    if(workerfd != -1)
+        return runIsolationWorker(workerfd);
 #endif
     // Default input values
     QDir indir, outdir;
     indir.setPath(""); outdir.setPath("");
-    size_t itpp = 1, etpp = 1, candidates = 64, detpoints = 10000;
-    bool verbose = false, rewriteoutput = false, enabledistractors = false, shuffletemplates = false;
+    size_t itpp = 1, etpp = 1, candidates = 64, detpoints = 10000, warmupcalls = 0;
+    bool verbose = false, rewriteoutput = false, enabledistractors = false, shuffletemplates = false, hwcounters = false;
+    bool tracing = false, coresweep = false, sweepgeneration = false, numaplacement = false, isolation = false;
+    size_t sweepcores = 0; // 0 means all available cores
+    size_t isolationareamb = 64;
+    size_t calltimeoutms = 0; // 0 means worker process may take any time to answer
+    size_t shards = 0; // 0 means no sharding
+    size_t batchsize = 0; // 0 means one identification template per search call
+    size_t shortlist = 0; // 0 means no comparison with two-stage search
+    size_t updateperiod = 0; // 0 means no gallery updates mixed into the search
+    size_t cachesize = 0; // 0 means no result cache
+    size_t bootstrapreplicates = 0; // 0 means no bootstrap confidence intervals
+    bool deadlinesweep = false;
+    std::vector<double> deadlinebudgets; // ns, empty means fractions of the average search time
     uint confexamples = 3;
     std::string apiresourcespath;
+    std::string galleryfile; // empty means gallery stays in memory
+    std::vector<int> cpus; // empty means no restriction
+    std::vector<QString> vendorlibraries; // empty means linked Vendor's API
+    std::vector<std::pair<std::string,std::string>> vendorparameters;
     QImage::Format qimgtargetformat = QImage::Format_RGB888;
     // If no args passed, show help
     if(argc == 1) {
@@ -31,6 +54,25 @@ int main(int argc, char *argv[])
                   << "\t-f[int] - number of exmples to count result confident (default: " << confexamples << ")" << std::endl
                   << "\t-b      - be more verbose (print all measurements)" << std::endl
                   << "\t-s      - shuffle templates before identification" << std::endl
+                  << "\t-q[int] - search identification templates in batches of given size (default: one by one)" << std::endl
+                  << "\t-v[str] - set Vendor's API parameter given as name=value, repeat to set several" << std::endl
+                  << "\t-j[int] - compare exhaustive search with two-stage search on the shortlist of given size (Vendor's API shortlist parameter)" << std::endl
+                  << "\t-U[int] - mix gallery updates into the search, one label is removed or inserted back after every given number of searches on the same thread, so searches run between updates, not concurrently (default: 10)" << std::endl
+                  << "\t-B[int] - bootstrap confidence intervals of TPIR[1] and FNIR with given number of replicates (default: 1000)" << std::endl
+                  << "\t-D[list] - sweep latency budgets of the deadline bounded search given in us, i.e. -D50,100,200 (default: 1/8, 1/4, 1/2, 1 and 2 of the average search time)" << std::endl
+                  << "\t-C[int] - replay identification templates with repeats through the result cache of given number of entries (default: 1024)" << std::endl
+                  << "\t-O[str] - keep gallery in the file at given path and compare its reads by mmap and direct I/O with cold and warm page cache (Vendor's API gallery_file parameter)" << std::endl
+                  << "\t-a[str] - restrict process to the given cpus, i.e. -a0-3,8 (Linux only)" << std::endl
+                  << "\t-k[int] - number of untimed warm-up calls at the beginning of each stage (default: " << warmupcalls << ")" << std::endl
+                  << "\t-x[int] - run core-count scaling sweep of the search over 1, 2, 4 ... cores (default: all available)" << std::endl
+                  << "\t-X      - also sweep identification templates generation (with -x)" << std::endl
+                  << "\t-m      - also compare local and remote NUMA placement of enrollment data (with -x)" << std::endl
+                  << "\t-t      - record timeline of the run and save it in Chrome Trace Event format next to the output file" << std::endl
+                  << "\t-h      - measure hardware performance counters around Vendor's API calls (Linux perf events), with -u or -z worker processes are not counted" << std::endl
+                  << "\t-l[str] - load Vendor's API library at run time, repeat to test several vendors on the same decoded images (Linux only)" << std::endl
+                  << "\t-z[int] - split enrollment set into given number of shards, each searched in its own worker process (Linux only)" << std::endl
+                  << "\t-u[int] - run Vendor's API in the worker process restarted on crash, value sets shared memory area in MB (default: " << isolationareamb << ", Linux only)" << std::endl
+                  << "\t-T[int] - kill and restart the worker process that does not answer Vendor's API call in given number of ms (with -u or -z)" << std::endl
                   << "\t-w      - force output file to be rewritten if already existed" << std::endl;
         return 0;
     }
@@ -76,6 +118,83 @@ int main(int argc, char *argv[])
             case 'd':
                 enabledistractors = true;
                 break;
+            case 'h':
+                hwcounters = true;
+                break;
+            case 't':
+                tracing = true;
+                break;
+            case 'k':
+                warmupcalls = QString(++argv[0]).toUInt();
+                break;
+            case 'x':
+                coresweep = true;
+                sweepcores = QString(++argv[0]).toUInt();
+                break;
+            case 'X':
+                sweepgeneration = true;
+                break;
+            case 'm':
+                numaplacement = true;
+                break;
+            case 'q':
+                batchsize = QString(++argv[0]).toUInt();
+                break;
+            case 'v': {
+                const QString _parameter(++argv[0]);
+                const int _eq = _parameter.indexOf('=');
+                if(_eq <= 0) {
+                    std::cerr << "Vendor's API parameter should be given as name=value! Abort...";
+                    return 18;
+                }
+                vendorparameters.push_back(std::make_pair(_parameter.left(_eq).toStdString(),_parameter.mid(_eq + 1).toStdString()));
+            } break;
+            case 'j':
+                shortlist = QString(++argv[0]).toUInt();
+                break;
+            case 'U':
+                updateperiod = QString(argv[0] + 1).toUInt() > 0 ? QString(++argv[0]).toUInt() : 10;
+                break;
+            case 'B':
+                bootstrapreplicates = QString(argv[0] + 1).toUInt() > 0 ? QString(++argv[0]).toUInt() : 1000;
+                break;
+            case 'D':
+                deadlinesweep = true;
+                if(argv[0][1] != '\0') {
+                    deadlinebudgets = parseBudgetList(QString(++argv[0]));
+                    if(deadlinebudgets.size() == 0) {
+                        std::cerr << "Can not parse list of latency budgets! Abort...";
+                        return 19;
+                    }
+                }
+                break;
+            case 'C':
+                cachesize = QString(argv[0] + 1).toUInt() > 0 ? QString(++argv[0]).toUInt() : 1024;
+                break;
+            case 'O':
+                galleryfile = QString(++argv[0]).toStdString();
+                break;
+            case 'z':
+                shards = QString(++argv[0]).toUInt();
+                break;
+            case 'l':
+                vendorlibraries.push_back(QString(++argv[0]));
+                break;
+            case 'u':
+                isolation = true;
+                if(QString(argv[0] + 1).toUInt() > 0)
+                    isolationareamb = QString(++argv[0]).toUInt();
+                break;
+            case 'T':
+                calltimeoutms = QString(++argv[0]).toUInt();
+                break;
+            case 'a':
+                cpus = parseCPUList(QString(++argv[0]));
+                if(cpus.size() == 0) {
+                    std::cerr << "Can not parse cpu list! Abort...";
+                    return 14;
+                }
+                break;
         }
     // Let's check if user have provided valid paths?
     if(indir.absolutePath().isEmpty()) {
@@ -146,279 +265,123 @@ int main(int argc, char *argv[])
         std::cerr << std::endl << "There is 0 identification templates! Test could not be performed! Abort..." << std::endl;
         return 8;
     }
-    // We need also check if output file already exists
-    QFile outputfile(outdir.absolutePath().append("/%1.json").arg(VENDOR_API_NAME));
-    if(outputfile.exists() && (rewriteoutput == false)) {
-        std::cerr << "Output file already exists in the target location! Abort...";
-        return 9;
-    } else if(outputfile.open(QFile::WriteOnly) == false) {
-        std::cerr << "Can not open output file for write! Abort...";
-        return 10;
-    }
-
-    //----------------------------------------------------------------
-    std::cout << std::endl << "Stage 2 - enrollment templates generation" << std::endl;
-    std::shared_ptr<IRPI::IdentInterface> recognizer = IRPI::IdentInterface::getImplementation();
-    std::cout << "  Initializing Vendor's API: ";
-    QElapsedTimer elapsedtimer;
-    elapsedtimer.start();
-    IRPI::ReturnStatus status = recognizer->initializeEnrollmentSession(apiresourcespath);
-    qint64 einittimems = elapsedtimer.elapsed();
-    std::cout << status.code << std::endl;
-    std::cout << " Time: " << einittimems << " ms" << std::endl;
-    if(status.code != IRPI::ReturnCode::Success) {
-        std::cout << "Vendor's error description: " << status.info << std::endl
-                  << "Can not initialize Vendor's API! Abort..." << std::endl;
-        return 11;
-    }
-
-    std::cout << std::endl << "Starting templates generation..." << std::endl;
-
-    IRPI::Image irpiimg;
-    std::vector<std::pair<size_t,std::vector<uint8_t>>> vetempl;     
-    vetempl.reserve(validsubdirs * etpp);
-    double etgentime = 0; // enrollment template gen time holder
-    size_t eterrors = 0;  // enrollment template gen errors
-    size_t label = 1;     // need to start from 1 because 0 reserved for default value in IRPI::Candidate
-
-    for(int i = 0; i < subdirs.size(); ++i) {
-        QDir _subdir(indir.absolutePath().append("/%1").arg(subdirs.at(i)));
-        QStringList _files = _subdir.entryList(filefilters,QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
-
-        if(static_cast<size_t>(_files.size()) >= minfilespp) {
-            std::cout << std::endl << "  Label: " << label << " - " << subdirs.at(i) << std::endl;
+    TestSetup setup;
+    setup.indir = indir;
+    setup.outdir = outdir;
+    setup.subdirs = subdirs;
+    setup.filefilters = filefilters;
+    setup.distractorfiles = distractorfiles;
+    setup.validsubdirs = validsubdirs;
+    setup.minfilespp = minfilespp;
+    setup.itpp = itpp;
+    setup.etpp = etpp;
+    setup.candidates = candidates;
+    setup.detpoints = detpoints;
+    setup.warmupcalls = warmupcalls;
+    setup.sweepcores = sweepcores;
+    setup.batchsize = batchsize;
+    setup.shortlist = shortlist;
+    setup.updateperiod = updateperiod;
+    setup.cachesize = cachesize;
+    setup.bootstrapreplicates = bootstrapreplicates;
+    setup.confexamples = confexamples;
+    setup.verbose = verbose;
+    setup.rewriteoutput = rewriteoutput;
+    setup.shuffletemplates = shuffletemplates;
+    setup.tracing = tracing;
+    setup.coresweep = coresweep;
+    setup.sweepgeneration = sweepgeneration;
+    setup.numaplacement = numaplacement;
+    setup.deadlinesweep = deadlinesweep;
+    setup.deadlinebudgets = deadlinebudgets;
+    setup.cpus = cpus;
+    setup.apiresourcespath = apiresourcespath;
+    setup.galleryfile = galleryfile;
+    setup.parameters = vendorparameters;
+    setup.qimgtargetformat = qimgtargetformat;
+    setup.startdt = startdt;
 
-            for(size_t j = 0; j < etpp; ++j) {
-                if(verbose)
-                    std::cout << "   - enrollment template: " << _files.at(static_cast<int>(j)) << std::endl;
-                irpiimg = readimage(_subdir.absoluteFilePath(_files.at(static_cast<int>(j))),qimgtargetformat,verbose);
-                std::vector<uint8_t> _templ;
-                elapsedtimer.start();
-                status = recognizer->createTemplate(irpiimg,IRPI::TemplateRole::Enrollment_1N,_templ);
-                etgentime += elapsedtimer.nsecsElapsed();
-                if(status.code != IRPI::ReturnCode::Success) {
-                    eterrors++;
-                    if(verbose) {
-                        std::cout << "   " << status.code << std::endl;
-                        std::cout << "   " << status.info << std::endl;
-                    }
-                } else {
-                    vetempl.push_back(std::make_pair(label,std::move(_templ)));
-                }
-            }
+    if(cpus.size() > 0) {
+        if(!setProcessAffinity(cpus)) {
+            std::cerr << "Can not restrict process to the cpus you've provided! Abort...";
+            return 15;
         }
-        label++;
+        std::cout << "Process restricted to " << cpus.size() << " cpu(s)" << std::endl;
     }
-
-    const size_t enrolllabelmax = label - 1; // we will use this when CMC and DET will be computed
-    etgentime /= vetempl.size();
-    const size_t enrolltemplsizebytes = vetempl[0].second.size();
-    std::cout << "\nEnrollment templates" << std::endl
-              << "  Total:   " << validsubdirs*etpp << std::endl
-              << "  Errors:  " << eterrors << std::endl
-              << "  Avgtime: " << 1e-6 * etgentime << " ms" << std::endl
-              << "  Size:    " << enrolltemplsizebytes << " bytes (before finalizaition)" << std::endl;
-
-
-    std::cout << std::endl << "Finalizing..." << std::endl;
-    elapsedtimer.start();
-    status = recognizer->finalizeEnrollment(vetempl);
-    qint64 finalizetimems = elapsedtimer.elapsed();
-    std::cout << " Time: " << finalizetimems << " ms" << std::endl;
-    if(status.code != IRPI::ReturnCode::Success) {
-        std::cout << "Vendor's error description: " << status.info << std::endl
-                  << "Can not finalize enrollment! Abort..." << std::endl;
-        return 12;
+    if(tracing) {
+        Tracer::instance().enable();
+        Tracer::instance().setThreadName("IRPITest main");
     }
-    // As we need not enroll templates any longer, let's release memory occupied by them
-    vetempl.clear(); vetempl.shrink_to_fit();
-
-    //----------------------------------------------------------------
-    std::cout << std::endl << "Stage 3 - identification templates generation" << std::endl;
-    std::cout << "  Initializing Vendor's API: ";
-    elapsedtimer.start();
-    status = recognizer->initializeIdentificationSession(apiresourcespath);
-    qint64 iinittimems = elapsedtimer.elapsed();
-    std::cout << status.code << std::endl;
-    std::cout << " Time: " << iinittimems << " ms" << std::endl;
-    if(status.code != IRPI::ReturnCode::Success) {
-        std::cout << "Vendor's error description: " << status.info << std::endl
-                  << "Can not initialize Vendor's API! Abort..." << std::endl;
-        return 13;
+    // Hardware counters are optional, so if they are not permitted we just go without them
+    PerfCounters perfcounters;
+    if(hwcounters) {
+        if(perfcounters.open(verbose)) {
+            std::cout << "Hardware performance counters enabled" << std::endl;
+            if(isolation || shards > 0)
+                std::cout << "Note: Vendor's API runs in the worker process, its CPU time is not counted by hardware counters" << std::endl;
+            setup.hwcounters = true;
+        } else {
+            std::cout << "Hardware performance counters are not permitted (check /proc/sys/kernel/perf_event_paranoid), test will go without them" << std::endl;
+        }
     }
 
-    std::cout << std::endl << "Starting templates generation..." << std::endl;
-
-    std::vector<std::vector<uint8_t>> vitempl;
-    std::vector<size_t> vtruelabel;
-    vitempl.reserve(validsubdirs * itpp + distractors);
-    vtruelabel.reserve(validsubdirs * itpp + distractors);
-    double itgentime = 0; // identification template gen time holder
-    size_t iterrors = 0;  // identification template gen errors
-    label = 1;            // need to start from 1 because 0 reserved for default value in IRPI::Candidate
-
-    for(int i = 0; i < subdirs.size(); ++i) {
-        QDir _subdir(indir.absolutePath().append("/%1").arg(subdirs.at(i)));
-        QStringList _files = _subdir.entryList(filefilters,QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
-
-        if(static_cast<size_t>(_files.size()) >= minfilespp) {
-            if(itpp > 0)
-                std::cout << std::endl << "  Label: " << label << " - " << subdirs.at(i) << std::endl;
-
-            for(size_t j = etpp; j < minfilespp; ++j) {
-                if(verbose)
-                    std::cout << "   - identification template: " << _files.at(static_cast<int>(j)) << std::endl;
-                irpiimg = readimage(_subdir.absoluteFilePath(_files.at(static_cast<int>(j))),qimgtargetformat,verbose);
-                std::vector<uint8_t> _templ;
-                elapsedtimer.start();
-                status = recognizer->createTemplate(irpiimg,IRPI::TemplateRole::Search_1N,_templ);
-                itgentime += elapsedtimer.nsecsElapsed();
-                if(status.code != IRPI::ReturnCode::Success) {
-                    iterrors++;
-                    if(verbose) {
-                        std::cout << "   " << status.code << std::endl;
-                        std::cout << "   " << status.info << std::endl;
-                    }
-                } else {
-                    vtruelabel.push_back(label);
-                    vitempl.push_back(std::move(_templ));
-                }
-            }
+    // Vendors loaded at run time go through the same pipeline as the linked one, each image is decoded once for all of them
+    std::vector<std::unique_ptr<VendorRun>> vendors;
+#ifdef Q_OS_LINUX
+    if(vendorlibraries.size() > 0) {
+        if(isolation || shards > 0)
+            std::cout << "Note: options -u and -z are not used when vendors are loaded with -l" << std::endl;
+        for(size_t k = 0; k < vendorlibraries.size(); ++k) {
+            vendors.push_back(loadVendorLibrary(vendorlibraries[k]));
+            if(vendors.back()->active)
+                std::cout << "Vendor's API loaded:\t" << vendors.back()->name.toStdString() << std::endl;
+            else
+                std::cout << "Can not load Vendor's API from " << vendorlibraries[k].toStdString() << " (" << vendors.back()->failure
+                          << "), vendor is excluded from the test" << std::endl;
         }
-        label++;
     }
-    // Also we need process all distractors
-    for(int i = 0; i < distractorfiles.size(); ++i) {
-        std::cout << std::endl << "  Label: " << label << " - " << distractorfiles.at(i) << std::endl;
-        irpiimg = readimage(indir.absoluteFilePath(distractorfiles.at(i)),qimgtargetformat,verbose);
-        std::vector<uint8_t> _templ;
-        elapsedtimer.start();
-        status = recognizer->createTemplate(irpiimg,IRPI::TemplateRole::Search_1N,_templ);
-        itgentime += elapsedtimer.nsecsElapsed();
-        if(status.code != IRPI::ReturnCode::Success) {
-            iterrors++;
-            if(verbose) {
-                std::cout << "   " << status.code << std::endl;
-                std::cout << "   " << status.info << std::endl;
+#endif
+    if(vendors.size() == 0) {
+        vendors.push_back(std::unique_ptr<VendorRun>(new VendorRun()));
+        VendorRun &_vendor = *vendors.back();
+        _vendor.name = VENDOR_API_NAME;
+#ifdef Q_OS_LINUX
+        if(shards > 0) {
+            _vendor.shardedrecognizer = std::make_shared<ShardedIdentInterface>(shards,isolationareamb << 20,calltimeoutms);
+            if(!_vendor.shardedrecognizer->start()) {
+                std::cerr << "Can not start Vendor's API worker processes! Abort...";
+                return 16;
+            }
+            std::cout << "Enrollment set is split into " << shards << " shards, each in its own worker process" << std::endl;
+            _vendor.recognizer = _vendor.shardedrecognizer;
+            _vendor.shards = shards;
+        } else if(isolation) {
+            _vendor.isolatedrecognizer = std::make_shared<IsolatedIdentInterface>(isolationareamb << 20,calltimeoutms);
+            if(!_vendor.isolatedrecognizer->start()) {
+                std::cerr << "Can not start Vendor's API worker process! Abort...";
+                return 16;
             }
-        } else {            
-            vtruelabel.push_back(label);
-            vitempl.push_back(std::move(_templ));
+            _vendor.isolatedrecognizer->calibrate(1000);
+            std::cout << "Vendor's API runs in the worker process, empty round trip: " << 1.e-3 * _vendor.isolatedrecognizer->pingTime() << " us" << std::endl;
+            _vendor.recognizer = _vendor.isolatedrecognizer;
         }
-        label++;
-    }
-
-    itgentime /= vitempl.size();
-    //const size_t valididenttempl = vitempl.size();
-    const size_t identtemplsizebytes = vitempl[0].size();
-    std::cout << "\nIdentification templates" << std::endl
-              << "  Total:   " << validsubdirs*itpp + distractors
-              << "  (distractors: " << distractors << ")" << std::endl
-              << "  Errors:  " << iterrors << std::endl
-              << "  Avgtime: " << 1.e-6 * itgentime << " ms" << std::endl
-              << "  Size:    " << identtemplsizebytes << " bytes" << std::endl;
-
-    // Optional shuffle identification templates
-    if(shuffletemplates) {
-        std::srand ( unsigned ( std::time(0) ) );
-        std::cout << std::endl << "Shuffling templates" << std::endl;
-        random_shuffle(vtruelabel.begin(),vtruelabel.end(),vitempl.begin(),vitempl.end());
-    }
-
-    std::cout << std::endl << "Stage 4 - identification search" << std::endl;
-    double searchtimens = 0;
-    std::vector<std::vector<IRPI::Candidate>> vcandidates;
-    vcandidates.reserve(vitempl.size());
-    std::vector<bool> vdecisions;
-    vdecisions.reserve(vitempl.size());
-    bool decision;
-    for(size_t i = 0; i < vitempl.size(); ++i) {
-        std::cout << "  Identification for label: " << vtruelabel[i] << std::endl;
-        std::vector<IRPI::Candidate> vprediction;
-        decision = false;
-        elapsedtimer.start();
-        status = recognizer->identifyTemplate(vitempl[i],candidates,vprediction,decision);
-        searchtimens += elapsedtimer.nsecsElapsed();
-        if(status.code != IRPI::ReturnCode::Success) {
-            if(verbose) {
-                std::cout << "   " << status.code << std::endl;
-                std::cout << "   " << status.info << std::endl;
+#else
+        if(isolation || shards > 0)
+            std::cout << "Isolation and sharding of Vendor's API are supported on Linux only, test will go without them" << std::endl;
+#endif
+        if(!_vendor.recognizer) {
+            const int _version = getLinkedImplementation(_vendor.recognizer);
+            if(!_vendor.recognizer) {
+                std::cerr << "Vendor's API built with interface version " << _version << " is not supported! Abort...";
+                return 17;
             }
-        } else {
-            vdecisions.push_back(decision);
-            vcandidates.push_back(std::move(vprediction));
+            _vendor.baseline = _version == 0;
+            if(_vendor.baseline)
+                std::cout << "Vendor's API is built against baseline irpi.h, only its baseline members are called" << std::endl;
         }
     }
-
-    searchtimens /= vitempl.size();
-    std::cout << std::endl << "  Total identifications: " << vitempl.size() << std::endl;
-    std::cout << "  Avg identification time: " << searchtimens*1e-3 << " us" << std::endl;
-    // As we need not ident templates any longer, let's release memory occupied by them
-    vitempl.clear(); vitempl.shrink_to_fit();       
-
-    std::cout << std::endl << "Stage 5 - CMC and DET computation" << std::endl << std::endl;
-    std::vector<CMCPoint> vCMC = computeCMC(vcandidates,vtruelabel,enrolllabelmax);
-    if(vCMC.size() > 0)
-        std::cout << "  Best TPIR[1]: "
-                  << QString::number(vCMC[0].mTPIR,'f',validdigits(validsubdirs * itpp * etpp, confexamples)).toStdString()
-                  << std::endl;
-
-    double bestFPIR = 1.0, bestFNIR = 1.0;
-    std::vector<DETPoint> vDET;
-    if(distractors > 0) {
-        vDET = computeDET(vcandidates,vtruelabel,enrolllabelmax,detpoints,confexamples);
-        bestFPIR = std::exp(std::log(10.0) * -validdigits(distractors * etpp, confexamples));
-        bestFNIR = findFNIR(vDET,bestFPIR);
-        std::cout << "  Best FNIR (FPIR): "
-                  << QString::number(bestFNIR,'f',validdigits(validsubdirs * itpp * etpp, confexamples)).toStdString()
-                  << " ("
-                  << QString::number(bestFPIR,'f',validdigits(distractors * etpp, confexamples)).toStdString()
-                  << ")" << std::endl;
-    }
-
-
-    QDateTime enddt = QDateTime::currentDateTime();
-    // Let's print time consumption
-    showTimeConsumption(startdt.secsTo(enddt));
-    // In the end we need to serialize test data
-    std::cout << " Wait untill output data will be saved..." << std::endl;
-
-    QJsonObject jsonobj;
-    jsonobj["Name"]       = VENDOR_API_NAME;
-    jsonobj["StartDT"]    = startdt.toString("dd.MM.yyyy hh:mm:ss");
-    jsonobj["EndDT"]      = enddt.toString("dd.MM.yyyy hh:mm:ss");
-    jsonobj["CMC"]        = serializeCMC(vCMC);
-    if(distractors > 0)
-        jsonobj["DET"]    = serializeDET(vDET);
-
-    QJsonObject _ejson;
-    _ejson["Templates"]   = static_cast<int>(validsubdirs*etpp);
-    _ejson["Perperson"]   = static_cast<int>(etpp);
-    _ejson["Errors"]      = static_cast<int>(eterrors);
-    _ejson["Gentime_ms"]  = 1.e-6 * etgentime;
-    _ejson["Size_bytes"]  = static_cast<int>(enrolltemplsizebytes);
-    _ejson["Rejection_rate"] = std::max(eterrors / static_cast<double>(validsubdirs*etpp),
-                                        confexamples / static_cast<double>(validsubdirs*etpp));
-    jsonobj["Enrollment"] = _ejson;
-    QJsonObject _ijson;
-    _ijson["Templates"]   = static_cast<int>(validsubdirs*itpp);
-    _ijson["Perperson"]   = static_cast<int>(itpp);
-    _ijson["Distractors"] = static_cast<int>(distractors);
-    _ijson["Errors"]      = static_cast<int>(iterrors);
-    _ijson["Gentime_ms"]  = 1.e-6 * itgentime;
-    _ijson["Size_bytes"]  = static_cast<int>(identtemplsizebytes);
-    _ijson["Rejection_rate"] = std::max(iterrors / static_cast<double>(validsubdirs*itpp),
-                                        confexamples / static_cast<double>(validsubdirs*itpp));
-    jsonobj["Identification"] = _ijson;
-
-    jsonobj["Searchtime_us"] = searchtimens * 1.e-3;
-    jsonobj["Einittime_ms"]  = einittimems;
-    jsonobj["Efinalizetime_ms"] = finalizetimems;
-    jsonobj["Iinittime_ms"]  = iinittimems;
-    jsonobj["FNIR"] = bestFNIR;
-    jsonobj["FPIR"] = bestFPIR;
-    outputfile.write(QJsonDocument(jsonobj).toJson());
-    outputfile.close();
-    std::cout << " Done" << std::endl;
-    return 0;
+    // Each vendor keeps its gallery in its own file
+    for(size_t k = 0; k < vendors.size() && !galleryfile.empty(); ++k)
+        vendors[k]->galleryfile = vendors.size() > 1 ? galleryfile + "." + vendors[k]->name.toStdString() : galleryfile;
+    return runTest(vendors,setup,perfcounters);
 }
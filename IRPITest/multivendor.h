@@ -0,0 +1,66 @@
+#ifndef MULTIVENDOR_H
+#define MULTIVENDOR_H
+
+#ifdef Q_OS_LINUX
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dlfcn.h>
+
+#include <QFileInfo>
+
+#include "irpi.h"
+#include "baselinevendor.h"
+#include "pipeline.h"
+
+// Itanium C++ ABI name of IRPI::IdentInterface::getImplementation(), libraries built against older irpi.h export only this one
+#define IRPI_BASELINE_FACTORY_SYMBOL "_ZN4IRPI14IdentInterface17getImplementationEv"
+
+//--------------------------------------------------
+/* Loads Vendor's API from _filename. All vendors export the same symbols, so each library
+ * is opened with RTLD_LOCAL | RTLD_DEEPBIND and the entry point is resolved from its own handle.
+ * Vendor that can not be loaded is returned excluded from the test */
+std::unique_ptr<VendorRun> loadVendorLibrary(const QString &_filename)
+{
+    std::unique_ptr<VendorRun> _vendor(new VendorRun());
+    _vendor->name = QFileInfo(_filename).completeBaseName();
+    if(_vendor->name.startsWith("lib"))
+        _vendor->name = _vendor->name.mid(3);
+    void *_handle = dlopen(_filename.toLocal8Bit().constData(), RTLD_NOW | RTLD_LOCAL | RTLD_DEEPBIND);
+    if(_handle == nullptr) {
+        _vendor->exclude(17,"dlopen",std::string(dlerror()));
+        return _vendor;
+    }
+    _vendor->library = std::shared_ptr<void>(_handle,dlclose);
+    typedef int (*Entry)(std::shared_ptr<IRPI::IdentInterface> *);
+    typedef std::shared_ptr<IRPI::IdentInterface> (*Factory)();
+    Entry _entry = reinterpret_cast<Entry>(dlsym(_handle, "irpiGetImplementation"));
+    if(_entry != nullptr) {
+        // Newer interface only appends members, so its vtable starts with ours
+        const int _version = _entry(&_vendor->recognizer);
+        if(_version < IRPI_INTERFACE_VERSION) {
+            _vendor->recognizer.reset();
+            _vendor->exclude(17,"irpiGetImplementation","interface version " + std::to_string(_version) + " is not supported");
+            return _vendor;
+        }
+    } else {
+        Factory _factory = reinterpret_cast<Factory>(dlsym(_handle, IRPI_BASELINE_FACTORY_SYMBOL));
+        if(_factory == nullptr) {
+            _vendor->exclude(17,"dlsym","neither irpiGetImplementation() nor getImplementation() is exported");
+            return _vendor;
+        }
+        const std::shared_ptr<IRPI::IdentInterface> _baseline = _factory();
+        if(_baseline)
+            _vendor->recognizer = std::make_shared<BaselineIdentInterface>(_baseline);
+        _vendor->baseline = true;
+    }
+    if(!_vendor->recognizer)
+        _vendor->exclude(17,"getImplementation","no implementation is returned");
+    return _vendor;
+}
+
+#endif // Q_OS_LINUX
+
+#endif // MULTIVENDOR_H
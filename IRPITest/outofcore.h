@@ -0,0 +1,91 @@
+#ifndef OUTOFCORE_H
+#define OUTOFCORE_H
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+#ifdef Q_OS_LINUX
+    #include <fcntl.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+//--------------------------------------------------
+/* Drops pages of the file from the page cache, so the next read goes to the storage.
+ * Pages mapped by a process stay in the cache, so the Vendor's API shall unmap them first.
+ * Returns size of the file, 0 if there is no such file */
+size_t evictFileCache(const std::string &_path)
+{
+#ifdef Q_OS_LINUX
+    const int _fd = ::open(_path.c_str(), O_RDONLY);
+    if(_fd < 0)
+        return 0;
+    struct stat _stat;
+    const size_t _bytes = ::fstat(_fd, &_stat) == 0 ? static_cast<size_t>(_stat.st_size) : 0;
+    ::fdatasync(_fd);
+    ::posix_fadvise(_fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(_fd);
+    return _bytes;
+#else
+    (void)_path;
+    return 0;
+#endif
+}
+
+// Gallery is in one file, or in one file per shard when it is split (see sharding.h)
+size_t evictGalleryFiles(const std::string &_path, size_t _shards)
+{
+    if(_shards == 0)
+        return evictFileCache(_path);
+    size_t _bytes = 0;
+    for(size_t s = 0; s < _shards; ++s)
+        _bytes += evictFileCache(_path + ".shard" + std::to_string(s));
+    return _bytes;
+}
+
+//--------------------------------------------------
+// Search over the gallery file read in one way (Vendor's API gallery_io parameter)
+struct OutOfCorePoint
+{
+    OutOfCorePoint() : coldns(0), warmns(0) {}
+    std::string mode;
+    double coldns; // first search after the file has been evicted from the page cache
+    double warmns; // average of the following searches
+};
+
+// Gallery bytes scanned per second by one search, GB/s
+double scanThroughput(size_t _bytes, double _ns)
+{
+    return _ns > 0 ? _bytes / _ns : 0.0;
+}
+
+QJsonObject serializeOutOfCore(const std::vector<OutOfCorePoint> &_vpoints, size_t _bytes)
+{
+    QJsonArray _jsonarr;
+    for(size_t i = 0; i < _vpoints.size(); ++i) {
+        QJsonObject _jsonobj;
+        _jsonobj["Mode"]      = QString::fromStdString(_vpoints[i].mode);
+        _jsonobj["Cold_ms"]   = 1.e-6 * _vpoints[i].coldns;
+        _jsonobj["Cold_GBps"] = scanThroughput(_bytes,_vpoints[i].coldns);
+        _jsonobj["Warm_ms"]   = 1.e-6 * _vpoints[i].warmns;
+        _jsonobj["Warm_GBps"] = scanThroughput(_bytes,_vpoints[i].warmns);
+        _jsonarr.push_back(_jsonobj);
+    }
+    QJsonObject _jsonobj;
+    _jsonobj["File_MB"] = _bytes / (1024.0 * 1024.0);
+    _jsonobj["Modes"]   = _jsonarr;
+    return _jsonobj;
+}
+
+void showOutOfCore(const OutOfCorePoint &_point, size_t _bytes)
+{
+    std::cout << "  " << _point.mode << ": cold " << 1.e-6 * _point.coldns << " ms ("
+              << scanThroughput(_bytes,_point.coldns) << " GB/s), warm " << 1.e-6 * _point.warmns << " ms ("
+              << scanThroughput(_bytes,_point.warmns) << " GB/s)" << std::endl;
+}
+
+#endif // OUTOFCORE_H
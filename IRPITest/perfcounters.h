@@ -0,0 +1,206 @@
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+#include <QJsonObject>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+// Hardware events we are interested in, order matters as it defines layout of the group read
+enum PerfEvent {
+    PerfCycles = 0,
+    PerfInstructions,
+    PerfLLCMisses,
+    PerfBranchMisses,
+    PerfDTLBMisses,
+    PerfEventsTotal
+};
+
+//--------------------------------------------------
+struct PerfStage
+{
+    PerfStage() : calls(0), unscheduled(false) {
+        for(int i = 0; i < PerfEventsTotal; ++i) {
+            counts[i] = 0;
+            valid[i] = false;
+        }
+    }
+    size_t   calls;
+    uint64_t counts[PerfEventsTotal];
+    bool     valid[PerfEventsTotal]; // false if event is not supported by the hardware or kernel
+    bool     unscheduled; // counters did not run during some call, so sums are incomplete and all events are invalid
+
+    double perCall(PerfEvent _event) const {
+        return calls > 0 ? static_cast<double>(counts[_event]) / calls : 0.0;
+    }
+};
+
+//--------------------------------------------------
+/* Wraps perf_event_open group of the counters attached to the calling thread.
+ * Note that only the thread that calls start()/stop() is measured, so work that
+ * Vendor's API offloads to its own threads is not accounted here */
+class PerfCounters
+{
+public:
+    PerfCounters() : leader(-1), opened(0) {
+        for(int i = 0; i < PerfEventsTotal; ++i) {
+            fd[i] = -1;
+            slot[i] = -1;
+        }
+    }
+    ~PerfCounters() { close(); }
+
+    // Returns false when perf events are not permitted or not supported, in such case start()/stop() do nothing
+    bool open(bool _verbose=false) {
+#ifdef Q_OS_LINUX
+        const uint32_t _types[PerfEventsTotal] = {PERF_TYPE_HARDWARE,
+                                                  PERF_TYPE_HARDWARE,
+                                                  PERF_TYPE_HW_CACHE,
+                                                  PERF_TYPE_HARDWARE,
+                                                  PERF_TYPE_HW_CACHE};
+        const uint64_t _configs[PerfEventsTotal] = {PERF_COUNT_HW_CPU_CYCLES,
+                                                    PERF_COUNT_HW_INSTRUCTIONS,
+                                                    PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+                                                    PERF_COUNT_HW_BRANCH_MISSES,
+                                                    PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)};
+        for(int i = 0; i < PerfEventsTotal; ++i) {
+            perf_event_attr _attr;
+            std::memset(&_attr, 0, sizeof(_attr));
+            _attr.size = sizeof(_attr);
+            _attr.type = _types[i];
+            _attr.config = _configs[i];
+            _attr.disabled = (leader == -1) ? 1 : 0;
+            _attr.exclude_kernel = 1;
+            _attr.exclude_hv = 1;
+            _attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+            fd[i] = static_cast<int>(syscall(__NR_perf_event_open, &_attr, 0, -1, leader, 0));
+            if(fd[i] == -1) {
+                if(_verbose)
+                    std::cout << "  Perf event " << i << " is not available: " << std::strerror(errno) << std::endl;
+                continue;
+            }
+            if(leader == -1)
+                leader = fd[i];
+            slot[i] = opened++;
+        }
+        if(leader == -1)
+            return false;
+        return true;
+#else
+        (void)_verbose;
+        return false;
+#endif
+    }
+
+    bool isOpened() const { return leader != -1; }
+
+    void start() {
+#ifdef Q_OS_LINUX
+        if(leader != -1) {
+            ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
+    }
+
+    void stop(PerfStage &_stage) {
+#ifdef Q_OS_LINUX
+        if(leader == -1)
+            return;
+        ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        // Layout of the group read: nr, time_enabled, time_running, values[nr]
+        uint64_t _buffer[3 + PerfEventsTotal];
+        if(read(leader, _buffer, sizeof(_buffer)) < static_cast<ssize_t>(3 * sizeof(uint64_t)))
+            return;
+        _stage.calls++;
+        // Group that has been enabled, but never scheduled on the PMU counted nothing, there is nothing to scale
+        if(_buffer[2] == 0 && _buffer[1] > 0)
+            _stage.unscheduled = true;
+        if(_stage.unscheduled) {
+            for(int i = 0; i < PerfEventsTotal; ++i)
+                _stage.valid[i] = false;
+            return;
+        }
+        // If kernel had to multiplex counters, we need to scale them
+        const double _scale = (_buffer[2] > 0) ? static_cast<double>(_buffer[1]) / _buffer[2] : 1.0;
+        for(int i = 0; i < PerfEventsTotal; ++i) {
+            if(slot[i] != -1 && static_cast<uint64_t>(slot[i]) < _buffer[0]) {
+                _stage.counts[i] += static_cast<uint64_t>(_scale * _buffer[3 + slot[i]]);
+                _stage.valid[i] = true;
+            }
+        }
+#else
+        (void)_stage;
+#endif
+    }
+
+    void close() {
+#ifdef Q_OS_LINUX
+        for(int i = 0; i < PerfEventsTotal; ++i)
+            if(fd[i] != -1) {
+                ::close(fd[i]);
+                fd[i] = -1;
+            }
+#endif
+        leader = -1;
+        opened = 0;
+    }
+
+private:
+    PerfCounters(const PerfCounters &);
+    PerfCounters &operator=(const PerfCounters &);
+
+    int fd[PerfEventsTotal];
+    int slot[PerfEventsTotal]; // position of the event inside group read
+    int leader;
+    int opened;
+};
+
+//--------------------------------------------------
+QJsonObject serializePerfStage(const PerfStage &_stage)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Calls"] = static_cast<qint64>(_stage.calls);
+    if(_stage.unscheduled)
+        _jsonobj["Unscheduled"] = true;
+    if(_stage.valid[PerfCycles])
+        _jsonobj["Cycles_per_call"] = _stage.perCall(PerfCycles);
+    if(_stage.valid[PerfInstructions])
+        _jsonobj["Instructions_per_call"] = _stage.perCall(PerfInstructions);
+    if(_stage.valid[PerfCycles] && _stage.valid[PerfInstructions] && _stage.counts[PerfCycles] > 0)
+        _jsonobj["IPC"] = static_cast<double>(_stage.counts[PerfInstructions]) / _stage.counts[PerfCycles];
+    if(_stage.valid[PerfLLCMisses])
+        _jsonobj["LLC_misses_per_call"] = _stage.perCall(PerfLLCMisses);
+    if(_stage.valid[PerfBranchMisses])
+        _jsonobj["Branch_misses_per_call"] = _stage.perCall(PerfBranchMisses);
+    if(_stage.valid[PerfDTLBMisses])
+        _jsonobj["DTLB_misses_per_call"] = _stage.perCall(PerfDTLBMisses);
+    return _jsonobj;
+}
+
+void showPerfStage(const char *_name, const PerfStage &_stage)
+{
+    std::cout << "  " << _name << ": calls " << _stage.calls;
+    if(_stage.unscheduled)
+        std::cout << ", counters were not scheduled, no data";
+    if(_stage.valid[PerfCycles] && _stage.valid[PerfInstructions] && _stage.counts[PerfCycles] > 0)
+        std::cout << ", IPC " << static_cast<double>(_stage.counts[PerfInstructions]) / _stage.counts[PerfCycles];
+    if(_stage.valid[PerfLLCMisses])
+        std::cout << ", LLC misses/call " << _stage.perCall(PerfLLCMisses);
+    if(_stage.valid[PerfBranchMisses])
+        std::cout << ", branch misses/call " << _stage.perCall(PerfBranchMisses);
+    if(_stage.valid[PerfDTLBMisses])
+        std::cout << ", dTLB misses/call " << _stage.perCall(PerfDTLBMisses);
+    std::cout << std::endl;
+}
+
+#endif // PERFCOUNTERS_H
@@ -0,0 +1,1042 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <QDateTime>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include "irpi.h"
+#include "irpihelper.h"
+#include "perfcounters.h"
+#include "cputime.h"
+#include "cpuaffinity.h"
+#include "scalingsweep.h"
+#include "warmup.h"
+#include "tracing.h"
+#include "templatearena.h"
+#include "isolation.h"
+#include "sharding.h"
+#include "shortlist.h"
+#include "outofcore.h"
+#include "updates.h"
+#include "resultcache.h"
+#include "deadline.h"
+#include "bootstrap.h"
+
+//--------------------------------------------------
+// Everything main() has found out about the test before Vendor's API is involved
+struct TestSetup
+{
+    TestSetup() :
+        validsubdirs(0),
+        minfilespp(0),
+        itpp(1),
+        etpp(1),
+        candidates(64),
+        detpoints(10000),
+        warmupcalls(0),
+        sweepcores(0),
+        batchsize(0),
+        shortlist(0),
+        updateperiod(0),
+        cachesize(0),
+        bootstrapreplicates(0),
+        confexamples(3),
+        verbose(false),
+        rewriteoutput(false),
+        shuffletemplates(false),
+        hwcounters(false),
+        tracing(false),
+        coresweep(false),
+        sweepgeneration(false),
+        numaplacement(false),
+        deadlinesweep(false),
+        qimgtargetformat(QImage::Format_RGB888) {}
+
+    QDir indir, outdir;
+    QStringList subdirs, filefilters, distractorfiles;
+    size_t validsubdirs, minfilespp, itpp, etpp, candidates, detpoints, warmupcalls;
+    size_t sweepcores, batchsize, shortlist, updateperiod, cachesize, bootstrapreplicates;
+    uint confexamples;
+    bool verbose, rewriteoutput, shuffletemplates, hwcounters, tracing;
+    bool coresweep, sweepgeneration, numaplacement, deadlinesweep;
+    std::vector<double> deadlinebudgets; // ns, empty means fractions of the average search time
+    std::vector<int> cpus;               // empty means no restriction
+    std::string apiresourcespath;
+    std::string galleryfile;             // empty means gallery stays in memory
+    std::vector<std::pair<std::string,std::string>> parameters; // given with -v
+    QImage::Format qimgtargetformat;
+    QDateTime startdt;
+};
+
+//--------------------------------------------------
+/* Vendor's API under test along with everything IRPITest measures for it.
+ * The vendor is either linked to IRPITest or loaded at run time, in the latter
+ * case library keeps the code loaded until all Vendor's objects are gone */
+struct VendorRun
+{
+    VendorRun() :
+        active(true),
+        baseline(false),
+        failurecode(0),
+        shards(0),
+        emaxtemplsize(0),
+        imaxtemplsize(0),
+        eterrors(0),
+        iterrors(0),
+        enrolltemplsizebytes(0),
+        identtemplsizebytes(0),
+        etgentime(0),
+        itgentime(0),
+        searchtimens(0),
+        steadypagefaultspercall(0),
+        einittimems(0),
+        finalizetimems(0),
+        iinittimems(0),
+        iinitpagefaults(0),
+        coldpagefaults(0),
+        galleryfilebytes(0),
+        cacherequests(0),
+        bestFPIR(1.0),
+        bestFNIR(1.0) {}
+
+    // Vendor is excluded from the test, the reason goes to its output file
+    void exclude(int _code, const std::string &_stage, const IRPI::ReturnStatus &_status) {
+        std::stringstream _stream;
+        _stream << _status.code;
+        exclude(_code,_stage,_stream.str() + (_status.info.empty() ? "" : ": " + _status.info));
+    }
+    void exclude(int _code, const std::string &_stage, const std::string &_failure) {
+        active = false;
+        failurecode = _code;
+        failurestage = _stage;
+        failure = _failure;
+    }
+
+    std::shared_ptr<void> library; // declared first, so it is released after all Vendor's objects
+    QString name;
+    std::shared_ptr<IRPI::IdentInterface> recognizer;
+#ifdef Q_OS_LINUX
+    std::shared_ptr<IsolatedIdentInterface> isolatedrecognizer;
+    std::shared_ptr<ShardedIdentInterface> shardedrecognizer;
+#endif
+    bool active; // false after fatal error, vendor is skipped then
+    bool baseline; // built against baseline irpi.h, so the search goes through its vector based identifyTemplate()
+    int failurecode;
+    std::string failurestage, failure;
+    size_t shards; // 0 means Vendor's API is not sharded
+    std::string galleryfile;
+    MemoryRanges enrollmentmemory; // mapped by Vendor's API in finalization and identification init, NUMA placement moves it
+    QFile outputfile;
+
+    TemplateArena etemplarena, itemplarena;
+    size_t emaxtemplsize, imaxtemplsize;
+    std::vector<std::pair<size_t,IRPI::TemplateView>> vetempl;
+    std::vector<IRPI::TemplateView> vitempl;
+    std::vector<size_t> vtruelabel;
+    std::vector<std::vector<IRPI::Candidate>> vcandidates;
+    // Mixed workload inserts templates of some labels again, so they are kept
+    std::vector<std::vector<uint8_t>> vupdatecopies;
+    std::vector<std::vector<std::pair<size_t,IRPI::TemplateView>>> vupdategroups;
+    size_t eterrors, iterrors, enrolltemplsizebytes, identtemplsizebytes;
+    double etgentime, itgentime, searchtimens, steadypagefaultspercall;
+    qint64 einittimems, finalizetimems, iinittimems, iinitpagefaults, coldpagefaults;
+    CPUStage einitcpu, ecpu, fcpu, iinitcpu, icpu, scpu;
+    PerfStage eperf, fperf, iperf, sperf; // enrollment, finalization, identification and search counters
+    LatencyTrace etrace, itrace, strace;
+
+    std::vector<ScalingPoint> vsearchscaling, vgenscaling;
+    std::vector<NUMAPoint> vnumascaling;
+    ShortlistComparison shortlistcmp;
+    std::vector<std::vector<IRPI::Candidate>> vshortlistcandidates;
+    std::vector<OutOfCorePoint> voutofcore;
+    size_t galleryfilebytes;
+    MixedWorkload mixedworkload;
+    std::shared_ptr<CachedIdentInterface> cachedrecognizer;
+    size_t cacherequests;
+    std::vector<DeadlinePoint> vdeadlines;
+    QJsonObject shardingjson;
+
+    std::vector<CMCPoint> vCMC;
+    std::vector<DETPoint> vDET;
+    double bestFPIR, bestFNIR;
+    BootstrapResult bootstrap;
+
+private:
+    VendorRun(const VendorRun &);
+    VendorRun &operator=(const VendorRun &);
+};
+
+//--------------------------------------------------
+// Gives the same decoded image to every active vendor and keeps template in the vendor's arena
+void createTemplates(std::vector<std::unique_ptr<VendorRun>> &_vvendors,
+                     const IRPI::Image &_img,
+                     IRPI::TemplateRole _role,
+                     size_t _label,
+                     const TestSetup &_setup,
+                     PerfCounters &_perfcounters)
+{
+    Tracer &_tracer = Tracer::instance();
+    QElapsedTimer _elapsedtimer;
+    CPUTimer _cputimer;
+    const bool _enrollment = (_role == IRPI::TemplateRole::Enrollment_1N);
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active)
+            continue;
+        IRPI::IdentInterface *_recognizer = _vendor.recognizer.get();
+        LatencyTrace &_trace = _enrollment ? _vendor.etrace : _vendor.itrace;
+        const size_t _maxtemplsize = _enrollment ? _vendor.emaxtemplsize : _vendor.imaxtemplsize;
+        if(_trace.isCold()) { // warm-up calls go on the first image of the stage, the same way as the timed ones
+            TemplateArena _scratch(std::max<size_t>(_maxtemplsize,4096));
+            warmUp([&]() { IRPI::TemplateView _t; createTemplateInArena(_recognizer,_img,_role,_maxtemplsize,_scratch,_t); },_setup.warmupcalls,_trace);
+        }
+        IRPI::TemplateView _templ;
+        const qint64 _tracebegin = _tracer.now();
+        _perfcounters.start();
+        _cputimer.start();
+        _elapsedtimer.start();
+        IRPI::ReturnStatus _status = createTemplateInArena(_recognizer,_img,_role,_maxtemplsize,
+                                                           _enrollment ? _vendor.etemplarena : _vendor.itemplarena,_templ);
+        const double _gentime = _elapsedtimer.nsecsElapsed();
+        _cputimer.stop(_enrollment ? _vendor.ecpu : _vendor.icpu);
+        _perfcounters.stop(_enrollment ? _vendor.eperf : _vendor.iperf);
+        _tracer.record("createTemplate","vendor",_tracebegin);
+        (_enrollment ? _vendor.etgentime : _vendor.itgentime) += _gentime;
+        _trace.add(_gentime);
+        if(_status.code != IRPI::ReturnCode::Success) {
+            (_enrollment ? _vendor.eterrors : _vendor.iterrors)++;
+            if(_setup.verbose) {
+                std::cout << "   " << (_vvendors.size() > 1 ? _vendor.name.toStdString() + ": " : std::string()) << _status.code << std::endl;
+                std::cout << "   " << _status.info << std::endl;
+            }
+        } else if(_enrollment) {
+            _vendor.vetempl.push_back(std::make_pair(_label,_templ));
+        } else {
+            _vendor.vtruelabel.push_back(_label);
+            _vendor.vitempl.push_back(_templ);
+        }
+    }
+}
+
+//--------------------------------------------------
+// Identification search of one vendor along with all comparisons that need identification templates
+void searchVendor(VendorRun &_vendor,
+                  const TestSetup &_setup,
+                  PerfCounters &_perfcounters,
+                  const std::vector<IRPI::Image> &_vsweepimages)
+{
+    Tracer &_tracer = Tracer::instance();
+    qint64 _tracebegin = 0;
+    QElapsedTimer _elapsedtimer;
+    CPUTimer _cputimer;
+    IRPI::ReturnStatus _status;
+    IRPI::IdentInterface *_recognizer = _vendor.recognizer.get();
+    std::vector<IRPI::TemplateView> &_vitempl = _vendor.vitempl;
+    const size_t _candidates = _setup.candidates, _batchsize = _setup.batchsize, _warmupcalls = _setup.warmupcalls;
+
+    // All memory the search loop needs is allocated here, so there is no heap churn around Vendor's API calls
+    IRPI::CandidateList _candidatelist(_candidates);
+    // Vector based search of the baseline vendors gets the template copied before the timer starts
+    std::vector<uint8_t> _templbuffer;
+    if(_vendor.baseline)
+        _templbuffer.reserve(std::max<size_t>(_vendor.imaxtemplsize,4096));
+    std::vector<IRPI::CandidateList> _vbatchlists(_batchsize,IRPI::CandidateList(_candidates));
+    std::unique_ptr<bool[]> _batchdecisions(new bool[std::max<size_t>(_batchsize,1)]);
+    _vendor.vcandidates.assign(_vitempl.size(),std::vector<IRPI::Candidate>(_candidates));
+    size_t _searches = 0;
+    _vendor.strace.vlatencyns.reserve(_warmupcalls + _vitempl.size());
+    bool _decision;
+    /* Page faults of the first searches show how cold Vendor's enrollment data is after initializeIdentificationSession.
+     * The first call (warm-up or timed one) closes the cold window, the steady one runs from there till the end */
+    qint64 _pagefaults = processPageFaults(), _coldpagefaults = 0, _steadypagefaults = 0;
+    bool _cold = true;
+    size_t _coldsearches = 0; // timed searches counted in the cold window
+    if(_warmupcalls > 0 && _vitempl.size() > 0) {
+        if(_batchsize > 0)
+            warmUp([&]() { _recognizer->identifyTemplates(_vitempl.data(),std::min(_batchsize,_vitempl.size()),_vbatchlists.data(),_batchdecisions.get()); },_warmupcalls,_vendor.strace);
+        else
+            warmUp([&]() { bool _d; _recognizer->identifyTemplate(_vitempl[0],_candidatelist,_d); },_warmupcalls,_vendor.strace);
+        _coldpagefaults = processPageFaults() - _pagefaults;
+        _pagefaults = processPageFaults();
+        _cold = false;
+    }
+#ifdef Q_OS_LINUX
+    if(_vendor.shardedrecognizer)
+        _vendor.shardedrecognizer->clearStats(); // warm-up searches do not count
+#endif
+    // In batch mode each call searches batchsize templates, its time is split evenly between them
+    for(size_t i = 0; _batchsize > 0 && i < _vitempl.size(); i += _batchsize) {
+        const size_t _count = std::min(_batchsize,_vitempl.size() - i);
+        std::cout << "  Identification for labels: " << _vendor.vtruelabel[i] << " - " << _vendor.vtruelabel[i + _count - 1] << std::endl;
+        _tracebegin = _tracer.now();
+        _perfcounters.start();
+        _cputimer.start();
+        _elapsedtimer.start();
+        _status = _recognizer->identifyTemplates(&_vitempl[i],_count,_vbatchlists.data(),_batchdecisions.get());
+        const double _batchtime = _elapsedtimer.nsecsElapsed();
+        _cputimer.stop(_vendor.scpu);
+        _perfcounters.stop(_vendor.sperf);
+        _tracer.record("identifyTemplates","vendor",_tracebegin);
+        _vendor.searchtimens += _batchtime;
+        for(size_t j = 0; j < _count; ++j)
+            _vendor.strace.add(_batchtime / _count);
+        if(_cold) {
+            _coldpagefaults = processPageFaults() - _pagefaults;
+            _pagefaults = processPageFaults();
+            _cold = false;
+            _coldsearches = _count;
+        }
+        if(_status.code != IRPI::ReturnCode::Success && _setup.verbose) {
+            std::cout << "   " << _status.code << std::endl;
+            std::cout << "   " << _status.info << std::endl;
+        }
+        // Failed searches of the batch come with empty lists, so results stay aligned with vtruelabel
+        for(size_t j = 0; j < _count; ++j)
+            copyCandidates(_vbatchlists[j],_vendor.vcandidates[_searches++]);
+    }
+    for(size_t i = 0; _batchsize == 0 && i < _vitempl.size(); ++i) {
+        std::cout << "  Identification for label: " << _vendor.vtruelabel[i] << std::endl;
+        _candidatelist.clear();
+        _decision = false;
+        std::vector<IRPI::Candidate> &_vprediction = _vendor.vcandidates[_searches];
+        if(_vendor.baseline) {
+            _templbuffer.assign(_vitempl[i].data(),_vitempl[i].data() + _vitempl[i].size());
+            _vprediction.clear(); // capacity stays, as vcandidates are allocated above
+        }
+        _tracebegin = _tracer.now();
+        _perfcounters.start();
+        _cputimer.start();
+        _elapsedtimer.start();
+        if(_vendor.baseline)
+            _status = _recognizer->identifyTemplate(_templbuffer,_candidates,_vprediction,_decision);
+        else
+            _status = _recognizer->identifyTemplate(_vitempl[i],_candidatelist,_decision);
+        const double _searchtime = _elapsedtimer.nsecsElapsed();
+        _cputimer.stop(_vendor.scpu);
+        _perfcounters.stop(_vendor.sperf);
+        _tracer.record("identifyTemplate","vendor",_tracebegin);
+        _vendor.searchtimens += _searchtime;
+        _vendor.strace.add(_searchtime);
+        if(_cold) {
+            _coldpagefaults = processPageFaults() - _pagefaults;
+            _pagefaults = processPageFaults();
+            _cold = false;
+            _coldsearches = 1;
+        }
+        if(_status.code != IRPI::ReturnCode::Success) {
+            if(_setup.verbose) {
+                std::cout << "   " << _status.code << std::endl;
+                std::cout << "   " << _status.info << std::endl;
+            }
+            // Failed search keeps its place with no candidates, so results stay aligned with vtruelabel
+            _vprediction.assign(_candidates,IRPI::Candidate());
+            _searches++;
+        } else if(_vendor.baseline) {
+            // All lists have the same length, as computeCMC takes the number of ranks from the first one
+            _vprediction.resize(_candidates);
+            _searches++;
+        } else {
+            copyCandidates(_candidatelist,_vprediction);
+            _searches++;
+        }
+    }
+    _vendor.vcandidates.resize(_searches);
+
+    _vendor.searchtimens /= std::max<size_t>(_vitempl.size(),1);
+    // Without any search both counts stay 0
+    if(!_cold)
+        _steadypagefaults = processPageFaults() - _pagefaults;
+    _vendor.coldpagefaults = _coldpagefaults;
+    _vendor.steadypagefaultspercall = static_cast<double>(_steadypagefaults) / std::max<size_t>(_vitempl.size() - _coldsearches,1);
+    std::cout << std::endl << "  Total identifications: " << _vitempl.size() << std::endl;
+    std::cout << "  Avg identification time: " << _vendor.searchtimens*1e-3 << " us" << std::endl;
+    std::cout << "  Search throughput: " << (_vendor.searchtimens > 0 ? 1.e9 / _vendor.searchtimens : 0.0) << " probes/s"
+              << " (batch: " << std::max<size_t>(_batchsize,1) << ")" << std::endl;
+    std::cout << "  First identification time: " << _vendor.strace.firstCall()*1e-3 << " us" << std::endl;
+    std::cout << "  Cold page faults: " << _vendor.coldpagefaults << std::endl;
+    std::cout << std::endl << "CPU time accounting" << std::endl;
+    showCPUStage("Enrollment templates", _vendor.ecpu);
+    showCPUStage("Finalization", _vendor.fcpu);
+    showCPUStage("Identification templates", _vendor.icpu);
+    showCPUStage("Search", _vendor.scpu);
+#ifdef Q_OS_LINUX
+    if(_vendor.isolatedrecognizer) {
+        std::cout << std::endl << "Vendor's API isolation" << std::endl;
+        showIsolation(*_vendor.isolatedrecognizer);
+    }
+    // Later sweeps also search through the shards, so search stage figures are taken now
+    if(_vendor.shardedrecognizer) {
+        std::cout << std::endl << "Sharded search" << std::endl;
+        showSharding(*_vendor.shardedrecognizer);
+        _vendor.shardingjson = serializeSharding(*_vendor.shardedrecognizer);
+    }
+#endif
+    if(_setup.hwcounters) {
+        std::cout << std::endl << "Hardware performance counters" << std::endl;
+        showPerfStage("Enrollment templates", _vendor.eperf);
+        showPerfStage("Finalization", _vendor.fperf);
+        showPerfStage("Identification templates", _vendor.iperf);
+        showPerfStage("Search", _vendor.sperf);
+    }
+
+    if(_setup.coresweep) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Core-count scaling sweep" << std::endl;
+        const std::vector<int> _initialcpus = allowedCPUs();
+        // Cores are taken node by node, so the sweep fills one socket before it crosses the interconnect
+        const std::vector<int> _sweepcpus = orderCPUsByNode(_initialcpus);
+        const size_t _maxcores = (_setup.sweepcores == 0 || _setup.sweepcores > _sweepcpus.size()) ? _sweepcpus.size() : _setup.sweepcores;
+        const std::vector<size_t> _counts = sweepCoreCounts(_maxcores);
+        for(size_t k = 0; k < _counts.size(); ++k) {
+            if(!setProcessAffinity(std::vector<int>(_sweepcpus.begin(),_sweepcpus.begin() + _counts[k]))) {
+                std::cout << "  Can not pin process to " << _counts[k] << " cores, sweep stopped" << std::endl;
+                break;
+            }
+            ScalingPoint _searchpoint;
+            _searchpoint.cores = _counts[k];
+            measureSearchPass(_recognizer,_vitempl,_candidates,_searchpoint.stage);
+            _vendor.vsearchscaling.push_back(_searchpoint);
+            std::cout << "  Cores: " << _counts[k]
+                      << "  search: " << 1.e-3 * _searchpoint.stage.wallns / std::max<size_t>(_searchpoint.stage.calls,1) << " us";
+            if(_setup.sweepgeneration) {
+                ScalingPoint _genpoint;
+                _genpoint.cores = _counts[k];
+                measureGenerationPass(_recognizer,_vsweepimages,_genpoint.stage);
+                _vendor.vgenscaling.push_back(_genpoint);
+                std::cout << "  generation: " << 1.e-6 * _genpoint.stage.wallns / std::max<size_t>(_genpoint.stage.calls,1) << " ms";
+            }
+            std::cout << std::endl;
+        }
+        if(_setup.numaplacement) {
+            const std::vector<int> _nodes = numaNodes();
+            if(_nodes.size() < 2) {
+                std::cout << "  Only one NUMA node found, remote placement can not be measured" << std::endl;
+            } else if(_vendor.enrollmentmemory.size() == 0) {
+                std::cout << "  Vendor's enrollment data is not found in IRPITest memory, remote placement can not be measured" << std::endl;
+            } else {
+                /* Threads stay on the first node, while memory Vendor's API has mapped for its enrollment data goes
+                 * to the first (local) or second (remote) node. Data put in memory that was mapped before is not moved */
+                std::vector<int> _nodecpus = numaNodeCPUs(_nodes[0]), _localcpus;
+                for(size_t i = 0; i < _nodecpus.size(); ++i)
+                    if(std::find(_initialcpus.begin(),_initialcpus.end(),_nodecpus[i]) != _initialcpus.end())
+                        _localcpus.push_back(_nodecpus[i]);
+                const std::vector<size_t> _nodecounts = sweepCoreCounts(std::min(_maxcores,_localcpus.size()));
+                for(size_t k = 0; k < _nodecounts.size(); ++k) {
+                    if(!setProcessAffinity(std::vector<int>(_localcpus.begin(),_localcpus.begin() + _nodecounts[k]))) {
+                        std::cout << "  Can not pin process to " << _nodecounts[k] << " cores of the first node, placement comparison stopped" << std::endl;
+                        break;
+                    }
+                    NUMAPoint _point;
+                    _point.cores = _nodecounts[k];
+                    if(!moveMemoryToNode(_vendor.enrollmentmemory,_nodes[0])) {
+                        std::cout << "  Can not move memory between NUMA nodes, remote placement can not be measured" << std::endl;
+                        break;
+                    }
+                    measureSearchPass(_recognizer,_vitempl,_candidates,_point.local);
+                    if(!moveMemoryToNode(_vendor.enrollmentmemory,_nodes[1])) {
+                        std::cout << "  Can not move memory to the second NUMA node, remote placement can not be measured" << std::endl;
+                        break;
+                    }
+                    measureSearchPass(_recognizer,_vitempl,_candidates,_point.remote);
+                    _vendor.vnumascaling.push_back(_point);
+                    std::cout << "  Cores: " << _nodecounts[k]
+                              << "  local: " << 1.e-3 * _point.local.wallns / std::max<size_t>(_point.local.calls,1) << " us"
+                              << "  remote: " << 1.e-3 * _point.remote.wallns / std::max<size_t>(_point.remote.calls,1) << " us" << std::endl;
+                }
+                moveMemoryToNode(_vendor.enrollmentmemory,_nodes[0]);
+            }
+        }
+        setProcessAffinity(_initialcpus);
+        _tracer.record("scaling sweep","harness",_tracebegin);
+    }
+    // Both searches go once more now, when enrollment data is warm, so speed-up is not biased by the first calls
+    if(_setup.shortlist > 0) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Two-stage search comparison" << std::endl;
+        _status = _recognizer->setParameter("shortlist",std::to_string(_setup.shortlist));
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cout << "  Vendor's API does not support shortlist: " << _status.info << std::endl;
+        } else {
+            _vendor.shortlistcmp.shortlist = _setup.shortlist;
+            _vendor.shortlistcmp.shortlistns = searchPass(_recognizer,_vitempl,_candidates,_batchsize,&_vendor.vshortlistcandidates);
+            std::string _restore = "0";
+            for(size_t i = 0; i < _setup.parameters.size(); ++i)
+                if(_setup.parameters[i].first == "shortlist")
+                    _restore = _setup.parameters[i].second;
+            _recognizer->setParameter("shortlist",_restore);
+            _vendor.shortlistcmp.exactns = searchPass(_recognizer,_vitempl,_candidates,_batchsize,nullptr);
+            std::cout << "  Avg identification time: " << 1.e-3 * _vendor.shortlistcmp.shortlistns << " us vs "
+                      << 1.e-3 * _vendor.shortlistcmp.exactns << " us" << std::endl;
+        }
+        _tracer.record("shortlist comparison","harness",_tracebegin);
+    }
+    // Gallery file is evicted from the page cache before the first search of each mode, then the searches go warm
+    if(!_vendor.galleryfile.empty() && _vitempl.size() > 0) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Out-of-core search of the gallery file" << std::endl;
+        const std::vector<IRPI::TemplateView> _vwarmtempl(_vitempl.begin(),_vitempl.begin() + std::min<size_t>(_vitempl.size(),16));
+        const char *_modes[] = {"mmap", "direct"};
+        for(const char *_mode : _modes) {
+            _status = _recognizer->setParameter("gallery_io",_mode);
+            if(_status.code != IRPI::ReturnCode::Success) {
+                std::cout << "  " << _mode << ": not supported (" << _status.info << ")" << std::endl;
+                continue;
+            }
+            OutOfCorePoint _point;
+            _point.mode = _mode;
+            _vendor.galleryfilebytes = evictGalleryFiles(_vendor.galleryfile,_vendor.shards);
+            _point.coldns = searchPass(_recognizer,std::vector<IRPI::TemplateView>(1,_vitempl[0]),_candidates,0,nullptr);
+            _point.warmns = searchPass(_recognizer,_vwarmtempl,_candidates,0,nullptr);
+            showOutOfCore(_point,_vendor.galleryfilebytes);
+            _vendor.voutofcore.push_back(_point);
+        }
+        _recognizer->setParameter("gallery_io","mmap");
+        _tracer.record("out-of-core comparison","harness",_tracebegin);
+    }
+    // Candidates of the search stage go to CMC and DET, so updates do not change accuracy figures
+    if(_setup.updateperiod > 0 && _vitempl.size() > 0) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Search between gallery updates (same thread)" << std::endl;
+        _vendor.mixedworkload.searchesperupdate = _setup.updateperiod;
+        runMixedWorkload(_recognizer,_vitempl,_candidates,_vendor.vupdategroups,_vendor.mixedworkload);
+        showMixedWorkload(_vendor.mixedworkload);
+        _tracer.record("mixed workload","harness",_tracebegin);
+    }
+    _vendor.vupdategroups.clear();
+    _vendor.vupdatecopies.clear();
+    // Repeated probes are drawn from the identification templates, the cache sits in front of Vendor's API in this stage only
+    if(_setup.cachesize > 0 && _vitempl.size() > 0) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Result cache replay" << std::endl;
+        _vendor.cachedrecognizer = std::make_shared<CachedIdentInterface>(_vendor.recognizer,_setup.cachesize);
+        std::vector<IRPI::TemplateView> _vstream(4 * _vitempl.size());
+        for(size_t i = 0; i < _vstream.size(); ++i)
+            _vstream[i] = _vitempl[std::rand() % _vitempl.size()];
+        _vendor.cacherequests = _vstream.size();
+        searchPass(_vendor.cachedrecognizer.get(),_vstream,_candidates,_batchsize,nullptr);
+        showResultCache(*_vendor.cachedrecognizer,_vendor.cacherequests);
+        _tracer.record("result cache replay","harness",_tracebegin);
+    }
+    // Each budget is a full pass over the identification templates, accuracy is computed with CMC and DET
+    if(_setup.deadlinesweep && _vitempl.size() > 0) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Deadline bounded search" << std::endl;
+        std::vector<double> _budgets = _setup.deadlinebudgets;
+        if(_budgets.size() == 0) {
+            const double _fractions[] = {0.125, 0.25, 0.5, 1.0, 2.0};
+            for(double _fraction : _fractions)
+                _budgets.push_back(_fraction * _vendor.searchtimens);
+        }
+        for(size_t i = 0; i < _budgets.size(); ++i) {
+            DeadlinePoint _point;
+            _point.budgetns = _budgets[i];
+            deadlinePass(_recognizer,_vitempl,_candidates,_point);
+            std::cout << "  Budget " << 1.e-3 * _point.budgetns << " us: mean " << 1.e-3 * _point.meanns << " us" << std::endl;
+            _vendor.vdeadlines.push_back(std::move(_point));
+        }
+        _tracer.record("deadline sweep","harness",_tracebegin);
+    }
+    // As we need not ident templates any longer, let's release memory occupied by them
+    _vitempl.clear(); _vitempl.shrink_to_fit();
+    _vendor.itemplarena.release();
+}
+
+//--------------------------------------------------
+// CMC, DET and everything else computed from the candidates of one vendor
+void computeVendorMetrics(VendorRun &_vendor,
+                          const TestSetup &_setup,
+                          size_t _enrolllabelmax)
+{
+    Tracer &_tracer = Tracer::instance();
+    qint64 _tracebegin = _tracer.now();
+    const size_t _distractors = static_cast<size_t>(_setup.distractorfiles.size());
+    const std::vector<size_t> &_vtruelabel = _vendor.vtruelabel;
+    _vendor.vCMC = computeCMC(_vendor.vcandidates,_vtruelabel,_enrolllabelmax);
+    _tracer.record("computeCMC","metrics",_tracebegin);
+    if(_vendor.vCMC.size() > 0)
+        std::cout << "  Best TPIR[1]: "
+                  << QString::number(_vendor.vCMC[0].mTPIR,'f',validdigits(_setup.validsubdirs * _setup.itpp * _setup.etpp, _setup.confexamples)).toStdString()
+                  << std::endl;
+    if(_distractors > 0) {
+        _tracebegin = _tracer.now();
+        _vendor.vDET = computeDET(_vendor.vcandidates,_vtruelabel,_enrolllabelmax,_setup.detpoints,_setup.confexamples);
+        _tracer.record("computeDET","metrics",_tracebegin);
+        _vendor.bestFPIR = std::exp(std::log(10.0) * -validdigits(_distractors * _setup.etpp, _setup.confexamples));
+        _vendor.bestFNIR = findFNIR(_vendor.vDET,_vendor.bestFPIR);
+        std::cout << "  Best FNIR (FPIR): "
+                  << QString::number(_vendor.bestFNIR,'f',validdigits(_setup.validsubdirs * _setup.itpp * _setup.etpp, _setup.confexamples)).toStdString()
+                  << " ("
+                  << QString::number(_vendor.bestFPIR,'f',validdigits(_distractors * _setup.etpp, _setup.confexamples)).toStdString()
+                  << ")" << std::endl;
+    }
+    if(_setup.bootstrapreplicates > 0) {
+        _tracebegin = _tracer.now();
+        _vendor.bootstrap = runBootstrap(makeBootstrapSample(_vendor.vcandidates,_vtruelabel,_enrolllabelmax),_setup.bootstrapreplicates,_vendor.bestFPIR);
+        _tracer.record("bootstrap","metrics",_tracebegin);
+        std::cout << std::endl << "Bootstrap over probes (" << _setup.bootstrapreplicates << " replicates)" << std::endl;
+        showBootstrap(_vendor.bootstrap,_distractors > 0);
+    }
+    ShortlistComparison &_shortlistcmp = _vendor.shortlistcmp;
+    if(_shortlistcmp.shortlist > 0) {
+        _tracebegin = _tracer.now();
+        std::vector<CMCPoint> _vCMC = computeCMC(_vendor.vshortlistcandidates,_vtruelabel,_enrolllabelmax);
+        _shortlistcmp.exactTPIR = _vendor.vCMC.size() > 0 ? _vendor.vCMC[0].mTPIR : 0.0;
+        _shortlistcmp.shortlistTPIR = _vCMC.size() > 0 ? _vCMC[0].mTPIR : 0.0;
+        if(_distractors > 0) {
+            _shortlistcmp.exactFNIR = _vendor.bestFNIR;
+            _shortlistcmp.shortlistFNIR = findFNIR(computeDET(_vendor.vshortlistcandidates,_vtruelabel,_enrolllabelmax,_setup.detpoints,_setup.confexamples),_vendor.bestFPIR);
+        }
+        _vendor.vshortlistcandidates.clear();
+        _tracer.record("shortlist metrics","metrics",_tracebegin);
+        std::cout << std::endl << "Two-stage search" << std::endl;
+        showShortlist(_shortlistcmp,_distractors > 0);
+    }
+    if(_vendor.vdeadlines.size() > 0) {
+        _tracebegin = _tracer.now();
+        std::cout << std::endl << "Deadline bounded search" << std::endl;
+        for(size_t i = 0; i < _vendor.vdeadlines.size(); ++i) {
+            DeadlinePoint &_point = _vendor.vdeadlines[i];
+            std::vector<CMCPoint> _vCMC = computeCMC(_point.vcandidates,_vtruelabel,_enrolllabelmax);
+            _point.TPIR = _vCMC.size() > 0 ? _vCMC[0].mTPIR : 0.0;
+            if(_distractors > 0)
+                _point.FNIR = findFNIR(computeDET(_point.vcandidates,_vtruelabel,_enrolllabelmax,_setup.detpoints,_setup.confexamples),_vendor.bestFPIR);
+            _point.vcandidates.clear();
+            showDeadline(_point,_vtruelabel.size(),_distractors > 0);
+        }
+        _tracer.record("deadline metrics","metrics",_tracebegin);
+    }
+}
+
+//--------------------------------------------------
+// Output file content of the vendor that has passed the test
+QJsonObject serializeVendorRun(const VendorRun &_vendor, const TestSetup &_setup, const QDateTime &_enddt)
+{
+    const size_t _distractors = static_cast<size_t>(_setup.distractorfiles.size());
+    QJsonObject _jsonobj;
+    _jsonobj["Name"]       = _vendor.name;
+    _jsonobj["StartDT"]    = _setup.startdt.toString("dd.MM.yyyy hh:mm:ss");
+    _jsonobj["EndDT"]      = _enddt.toString("dd.MM.yyyy hh:mm:ss");
+    _jsonobj["CMC"]        = serializeCMC(_vendor.vCMC);
+    if(_distractors > 0)
+        _jsonobj["DET"]    = serializeDET(_vendor.vDET);
+
+    QJsonObject _ejson;
+    _ejson["Templates"]   = static_cast<int>(_setup.validsubdirs*_setup.etpp);
+    _ejson["Perperson"]   = static_cast<int>(_setup.etpp);
+    _ejson["Errors"]      = static_cast<int>(_vendor.eterrors);
+    _ejson["Gentime_ms"]  = 1.e-6 * _vendor.etgentime;
+    _ejson["Size_bytes"]  = static_cast<int>(_vendor.enrolltemplsizebytes);
+    _ejson["Rejection_rate"] = std::max(_vendor.eterrors / static_cast<double>(_setup.validsubdirs*_setup.etpp),
+                                        _setup.confexamples / static_cast<double>(_setup.validsubdirs*_setup.etpp));
+    _jsonobj["Enrollment"] = _ejson;
+    QJsonObject _ijson;
+    _ijson["Templates"]   = static_cast<int>(_setup.validsubdirs*_setup.itpp);
+    _ijson["Perperson"]   = static_cast<int>(_setup.itpp);
+    _ijson["Distractors"] = static_cast<int>(_distractors);
+    _ijson["Errors"]      = static_cast<int>(_vendor.iterrors);
+    _ijson["Gentime_ms"]  = 1.e-6 * _vendor.itgentime;
+    _ijson["Size_bytes"]  = static_cast<int>(_vendor.identtemplsizebytes);
+    _ijson["Rejection_rate"] = std::max(_vendor.iterrors / static_cast<double>(_setup.validsubdirs*_setup.itpp),
+                                        _setup.confexamples / static_cast<double>(_setup.validsubdirs*_setup.itpp));
+    _jsonobj["Identification"] = _ijson;
+
+    _jsonobj["Searchtime_us"] = _vendor.searchtimens * 1.e-3;
+    _jsonobj["Searchbatch"]   = static_cast<int>(std::max<size_t>(_setup.batchsize,1));
+    _jsonobj["Searchthroughput_probes_per_s"] = _vendor.searchtimens > 0 ? 1.e9 / _vendor.searchtimens : 0.0;
+    _jsonobj["Einittime_ms"]  = _vendor.einittimems;
+    _jsonobj["Efinalizetime_ms"] = _vendor.finalizetimems;
+    _jsonobj["Iinittime_ms"]  = _vendor.iinittimems;
+    _jsonobj["FNIR"] = _vendor.bestFNIR;
+    _jsonobj["FPIR"] = _vendor.bestFPIR;
+    QJsonObject _warmupjson;
+    _warmupjson["Enrollment"]     = serializeWarmup(_vendor.etrace);
+    _warmupjson["Identification"] = serializeWarmup(_vendor.itrace);
+    QJsonObject _swarmupjson      = serializeWarmup(_vendor.strace,true);
+    _swarmupjson["Iinit_page_faults"] = _vendor.iinitpagefaults;
+    _swarmupjson["Cold_page_faults"]  = _vendor.coldpagefaults;
+    _swarmupjson["Steady_page_faults_per_call"] = _vendor.steadypagefaultspercall;
+    _warmupjson["Search"] = _swarmupjson;
+    _jsonobj["Warmup"] = _warmupjson;
+    QJsonObject _cpujson;
+    _cpujson["Einit"]          = serializeCPUStage(_vendor.einitcpu);
+    _cpujson["Enrollment"]     = serializeCPUStage(_vendor.ecpu);
+    _cpujson["Finalization"]   = serializeCPUStage(_vendor.fcpu);
+    _cpujson["Iinit"]          = serializeCPUStage(_vendor.iinitcpu);
+    _cpujson["Identification"] = serializeCPUStage(_vendor.icpu);
+    _cpujson["Search"]         = serializeCPUStage(_vendor.scpu);
+    _jsonobj["Cputime"] = _cpujson;
+    if(_setup.cpus.size() > 0)
+        _jsonobj["Cpus"] = static_cast<int>(_setup.cpus.size());
+    if(_setup.coresweep) {
+        QJsonObject _scalingjson;
+        _scalingjson["Search"] = serializeScaling(_vendor.vsearchscaling);
+        if(_setup.sweepgeneration)
+            _scalingjson["Generation"] = serializeScaling(_vendor.vgenscaling);
+        if(_vendor.vnumascaling.size() > 0)
+            _scalingjson["NUMA"] = serializeNUMAScaling(_vendor.vnumascaling);
+        _jsonobj["Scaling"] = _scalingjson;
+    }
+#ifdef Q_OS_LINUX
+    if(_vendor.isolatedrecognizer)
+        _jsonobj["Isolation"] = serializeIsolation(*_vendor.isolatedrecognizer);
+    if(_vendor.shardedrecognizer)
+        _jsonobj["Sharding"] = _vendor.shardingjson;
+#endif
+    if(_vendor.shortlistcmp.shortlist > 0)
+        _jsonobj["Shortlist"] = serializeShortlist(_vendor.shortlistcmp,_distractors > 0);
+    if(_vendor.mixedworkload.searchesperupdate > 0)
+        _jsonobj["Updates"] = serializeMixedWorkload(_vendor.mixedworkload);
+    if(_vendor.bootstrap.replicates > 0)
+        _jsonobj["Bootstrap"] = serializeBootstrap(_vendor.bootstrap,_distractors > 0);
+    if(_vendor.vdeadlines.size() > 0)
+        _jsonobj["Deadline"] = serializeDeadlines(_vendor.vdeadlines,_vendor.vtruelabel.size(),_distractors > 0);
+    if(_vendor.cachedrecognizer)
+        _jsonobj["Cache"] = serializeResultCache(*_vendor.cachedrecognizer,_vendor.cacherequests);
+    if(_vendor.voutofcore.size() > 0)
+        _jsonobj["Outofcore"] = serializeOutOfCore(_vendor.voutofcore,_vendor.galleryfilebytes);
+    if(_setup.hwcounters) {
+        QJsonObject _perfjson;
+        _perfjson["Enrollment"]     = serializePerfStage(_vendor.eperf);
+        _perfjson["Finalization"]   = serializePerfStage(_vendor.fperf);
+        _perfjson["Identification"] = serializePerfStage(_vendor.iperf);
+        _perfjson["Search"]         = serializePerfStage(_vendor.sperf);
+        _jsonobj["Perfcounters"] = _perfjson;
+    }
+    return _jsonobj;
+}
+
+// Output file content of the vendor excluded from the test
+QJsonObject serializeVendorFailure(const VendorRun &_vendor, const TestSetup &_setup, const QDateTime &_enddt)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Name"]    = _vendor.name;
+    _jsonobj["StartDT"] = _setup.startdt.toString("dd.MM.yyyy hh:mm:ss");
+    _jsonobj["EndDT"]   = _enddt.toString("dd.MM.yyyy hh:mm:ss");
+    QJsonObject _errorjson;
+    _errorjson["Stage"] = QString::fromStdString(_vendor.failurestage);
+    _errorjson["Code"]  = _vendor.failurecode;
+    _errorjson["Info"]  = QString::fromStdString(_vendor.failure);
+    _jsonobj["Error"] = _errorjson;
+    return _jsonobj;
+}
+
+//--------------------------------------------------
+/* Stages 2 to 5 of the test for all vendors at once: each image is decoded only once
+ * and goes to every active vendor, results are saved in <outdir>/<vendor>.json side by side.
+ * Vendor that fails is excluded from the test and gets its error record in the output file.
+ * Returns 0 if at least one vendor has passed the test, otherwise error code of the first vendor */
+int runTest(std::vector<std::unique_ptr<VendorRun>> &_vvendors, const TestSetup &_setup, PerfCounters &_perfcounters)
+{
+    // We need also check if output files already exist
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        _vendor.outputfile.setFileName(_setup.outdir.absolutePath().append("/%1.json").arg(_vendor.name));
+        if(_vendor.outputfile.exists() && (_setup.rewriteoutput == false)) {
+            std::cerr << "Output file already exists in the target location! Abort...";
+            return 9;
+        } else if(_vendor.outputfile.open(QFile::WriteOnly) == false) {
+            std::cerr << "Can not open output file for write! Abort...";
+            return 10;
+        }
+    }
+    const size_t _distractors = static_cast<size_t>(_setup.distractorfiles.size());
+    const bool _multivendor = _vvendors.size() > 1;
+    Tracer &_tracer = Tracer::instance();
+    qint64 _tracebegin = 0;
+    ImagePool _imagepool; // pixel buffers are reused from image to image
+    IRPI::Image _irpiimg;
+    QElapsedTimer _elapsedtimer;
+    CPUTimer _cputimer;
+    IRPI::ReturnStatus _status;
+    double _decodetimens = 0;
+    size_t _decodes = 0;
+
+    //----------------------------------------------------------------
+    std::cout << std::endl << "Stage 2 - enrollment templates generation" << std::endl;
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active)
+            continue;
+        std::vector<std::pair<std::string,std::string>> _parameters = _setup.parameters;
+        if(!_vendor.galleryfile.empty())
+            _parameters.push_back(std::make_pair(std::string("gallery_file"),_vendor.galleryfile));
+        for(size_t i = 0; i < _parameters.size() && _vendor.active; ++i) {
+            _status = _vendor.recognizer->setParameter(_parameters[i].first,_parameters[i].second);
+            std::cout << "  Parameter " << _parameters[i].first << "=" << _parameters[i].second << ": " << _status.code << std::endl;
+            if(_status.code != IRPI::ReturnCode::Success) {
+                std::cout << "Vendor's error description: " << _status.info << std::endl
+                          << "Can not set Vendor's API parameter! " << _vendor.name.toStdString() << " is excluded from the test" << std::endl;
+                _vendor.exclude(18,"setParameter " + _parameters[i].first,_status);
+            }
+        }
+        if(!_vendor.active)
+            continue;
+        std::cout << "  Initializing " << (_multivendor ? _vendor.name.toStdString() : std::string("Vendor's API")) << ": ";
+        _tracebegin = _tracer.now();
+        _cputimer.start();
+        _elapsedtimer.start();
+        _status = _vendor.recognizer->initializeEnrollmentSession(_setup.apiresourcespath);
+        _vendor.einittimems = _elapsedtimer.elapsed();
+        _cputimer.stop(_vendor.einitcpu);
+        _tracer.record("initializeEnrollmentSession","vendor",_tracebegin);
+        std::cout << _status.code << std::endl;
+        std::cout << " Time: " << _vendor.einittimems << " ms" << std::endl;
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cout << "Vendor's error description: " << _status.info << std::endl
+                      << "Can not initialize Vendor's API! " << _vendor.name.toStdString() << " is excluded from the test" << std::endl;
+            _vendor.exclude(11,"initializeEnrollmentSession",_status);
+            continue;
+        }
+        _vendor.emaxtemplsize = _vendor.recognizer->maxTemplateSize(IRPI::TemplateRole::Enrollment_1N);
+        _vendor.vetempl.reserve(_setup.validsubdirs * _setup.etpp);
+    }
+
+    std::cout << std::endl << "Starting templates generation..." << std::endl;
+    size_t _label = 1; // need to start from 1 because 0 reserved for default value in IRPI::Candidate
+    for(int i = 0; i < _setup.subdirs.size(); ++i) {
+        QDir _subdir(_setup.indir.absolutePath().append("/%1").arg(_setup.subdirs.at(i)));
+        QStringList _files = _subdir.entryList(_setup.filefilters,QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
+        if(static_cast<size_t>(_files.size()) >= _setup.minfilespp) {
+            std::cout << std::endl << "  Label: " << _label << " - " << _setup.subdirs.at(i) << std::endl;
+            for(size_t j = 0; j < _setup.etpp; ++j) {
+                if(_setup.verbose)
+                    std::cout << "   - enrollment template: " << _files.at(static_cast<int>(j)) << std::endl;
+                _tracebegin = _tracer.now();
+                _elapsedtimer.start();
+                _irpiimg = readimage(_subdir.absoluteFilePath(_files.at(static_cast<int>(j))),_setup.qimgtargetformat,_setup.verbose,&_imagepool);
+                _decodetimens += _elapsedtimer.nsecsElapsed();
+                _decodes++;
+                _tracer.record("readimage","io",_tracebegin);
+                createTemplates(_vvendors,_irpiimg,IRPI::TemplateRole::Enrollment_1N,_label,_setup,_perfcounters);
+            }
+        }
+        _label++;
+    }
+    const size_t _enrolllabelmax = _label - 1; // we will use this when CMC and DET will be computed
+
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active)
+            continue;
+        _vendor.etgentime /= std::max<size_t>(_vendor.vetempl.size(),1);
+        _vendor.enrolltemplsizebytes = _vendor.vetempl.size() > 0 ? _vendor.vetempl[0].second.size() : 0;
+        std::cout << "\nEnrollment templates" << (_multivendor ? " of " + _vendor.name.toStdString() : std::string()) << std::endl
+                  << "  Total:   " << _setup.validsubdirs*_setup.etpp << std::endl
+                  << "  Errors:  " << _vendor.eterrors << std::endl
+                  << "  Avgtime: " << 1e-6 * _vendor.etgentime << " ms" << std::endl
+                  << "  Size:    " << _vendor.enrolltemplsizebytes << " bytes (before finalizaition)" << std::endl
+                  << "  Arena:   " << _vendor.etemplarena.bytes() << " bytes in " << _vendor.etemplarena.allocations() << " block(s)" << std::endl;
+
+        std::cout << std::endl << "Finalizing..." << std::endl;
+        const MemoryRanges _memorybefore = _setup.numaplacement ? anonymousMemory() : MemoryRanges();
+        _tracebegin = _tracer.now();
+        _perfcounters.start();
+        _cputimer.start();
+        _elapsedtimer.start();
+        _status = _vendor.recognizer->finalizeEnrollment(_vendor.vetempl);
+        _vendor.finalizetimems = _elapsedtimer.elapsed();
+        _cputimer.stop(_vendor.fcpu);
+        _perfcounters.stop(_vendor.fperf);
+        _tracer.record("finalizeEnrollment","vendor",_tracebegin);
+        if(_setup.numaplacement)
+            _vendor.enrollmentmemory = newMemory(_memorybefore,anonymousMemory());
+        std::cout << " Time: " << _vendor.finalizetimems << " ms" << std::endl;
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cout << "Vendor's error description: " << _status.info << std::endl
+                      << "Can not finalize enrollment! " << _vendor.name.toStdString() << " is excluded from the test" << std::endl;
+            _vendor.exclude(12,"finalizeEnrollment",_status);
+        } else if(_setup.updateperiod > 0) {
+            _vendor.vupdategroups = groupUpdateTemplates(_vendor.vetempl,64,_vendor.vupdatecopies);
+        }
+        // As we need not enroll templates any longer, let's release memory occupied by them
+        _vendor.vetempl.clear(); _vendor.vetempl.shrink_to_fit();
+        _vendor.etemplarena.release();
+    }
+
+    //----------------------------------------------------------------
+    std::cout << std::endl << "Stage 3 - identification templates generation" << std::endl;
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active)
+            continue;
+        std::cout << "  Initializing " << (_multivendor ? _vendor.name.toStdString() : std::string("Vendor's API")) << ": ";
+        _vendor.iinitpagefaults = processPageFaults();
+        const MemoryRanges _memorybefore = _setup.numaplacement ? anonymousMemory() : MemoryRanges();
+        _tracebegin = _tracer.now();
+        _cputimer.start();
+        _elapsedtimer.start();
+        _status = _vendor.recognizer->initializeIdentificationSession(_setup.apiresourcespath);
+        _vendor.iinittimems = _elapsedtimer.elapsed();
+        _cputimer.stop(_vendor.iinitcpu);
+        _tracer.record("initializeIdentificationSession","vendor",_tracebegin);
+        _vendor.iinitpagefaults = processPageFaults() - _vendor.iinitpagefaults;
+        if(_setup.numaplacement) {
+            const MemoryRanges _loaded = newMemory(_memorybefore,anonymousMemory());
+            _vendor.enrollmentmemory.insert(_vendor.enrollmentmemory.end(),_loaded.begin(),_loaded.end());
+        }
+        std::cout << _status.code << std::endl;
+        std::cout << " Time: " << _vendor.iinittimems << " ms" << std::endl;
+        if(_status.code != IRPI::ReturnCode::Success) {
+            std::cout << "Vendor's error description: " << _status.info << std::endl
+                      << "Can not initialize Vendor's API! " << _vendor.name.toStdString() << " is excluded from the test" << std::endl;
+            _vendor.exclude(13,"initializeIdentificationSession",_status);
+            continue;
+        }
+        _vendor.imaxtemplsize = _vendor.recognizer->maxTemplateSize(IRPI::TemplateRole::Search_1N);
+        _vendor.vitempl.reserve(_setup.validsubdirs * _setup.itpp + _distractors);
+        _vendor.vtruelabel.reserve(_setup.validsubdirs * _setup.itpp + _distractors);
+    }
+
+    std::cout << std::endl << "Starting templates generation..." << std::endl;
+    std::vector<IRPI::Image> _vsweepimages; // subset of identification images for scaling sweep
+    const size_t _sweepimagesmax = 128;
+    _label = 1; // need to start from 1 because 0 reserved for default value in IRPI::Candidate
+    for(int i = 0; i < _setup.subdirs.size(); ++i) {
+        QDir _subdir(_setup.indir.absolutePath().append("/%1").arg(_setup.subdirs.at(i)));
+        QStringList _files = _subdir.entryList(_setup.filefilters,QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
+        if(static_cast<size_t>(_files.size()) >= _setup.minfilespp) {
+            if(_setup.itpp > 0)
+                std::cout << std::endl << "  Label: " << _label << " - " << _setup.subdirs.at(i) << std::endl;
+            for(size_t j = _setup.etpp; j < _setup.minfilespp; ++j) {
+                if(_setup.verbose)
+                    std::cout << "   - identification template: " << _files.at(static_cast<int>(j)) << std::endl;
+                _tracebegin = _tracer.now();
+                _elapsedtimer.start();
+                _irpiimg = readimage(_subdir.absoluteFilePath(_files.at(static_cast<int>(j))),_setup.qimgtargetformat,_setup.verbose,&_imagepool);
+                _decodetimens += _elapsedtimer.nsecsElapsed();
+                _decodes++;
+                _tracer.record("readimage","io",_tracebegin);
+                if(_setup.sweepgeneration && _vsweepimages.size() < _sweepimagesmax)
+                    _vsweepimages.push_back(_irpiimg);
+                createTemplates(_vvendors,_irpiimg,IRPI::TemplateRole::Search_1N,_label,_setup,_perfcounters);
+            }
+        }
+        _label++;
+    }
+    // Also we need process all distractors
+    for(int i = 0; i < _setup.distractorfiles.size(); ++i) {
+        std::cout << std::endl << "  Label: " << _label << " - " << _setup.distractorfiles.at(i) << std::endl;
+        _tracebegin = _tracer.now();
+        _elapsedtimer.start();
+        _irpiimg = readimage(_setup.indir.absoluteFilePath(_setup.distractorfiles.at(i)),_setup.qimgtargetformat,_setup.verbose,&_imagepool);
+        _decodetimens += _elapsedtimer.nsecsElapsed();
+        _decodes++;
+        _tracer.record("readimage","io",_tracebegin);
+        if(_setup.sweepgeneration && _vsweepimages.size() < _sweepimagesmax)
+            _vsweepimages.push_back(_irpiimg);
+        createTemplates(_vvendors,_irpiimg,IRPI::TemplateRole::Search_1N,_label,_setup,_perfcounters);
+        _label++;
+    }
+    _irpiimg = IRPI::Image();
+
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active)
+            continue;
+        _vendor.itgentime /= std::max<size_t>(_vendor.vitempl.size(),1);
+        _vendor.identtemplsizebytes = _vendor.vitempl.size() > 0 ? _vendor.vitempl[0].size() : 0;
+        std::cout << "\nIdentification templates" << (_multivendor ? " of " + _vendor.name.toStdString() : std::string()) << std::endl
+                  << "  Total:   " << _setup.validsubdirs*_setup.itpp + _distractors
+                  << "  (distractors: " << _distractors << ")" << std::endl
+                  << "  Errors:  " << _vendor.iterrors << std::endl
+                  << "  Avgtime: " << 1.e-6 * _vendor.itgentime << " ms" << std::endl
+                  << "  Size:    " << _vendor.identtemplsizebytes << " bytes" << std::endl
+                  << "  Arena:   " << _vendor.itemplarena.bytes() << " bytes in " << _vendor.itemplarena.allocations() << " block(s)" << std::endl;
+    }
+    if(_setup.verbose)
+        std::cout << "  Image pool hits: " << _imagepool.hits() << ", misses: " << _imagepool.misses() << std::endl;
+
+    //----------------------------------------------------------------
+    std::cout << std::endl << "Stage 4 - identification search" << std::endl;
+    // Optional shuffle identification templates
+    if(_setup.shuffletemplates)
+        std::srand ( unsigned ( std::time(0) ) );
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active)
+            continue;
+        if(_multivendor)
+            std::cout << std::endl << "  " << _vendor.name.toStdString() << std::endl;
+        if(_setup.shuffletemplates) {
+            std::cout << std::endl << "Shuffling templates" << std::endl;
+            random_shuffle(_vendor.vtruelabel.begin(),_vendor.vtruelabel.end(),_vendor.vitempl.begin(),_vendor.vitempl.end());
+        }
+        searchVendor(_vendor,_setup,_perfcounters,_vsweepimages);
+    }
+    _vsweepimages.clear();
+
+    //----------------------------------------------------------------
+    std::cout << std::endl << "Stage 5 - CMC and DET computation" << std::endl << std::endl;
+    int _code = 0;
+    size_t _passed = 0;
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        if(!_vendor.active) {
+            if(_code == 0)
+                _code = _vendor.failurecode;
+            continue;
+        }
+        if(_multivendor)
+            std::cout << std::endl << "  " << _vendor.name.toStdString() << std::endl;
+        computeVendorMetrics(_vendor,_setup,_enrolllabelmax);
+        _passed++;
+    }
+    if(_multivendor)
+        std::cout << std::endl << "  Images decoded once: " << _decodes
+                  << ", decoding took " << 1.e-6 * _decodetimens << " ms"
+                  << " (saved " << 1.e-6 * _decodetimens * (_passed > 0 ? _passed - 1 : 0) << " ms against separate runs)" << std::endl;
+
+    QDateTime _enddt = QDateTime::currentDateTime();
+    // Let's print time consumption
+    if(_passed > 0)
+        showTimeConsumption(_setup.startdt.secsTo(_enddt));
+    else
+        std::cout << std::endl << "No vendor has passed the test" << std::endl;
+    // In the end we need to serialize test data
+    std::cout << " Wait untill output data will be saved..." << std::endl;
+
+    _tracebegin = _tracer.now();
+    for(size_t k = 0; k < _vvendors.size(); ++k) {
+        VendorRun &_vendor = *_vvendors[k];
+        QJsonObject _jsonobj;
+        if(_vendor.active) {
+            _jsonobj = serializeVendorRun(_vendor,_setup,_enddt);
+            if(_multivendor) {
+                QJsonObject _decodejson;
+                _decodejson["Images"]        = static_cast<qint64>(_decodes);
+                _decodejson["Vendors"]       = static_cast<qint64>(_vvendors.size());
+                _decodejson["Decodetime_ms"] = 1.e-6 * _decodetimens;
+                _jsonobj["Shareddecode"] = _decodejson;
+            }
+        } else {
+            _jsonobj = serializeVendorFailure(_vendor,_setup,_enddt);
+        }
+        _vendor.outputfile.write(QJsonDocument(_jsonobj).toJson());
+        _vendor.outputfile.close();
+        if(_multivendor)
+            std::cout << " " << _vendor.name.toStdString() << (_vendor.active ? "" : " (error record)")
+                      << " saved in " << _vendor.outputfile.fileName().toStdString() << std::endl;
+    }
+    _tracer.record("JSON serialization","io",_tracebegin);
+    if(_setup.tracing) {
+        const QString _tracefilename = _setup.outdir.absolutePath().append("/%1.trace.json").arg(_multivendor ? QString(APP_NAME) : _vvendors[0]->name);
+        if(_tracer.write(_tracefilename))
+            std::cout << " Timeline with " << _tracer.events() << " events saved in " << _tracefilename << std::endl;
+        else
+            std::cout << " Can not save timeline in " << _tracefilename << std::endl;
+    }
+    std::cout << " Done" << std::endl;
+    return _passed > 0 ? 0 : _code;
+}
+
+#endif // PIPELINE_H
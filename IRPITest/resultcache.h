@@ -0,0 +1,351 @@
+#ifndef RESULTCACHE_H
+#define RESULTCACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+#include "irpi.h"
+
+//--------------------------------------------------
+// Fast 64-bit hash of the template bytes, 8 bytes per step, murmur finalizer
+inline uint64_t hashTemplate(const uint8_t *_data, size_t _size, uint64_t _seed)
+{
+    const uint64_t _m = 0x9E3779B97F4A7C15ULL;
+    uint64_t _h = _seed ^ (_size * _m);
+    size_t i = 0;
+    for(; i + sizeof(uint64_t) <= _size; i += sizeof(uint64_t)) {
+        uint64_t _word;
+        std::memcpy(&_word,_data + i,sizeof(uint64_t));
+        _h ^= _word * _m;
+        _h = ((_h << 31) | (_h >> 33)) * 0xC2B2AE3D27D4EB4FULL;
+    }
+    for(; i < _size; ++i)
+        _h = (_h ^ _data[i]) * _m;
+    _h ^= _h >> 33;
+    _h *= 0xFF51AFD7ED558CCDULL;
+    _h ^= _h >> 33;
+    _h *= 0xC4CEB9FE1A85EC53ULL;
+    _h ^= _h >> 33;
+    return _h;
+}
+
+//--------------------------------------------------
+/* Decorator that keeps results of the last searches: repeated probe with the same candidate
+ * list length gets the stored candidates without the gallery scan. The key is the hash of the
+ * template bytes and the list length, the bytes are compared on hit, so results are exact.
+ * Entries are split into stripes by hash, each stripe has its own lock and LRU list, so
+ * concurrent searches rarely wait for each other. Any call that may change the gallery or
+ * the search (finalization, updates, parameters) drops all entries when it returns. Each such
+ * call also moves the generation on before and after the wrapped one, a search keeps its result
+ * only if the generation has not moved since the search began, so a result computed against the
+ * gallery that is being changed is never stored after the entries have been dropped */
+class CachedIdentInterface : public IRPI::IdentInterface
+{
+public:
+    CachedIdentInterface(std::shared_ptr<IRPI::IdentInterface> _inner, size_t _capacity, size_t _stripes=16) :
+        inner(_inner),
+        vstripes(std::max<size_t>(1,std::min(_stripes,_capacity))),
+        hits(0),
+        misses(0),
+        hitns(0),
+        missns(0),
+        invalidations(0),
+        generation(0),
+        missedcapacity(0) {
+        for(size_t s = 0; s < vstripes.size(); ++s)
+            vstripes[s].capacity = std::max<size_t>(1,_capacity / vstripes.size());
+    }
+
+    IRPI::ReturnStatus setParameter(const std::string &name, const std::string &value) override {
+        generation++;
+        IRPI::ReturnStatus _status = inner->setParameter(name,value);
+        invalidate();
+        return _status;
+    }
+
+    IRPI::ReturnStatus initializeEnrollmentSession(const std::string &configDir) override {
+        return inner->initializeEnrollmentSession(configDir);
+    }
+
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, std::vector<uint8_t> &templ) override {
+        return inner->createTemplate(img,role,templ);
+    }
+
+    size_t maxTemplateSize(IRPI::TemplateRole role) const override {
+        return inner->maxTemplateSize(role);
+    }
+
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, uint8_t *templ, size_t capacity, size_t &length) override {
+        return inner->createTemplate(img,role,templ,capacity,length);
+    }
+
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,std::vector<uint8_t>>> &vtempl) override {
+        generation++;
+        IRPI::ReturnStatus _status = inner->finalizeEnrollment(vtempl);
+        invalidate();
+        return _status;
+    }
+
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) override {
+        generation++;
+        IRPI::ReturnStatus _status = inner->finalizeEnrollment(vtempl);
+        invalidate();
+        return _status;
+    }
+
+    IRPI::ReturnStatus insertTemplates(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) override {
+        generation++;
+        IRPI::ReturnStatus _status = inner->insertTemplates(vtempl);
+        invalidate();
+        return _status;
+    }
+
+    IRPI::ReturnStatus removeLabels(const std::vector<size_t> &labels) override {
+        generation++;
+        IRPI::ReturnStatus _status = inner->removeLabels(labels);
+        invalidate();
+        return _status;
+    }
+
+    IRPI::ReturnStatus initializeIdentificationSession(const std::string &configDir) override {
+        generation++;
+        IRPI::ReturnStatus _status = inner->initializeIdentificationSession(configDir);
+        invalidate();
+        return _status;
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const std::vector<uint8_t> &idTemplate, const size_t candidateListLength,
+                                        std::vector<IRPI::Candidate> &candidateList, bool &decision) override {
+        IRPI::CandidateList _candidatelist(candidateListLength);
+        IRPI::ReturnStatus _status = identifyTemplate(IRPI::TemplateView(idTemplate),_candidatelist,decision);
+        for(size_t i = 0; i < _candidatelist.length; ++i)
+            candidateList.push_back(IRPI::Candidate(true,_candidatelist.labels[i],_candidatelist.scores[i]));
+        return _status;
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const IRPI::TemplateView &idTemplate, IRPI::CandidateList &candidateList, bool &decision) override {
+        QElapsedTimer _timer;
+        _timer.start();
+        const uint64_t _hash = hashTemplate(idTemplate.data(),idTemplate.size(),candidateList.capacity());
+        if(lookup(_hash,idTemplate,candidateList,decision)) {
+            hits++;
+            hitns += static_cast<uint64_t>(_timer.nsecsElapsed());
+            return IRPI::ReturnStatus(IRPI::ReturnCode::Success);
+        }
+        const uint64_t _generation = generation;
+        IRPI::ReturnStatus _status = inner->identifyTemplate(idTemplate,candidateList,decision);
+        if(_status.code == IRPI::ReturnCode::Success)
+            store(_generation,_hash,idTemplate,candidateList,decision);
+        misses++;
+        missns += static_cast<uint64_t>(_timer.nsecsElapsed());
+        return _status;
+    }
+
+    // Partial results depend on the deadline, so they are not kept
+    IRPI::ReturnStatus identifyTemplate(const IRPI::TemplateView &idTemplate, std::chrono::steady_clock::time_point deadline,
+                                        IRPI::CandidateList &candidateList, bool &decision, bool &partial) override {
+        QElapsedTimer _timer;
+        _timer.start();
+        const uint64_t _hash = hashTemplate(idTemplate.data(),idTemplate.size(),candidateList.capacity());
+        partial = false;
+        if(lookup(_hash,idTemplate,candidateList,decision)) {
+            hits++;
+            hitns += static_cast<uint64_t>(_timer.nsecsElapsed());
+            return IRPI::ReturnStatus(IRPI::ReturnCode::Success);
+        }
+        const uint64_t _generation = generation;
+        IRPI::ReturnStatus _status = inner->identifyTemplate(idTemplate,deadline,candidateList,decision,partial);
+        if(_status.code == IRPI::ReturnCode::Success && !partial)
+            store(_generation,_hash,idTemplate,candidateList,decision);
+        misses++;
+        missns += static_cast<uint64_t>(_timer.nsecsElapsed());
+        return _status;
+    }
+
+    /* Hits are answered at once, misses go to the wrapped interface as one batch and share its time.
+     * Buffers of the batch are kept between calls, so batches must not be searched concurrently */
+    IRPI::ReturnStatus identifyTemplates(const IRPI::TemplateView *idTemplates, size_t count,
+                                         IRPI::CandidateList *candidateLists, bool *decisions) override {
+        QElapsedTimer _timer;
+        vhashes.resize(count);
+        vmissed.clear();
+        vmissedtempl.clear();
+        for(size_t i = 0; i < count; ++i) {
+            _timer.start();
+            vhashes[i] = hashTemplate(idTemplates[i].data(),idTemplates[i].size(),candidateLists[i].capacity());
+            if(lookup(vhashes[i],idTemplates[i],candidateLists[i],decisions[i])) {
+                hits++;
+                hitns += static_cast<uint64_t>(_timer.nsecsElapsed());
+            } else {
+                vmissed.push_back(i);
+                vmissedtempl.push_back(idTemplates[i]);
+            }
+        }
+        if(vmissed.size() == 0)
+            return IRPI::ReturnStatus(IRPI::ReturnCode::Success);
+        if(vmissedlists.size() < vmissed.size())
+            vmissedlists.resize(vmissed.size());
+        for(size_t j = 0; j < vmissed.size(); ++j) {
+            const size_t _capacity = candidateLists[vmissed[j]].capacity();
+            if(vmissedlists[j].capacity() != _capacity)
+                vmissedlists[j] = IRPI::CandidateList(_capacity);
+            vmissedlists[j].clear();
+        }
+        if(missedcapacity < vmissed.size()) {
+            vmisseddecisions.reset(new bool[vmissed.size()]);
+            missedcapacity = vmissed.size();
+        }
+        _timer.start();
+        const uint64_t _generation = generation;
+        IRPI::ReturnStatus _status = inner->identifyTemplates(vmissedtempl.data(),vmissed.size(),vmissedlists.data(),vmisseddecisions.get());
+        for(size_t j = 0; j < vmissed.size(); ++j) {
+            const size_t i = vmissed[j];
+            candidateLists[i] = vmissedlists[j];
+            decisions[i] = vmisseddecisions[j];
+            // Whole successful batch is kept, even empty lists, while in a failed one empty list may be a failed search
+            if(_status.code == IRPI::ReturnCode::Success || vmissedlists[j].length > 0)
+                store(_generation,vhashes[i],idTemplates[i],candidateLists[i],decisions[i]);
+        }
+        misses += vmissed.size();
+        missns += static_cast<uint64_t>(_timer.nsecsElapsed());
+        return _status;
+    }
+
+    // Drops all entries, searches that have begun before are not stored any more
+    void invalidate() {
+        generation++;
+        for(size_t s = 0; s < vstripes.size(); ++s) {
+            std::lock_guard<std::mutex> _lock(vstripes[s].mutex);
+            vstripes[s].lru.clear();
+            vstripes[s].index.clear();
+        }
+        invalidations++;
+    }
+
+    void clearStats() {
+        hits = misses = hitns = missns = invalidations = 0;
+    }
+
+    size_t capacity() const { return vstripes.size() * vstripes[0].capacity; }
+    size_t hitCount() const { return hits; }
+    size_t missCount() const { return misses; }
+    size_t invalidationCount() const { return invalidations; }
+    double hitRate() const { return (hits + misses) > 0 ? static_cast<double>(hits) / (hits + misses) : 0.0; }
+    double hitTime() const { return hits > 0 ? static_cast<double>(hitns) / hits : 0.0; }
+    double missTime() const { return misses > 0 ? static_cast<double>(missns) / misses : 0.0; }
+    // Time hits would have taken as misses minus time they have taken
+    double savedTime() const { return hits * std::max(0.0, missTime() - hitTime()); }
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        std::vector<uint8_t> templ;
+        IRPI::CandidateList candidates;
+        bool decision;
+    };
+
+    struct Stripe
+    {
+        Stripe() : capacity(1) {}
+        std::mutex mutex;
+        size_t capacity;
+        std::list<Entry> lru; // most recently used first
+        std::unordered_multimap<uint64_t,std::list<Entry>::iterator> index;
+    };
+
+    bool lookup(uint64_t _hash, const IRPI::TemplateView &_templ, IRPI::CandidateList &_candidates, bool &_decision) {
+        Stripe &_stripe = vstripes[_hash % vstripes.size()];
+        std::lock_guard<std::mutex> _lock(_stripe.mutex);
+        auto _range = _stripe.index.equal_range(_hash);
+        for(auto _it = _range.first; _it != _range.second; ++_it) {
+            const Entry &_entry = *_it->second;
+            if(_entry.templ.size() == _templ.size() && _entry.candidates.capacity() == _candidates.capacity() &&
+               std::memcmp(_entry.templ.data(),_templ.data(),_templ.size()) == 0) {
+                _stripe.lru.splice(_stripe.lru.begin(),_stripe.lru,_it->second);
+                _candidates.clear();
+                for(size_t i = 0; i < _entry.candidates.length; ++i)
+                    _candidates.push(_entry.candidates.labels[i],_entry.candidates.scores[i]);
+                _decision = _entry.decision;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Generation is checked under the stripe lock, so invalidate() either refuses the entry or drops it
+    void store(uint64_t _generation, uint64_t _hash, const IRPI::TemplateView &_templ, const IRPI::CandidateList &_candidates, bool _decision) {
+        Stripe &_stripe = vstripes[_hash % vstripes.size()];
+        std::lock_guard<std::mutex> _lock(_stripe.mutex);
+        if(generation != _generation)
+            return;
+        if(_stripe.lru.size() == _stripe.capacity) {
+            // Least recently used entry is reused for the new one
+            auto _last = std::prev(_stripe.lru.end());
+            auto _range = _stripe.index.equal_range(_last->hash);
+            for(auto _it = _range.first; _it != _range.second; ++_it)
+                if(_it->second == _last) {
+                    _stripe.index.erase(_it);
+                    break;
+                }
+            _stripe.lru.splice(_stripe.lru.begin(),_stripe.lru,_last);
+        } else {
+            _stripe.lru.push_front(Entry());
+        }
+        Entry &_entry = _stripe.lru.front();
+        _entry.hash = _hash;
+        _entry.templ.assign(_templ.data(),_templ.data() + _templ.size());
+        _entry.candidates = _candidates;
+        _entry.decision = _decision;
+        _stripe.index.insert(std::make_pair(_hash,_stripe.lru.begin()));
+    }
+
+    std::shared_ptr<IRPI::IdentInterface> inner;
+    std::vector<Stripe> vstripes;
+    std::atomic<uint64_t> hits, misses, hitns, missns, invalidations;
+    std::atomic<uint64_t> generation; // moves on around every call that may change search results
+    // Batch buffers reused by identifyTemplates()
+    std::vector<uint64_t> vhashes;
+    std::vector<size_t> vmissed;
+    std::vector<IRPI::TemplateView> vmissedtempl;
+    std::vector<IRPI::CandidateList> vmissedlists;
+    std::unique_ptr<bool[]> vmisseddecisions;
+    size_t missedcapacity;
+};
+
+//--------------------------------------------------
+QJsonObject serializeResultCache(const CachedIdentInterface &_cached, size_t _requests)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Capacity"]      = static_cast<qint64>(_cached.capacity());
+    _jsonobj["Requests"]      = static_cast<qint64>(_requests);
+    _jsonobj["Hits"]          = static_cast<qint64>(_cached.hitCount());
+    _jsonobj["Hit_rate"]      = _cached.hitRate();
+    _jsonobj["Hit_us"]        = 1.e-3 * _cached.hitTime();
+    _jsonobj["Miss_us"]       = 1.e-3 * _cached.missTime();
+    _jsonobj["Saved_ms"]      = 1.e-6 * _cached.savedTime();
+    _jsonobj["Invalidations"] = static_cast<qint64>(_cached.invalidationCount());
+    return _jsonobj;
+}
+
+void showResultCache(const CachedIdentInterface &_cached, size_t _requests)
+{
+    std::cout << "  Requests: " << _requests << ", hit rate " << _cached.hitRate()
+              << " (" << _cached.hitCount() << " of " << _cached.hitCount() + _cached.missCount() << ")" << std::endl
+              << "  Hit: " << 1.e-3 * _cached.hitTime() << " us, miss: " << 1.e-3 * _cached.missTime() << " us" << std::endl
+              << "  Latency saved: " << 1.e-6 * _cached.savedTime() << " ms in total" << std::endl;
+}
+
+#endif // RESULTCACHE_H
@@ -0,0 +1,108 @@
+#ifndef SCALINGSWEEP_H
+#define SCALINGSWEEP_H
+
+#include <vector>
+
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include "irpi.h"
+#include "cputime.h"
+
+//--------------------------------------------------
+// Returns 1, 2, 4 ... cores up to _maxcores, _maxcores itself is always included
+std::vector<size_t> sweepCoreCounts(size_t _maxcores)
+{
+    std::vector<size_t> _counts;
+    for(size_t _cores = 1; _cores < _maxcores; _cores *= 2)
+        _counts.push_back(_cores);
+    if(_maxcores > 0)
+        _counts.push_back(_maxcores);
+    return _counts;
+}
+
+//--------------------------------------------------
+struct ScalingPoint
+{
+    ScalingPoint() : cores(0) {}
+    size_t   cores;
+    CPUStage stage;
+};
+
+struct NUMAPoint
+{
+    NUMAPoint() : cores(0) {}
+    size_t   cores;
+    CPUStage local, remote;
+};
+
+//--------------------------------------------------
+// Runs all identification templates through the search once, candidates are dropped
+void measureSearchPass(IRPI::IdentInterface *_recognizer,
+                       const std::vector<IRPI::TemplateView> &_vitempl,
+                       const size_t _candidates,
+                       CPUStage &_stage)
+{
+    CPUTimer _cputimer;
+    IRPI::CandidateList _candidatelist(_candidates);
+    bool _decision;
+    for(size_t i = 0; i < _vitempl.size(); ++i) {
+        _candidatelist.clear();
+        _cputimer.start();
+        _recognizer->identifyTemplate(_vitempl[i],_candidatelist,_decision);
+        _cputimer.stop(_stage);
+    }
+}
+
+// Runs all images through the identification template generation once, templates are dropped
+void measureGenerationPass(IRPI::IdentInterface *_recognizer,
+                           const std::vector<IRPI::Image> &_vimages,
+                           CPUStage &_stage)
+{
+    CPUTimer _cputimer;
+    for(size_t i = 0; i < _vimages.size(); ++i) {
+        std::vector<uint8_t> _templ;
+        _cputimer.start();
+        _recognizer->createTemplate(_vimages[i],IRPI::TemplateRole::Search_1N,_templ);
+        _cputimer.stop(_stage);
+    }
+}
+
+//--------------------------------------------------
+QJsonArray serializeScaling(const std::vector<ScalingPoint> &_vscaling)
+{
+    QJsonArray _jsonarr;
+    for(size_t i = 0; i < _vscaling.size(); ++i) {
+        const CPUStage &_stage = _vscaling[i].stage;
+        const double _walltime = _stage.calls > 0 ? _stage.wallns / _stage.calls : 0.0;
+        const double _basetime = _vscaling[0].stage.calls > 0 ? _vscaling[0].stage.wallns / _vscaling[0].stage.calls : 0.0;
+        const double _speedup = _walltime > 0 ? _basetime / _walltime : 0.0;
+        QJsonObject _jsonobj;
+        _jsonobj["Cores"]       = static_cast<qint64>(_vscaling[i].cores);
+        _jsonobj["Time_us"]     = 1.e-3 * _walltime;
+        _jsonobj["CPU_ms_per_call"] = _stage.calls > 0 ? 1.e-6 * _stage.processns / _stage.calls : 0.0;
+        _jsonobj["Speedup"]     = _speedup;
+        _jsonobj["Efficiency"]  = _speedup / _vscaling[i].cores;
+        _jsonobj["Parallelism"] = _stage.parallelism();
+        _jsonarr.push_back(qMove(_jsonobj));
+    }
+    return _jsonarr;
+}
+
+QJsonArray serializeNUMAScaling(const std::vector<NUMAPoint> &_vnuma)
+{
+    QJsonArray _jsonarr;
+    for(size_t i = 0; i < _vnuma.size(); ++i) {
+        const double _localtime  = _vnuma[i].local.calls > 0 ? _vnuma[i].local.wallns / _vnuma[i].local.calls : 0.0;
+        const double _remotetime = _vnuma[i].remote.calls > 0 ? _vnuma[i].remote.wallns / _vnuma[i].remote.calls : 0.0;
+        QJsonObject _jsonobj;
+        _jsonobj["Cores"]          = static_cast<qint64>(_vnuma[i].cores);
+        _jsonobj["Local_us"]       = 1.e-3 * _localtime;
+        _jsonobj["Remote_us"]      = 1.e-3 * _remotetime;
+        _jsonobj["Remote_penalty"] = _localtime > 0 ? _remotetime / _localtime : 0.0;
+        _jsonarr.push_back(qMove(_jsonobj));
+    }
+    return _jsonarr;
+}
+
+#endif // SCALINGSWEEP_H
@@ -0,0 +1,355 @@
+#ifndef SHARDING_H
+#define SHARDING_H
+
+#ifdef Q_OS_LINUX
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonObject>
+
+#include "irpi.h"
+#include "isolation.h"
+#include "tracing.h"
+#include "warmup.h"
+
+//--------------------------------------------------
+/* Local model of the multi-node deployment: enrollment set is split by label into S shards,
+ * each shard is finalized in its own worker process (see isolation.h). Every probe is sent
+ * to all shards at once and per shard top-K lists are merged into one candidate list */
+class ShardedIdentInterface : public IRPI::IdentInterface
+{
+public:
+    ShardedIdentInterface(size_t _shards, size_t _areasize, size_t _timeoutms=0) :
+        shards(std::max<size_t>(_shards,1)),
+        areasize(_areasize),
+        timeoutms(_timeoutms),
+        vgallery(shards,0),
+        vshardfailures(shards,0),
+        vshardlatencyns(shards),
+        vlists(shards),
+        vdecisions(shards,false),
+        vstatuses(shards),
+        vpositions(shards,0),
+        vpartials(shards,false),
+        failedsearches(0),
+        unsortedlists(0) {}
+
+    // Starts all workers
+    bool start() {
+        for(size_t s = 0; s < shards; ++s) {
+            vshards.push_back(std::make_shared<IsolatedIdentInterface>(areasize,timeoutms));
+            if(!vshards.back()->start())
+                return false;
+        }
+        return true;
+    }
+
+    IRPI::ReturnStatus setParameter(const std::string &name, const std::string &value) override {
+        IRPI::ReturnStatus _result(IRPI::ReturnCode::Success);
+        for(size_t s = 0; s < shards; ++s) {
+            // Every shard keeps its own gallery file
+            const std::string _value = name == "gallery_file" ? value + ".shard" + std::to_string(s) : value;
+            IRPI::ReturnStatus _status = vshards[s]->setParameter(name,_value);
+            if(_status.code != IRPI::ReturnCode::Success)
+                _result = _status;
+        }
+        return _result;
+    }
+
+    IRPI::ReturnStatus initializeEnrollmentSession(const std::string &configDir) override {
+        IRPI::ReturnStatus _result(IRPI::ReturnCode::Success);
+        for(size_t s = 0; s < shards; ++s) {
+            IRPI::ReturnStatus _status = vshards[s]->initializeEnrollmentSession(configDir);
+            if(_status.code != IRPI::ReturnCode::Success)
+                _result = _status;
+        }
+        return _result;
+    }
+
+    // Templates do not depend on the shard, so the first worker makes them
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, std::vector<uint8_t> &templ) override {
+        return vshards[0]->createTemplate(img,role,templ);
+    }
+
+    size_t maxTemplateSize(IRPI::TemplateRole role) const override {
+        return vshards[0]->maxTemplateSize(role);
+    }
+
+    IRPI::ReturnStatus createTemplate(const IRPI::Image &img, IRPI::TemplateRole role, uint8_t *templ, size_t capacity, size_t &length) override {
+        return vshards[0]->createTemplate(img,role,templ,capacity,length);
+    }
+
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,std::vector<uint8_t>>> &vtempl) override {
+        std::vector<std::pair<size_t,IRPI::TemplateView>> _vtempl;
+        _vtempl.reserve(vtempl.size());
+        for(size_t i = 0; i < vtempl.size(); ++i)
+            _vtempl.push_back(std::make_pair(vtempl[i].first,IRPI::TemplateView(vtempl[i].second)));
+        return finalizeEnrollment(_vtempl);
+    }
+
+    /* All templates of one label go to the same shard, shards finalize in parallel.
+     * Each shard keeps its part in the replay log of its worker, a memfd file rather than the heap,
+     * so the restarted shard gets its part and updates again instead of dropping out of the searches */
+    IRPI::ReturnStatus finalizeEnrollment(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) override {
+        std::vector<std::vector<std::pair<size_t,IRPI::TemplateView>>> _vparts(shards);
+        for(size_t i = 0; i < vtempl.size(); ++i)
+            _vparts[vtempl[i].first % shards].push_back(vtempl[i]);
+        for(size_t s = 0; s < shards; ++s) {
+            vgallery[s] = _vparts[s].size();
+            vshards[s]->postFinalizeEnrollment(_vparts[s]);
+        }
+        IRPI::ReturnStatus _result(IRPI::ReturnCode::Success);
+        for(size_t s = 0; s < shards; ++s) {
+            IRPI::ReturnStatus _status = vshards[s]->completeFinalizeEnrollment();
+            if(_status.code != IRPI::ReturnCode::Success)
+                _result = _status;
+        }
+        return _result;
+    }
+
+    // Updates of a label go to the shard it has been finalized in
+    IRPI::ReturnStatus insertTemplates(const std::vector<std::pair<size_t,IRPI::TemplateView>> &vtempl) override {
+        std::vector<std::vector<std::pair<size_t,IRPI::TemplateView>>> _vparts(shards);
+        for(size_t i = 0; i < vtempl.size(); ++i)
+            _vparts[vtempl[i].first % shards].push_back(vtempl[i]);
+        IRPI::ReturnStatus _result(IRPI::ReturnCode::Success);
+        for(size_t s = 0; s < shards; ++s) {
+            if(_vparts[s].size() == 0)
+                continue;
+            IRPI::ReturnStatus _status = vshards[s]->insertTemplates(_vparts[s]);
+            if(_status.code != IRPI::ReturnCode::Success)
+                _result = _status;
+        }
+        return _result;
+    }
+
+    IRPI::ReturnStatus removeLabels(const std::vector<size_t> &labels) override {
+        std::vector<std::vector<size_t>> _vparts(shards);
+        for(size_t i = 0; i < labels.size(); ++i)
+            _vparts[labels[i] % shards].push_back(labels[i]);
+        IRPI::ReturnStatus _result(IRPI::ReturnCode::Success);
+        for(size_t s = 0; s < shards; ++s) {
+            if(_vparts[s].size() == 0)
+                continue;
+            IRPI::ReturnStatus _status = vshards[s]->removeLabels(_vparts[s]);
+            if(_status.code != IRPI::ReturnCode::Success)
+                _result = _status;
+        }
+        return _result;
+    }
+
+    IRPI::ReturnStatus initializeIdentificationSession(const std::string &configDir) override {
+        IRPI::ReturnStatus _result(IRPI::ReturnCode::Success);
+        for(size_t s = 0; s < shards; ++s) {
+            IRPI::ReturnStatus _status = vshards[s]->initializeIdentificationSession(configDir);
+            if(_status.code != IRPI::ReturnCode::Success)
+                _result = _status;
+        }
+        return _result;
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const std::vector<uint8_t> &idTemplate, const size_t candidateListLength,
+                                        std::vector<IRPI::Candidate> &candidateList, bool &decision) override {
+        IRPI::CandidateList _candidatelist(candidateListLength);
+        IRPI::ReturnStatus _status = identifyTemplate(IRPI::TemplateView(idTemplate),_candidatelist,decision);
+        for(size_t i = 0; i < _candidatelist.length; ++i)
+            candidateList.push_back(IRPI::Candidate(true,_candidatelist.labels[i],_candidatelist.scores[i]));
+        return _status;
+    }
+
+    IRPI::ReturnStatus identifyTemplate(const IRPI::TemplateView &idTemplate, IRPI::CandidateList &candidateList, bool &decision) override {
+        bool _partial = false;
+        return search(idTemplate,0,candidateList,decision,_partial);
+    }
+
+    // Deadline goes to every shard, search is partial if any shard has cut its search short or failed
+    IRPI::ReturnStatus identifyTemplate(const IRPI::TemplateView &idTemplate, std::chrono::steady_clock::time_point deadline,
+                                        IRPI::CandidateList &candidateList, bool &decision, bool &partial) override {
+        return search(idTemplate,std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch()).count(),
+                      candidateList,decision,partial);
+    }
+
+    void clearStats() {
+        for(size_t s = 0; s < shards; ++s) {
+            vshardlatencyns[s].clear();
+            vshardfailures[s] = 0;
+        }
+        vmergens.clear();
+        ve2ens.clear();
+        failedsearches = unsortedlists = 0;
+    }
+
+    size_t shardsCount() const { return shards; }
+    size_t galleryTemplates(size_t _shard) const { return vgallery[_shard]; }
+    // Searches the shard has failed, the others' candidates were returned without it
+    size_t shardFailures(size_t _shard) const { return vshardfailures[_shard]; }
+    // Searches that have returned candidates of some shards only
+    size_t failedSearches() const { return failedsearches; }
+    // Shard lists that came out of descending order of scores and were sorted before the merge
+    size_t unsortedLists() const { return unsortedlists; }
+    const std::vector<double> &shardLatencies(size_t _shard) const { return vshardlatencyns[_shard]; }
+    const std::vector<double> &mergeTimes() const { return vmergens; }
+    const std::vector<double> &endToEndTimes() const { return ve2ens; }
+    size_t restarts() const {
+        size_t _restarts = 0;
+        for(size_t s = 0; s < vshards.size(); ++s)
+            _restarts += vshards[s]->restarts();
+        return _restarts;
+    }
+
+private:
+    /* Scatter: the probe goes to all shards before any answer is awaited.
+     * Gather: each shard returns its own top-K, K-way merge keeps the best K overall.
+     * If a shard fails, candidates of the other shards are still merged and the search succeeds
+     * as a partial one, failure is counted for the shard; its status is returned only if all shards fail */
+    IRPI::ReturnStatus search(const IRPI::TemplateView &_templ, int64_t _deadlinens,
+                              IRPI::CandidateList &_candidatelist, bool &_decision, bool &_partial) {
+        Tracer &_tracer = Tracer::instance();
+        qint64 _tracebegin = _tracer.now();
+        QElapsedTimer _e2etimer;
+        _e2etimer.start();
+        const size_t _k = _candidatelist.capacity();
+        for(size_t s = 0; s < shards; ++s) {
+            if(vlists[s].capacity() != _k)
+                vlists[s] = IRPI::CandidateList(_k);
+            vshards[s]->postIdentifyTemplate(_templ,_k,_deadlinens);
+        }
+        _tracer.record("shard fan-out","shards",_tracebegin);
+        _tracebegin = _tracer.now();
+        IRPI::ReturnStatus _failure(IRPI::ReturnCode::Success);
+        size_t _failed = 0;
+        for(size_t s = 0; s < shards; ++s) {
+            bool _shardecision = false, _shardpartial = false;
+            vstatuses[s] = vshards[s]->completeIdentifyTemplate(vlists[s],_shardecision,_shardpartial);
+            vdecisions[s] = _shardecision;
+            vpartials[s] = _shardpartial;
+            if(vstatuses[s].code == IRPI::ReturnCode::Success) {
+                vshardlatencyns[s].push_back(vshards[s]->lastLatency());
+            } else {
+                _failure = vstatuses[s];
+                vshardfailures[s]++;
+                _failed++;
+            }
+        }
+        _tracer.record("shard gather","shards",_tracebegin);
+        _tracebegin = _tracer.now();
+        QElapsedTimer _mergetimer;
+        _mergetimer.start();
+        _candidatelist.clear();
+        _decision = false;
+        _partial = _failed > 0;
+        for(size_t s = 0; s < shards; ++s) {
+            vpositions[s] = 0;
+            if(vstatuses[s].code == IRPI::ReturnCode::Success) {
+                _decision = _decision || vdecisions[s];
+                _partial = _partial || vpartials[s];
+                // K-way merge takes the heads of the lists, so each list must be in descending order
+                if(!std::is_sorted(vlists[s].scores.begin(),vlists[s].scores.begin() + vlists[s].length,std::greater<IsolationScore>())) {
+                    sortCandidates(vlists[s]);
+                    unsortedlists++;
+                }
+            } else {
+                vlists[s].clear();
+            }
+        }
+        while(_candidatelist.length < _k) {
+            size_t _best = shards;
+            for(size_t s = 0; s < shards; ++s)
+                if(vpositions[s] < vlists[s].length &&
+                   (_best == shards || vlists[s].scores[vpositions[s]] > vlists[_best].scores[vpositions[_best]]))
+                    _best = s;
+            if(_best == shards)
+                break;
+            _candidatelist.push(vlists[_best].labels[vpositions[_best]],vlists[_best].scores[vpositions[_best]]);
+            vpositions[_best]++;
+        }
+        _tracer.record("shard merge","shards",_tracebegin);
+        vmergens.push_back(_mergetimer.nsecsElapsed());
+        ve2ens.push_back(_e2etimer.nsecsElapsed());
+        if(_failed == shards)
+            return _failure;
+        if(_failed > 0)
+            failedsearches++;
+        return IRPI::ReturnStatus(IRPI::ReturnCode::Success);
+    }
+
+    // Puts the list in descending order of scores, NaN scores go last
+    void sortCandidates(IRPI::CandidateList &_list) {
+        vsorted.clear();
+        for(size_t i = 0; i < _list.length; ++i)
+            vsorted.push_back(std::make_pair(_list.scores[i],_list.labels[i]));
+        std::stable_sort(vsorted.begin(),vsorted.end(),
+                         [](const std::pair<IsolationScore,IsolationLabel> &_a, const std::pair<IsolationScore,IsolationLabel> &_b) {
+                             return _a.first > _b.first || (_a.first == _a.first && _b.first != _b.first);
+                         });
+        for(size_t i = 0; i < vsorted.size(); ++i) {
+            _list.scores[i] = vsorted[i].first;
+            _list.labels[i] = vsorted[i].second;
+        }
+    }
+
+    const size_t shards, areasize, timeoutms;
+    std::vector<std::shared_ptr<IsolatedIdentInterface>> vshards;
+    std::vector<size_t> vgallery, vshardfailures;
+    std::vector<std::vector<double>> vshardlatencyns;
+    std::vector<double> vmergens, ve2ens;
+    // Per search buffers, they are reused from probe to probe
+    std::vector<IRPI::CandidateList> vlists;
+    std::vector<bool> vdecisions;
+    std::vector<IRPI::ReturnStatus> vstatuses;
+    std::vector<size_t> vpositions;
+    std::vector<bool> vpartials;
+    std::vector<std::pair<IsolationScore,IsolationLabel>> vsorted;
+    size_t failedsearches, unsortedlists;
+};
+
+//--------------------------------------------------
+QJsonObject serializeSharding(const ShardedIdentInterface &_sharded)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Shards"]   = static_cast<qint64>(_sharded.shardsCount());
+    _jsonobj["Restarts"] = static_cast<qint64>(_sharded.restarts());
+    QJsonArray _shardsjson;
+    for(size_t s = 0; s < _sharded.shardsCount(); ++s) {
+        QJsonObject _shardjson = serializePercentiles(_sharded.shardLatencies(s));
+        _shardjson["Shard"]     = static_cast<qint64>(s);
+        _shardjson["Templates"] = static_cast<qint64>(_sharded.galleryTemplates(s));
+        _shardjson["Failures"]  = static_cast<qint64>(_sharded.shardFailures(s));
+        _shardsjson.push_back(qMove(_shardjson));
+    }
+    _jsonobj["Shard_latency"] = _shardsjson;
+    _jsonobj["Partial_searches"] = static_cast<qint64>(_sharded.failedSearches());
+    _jsonobj["Unsorted_lists"]   = static_cast<qint64>(_sharded.unsortedLists());
+    _jsonobj["Merge"]         = serializePercentiles(_sharded.mergeTimes());
+    _jsonobj["End_to_end"]    = serializePercentiles(_sharded.endToEndTimes());
+    return _jsonobj;
+}
+
+void showSharding(const ShardedIdentInterface &_sharded)
+{
+    for(size_t s = 0; s < _sharded.shardsCount(); ++s)
+        std::cout << "  Shard " << s << " (" << _sharded.galleryTemplates(s) << " templates)"
+                  << "  p50: " << 1.e-3 * percentile(_sharded.shardLatencies(s),0.5) << " us"
+                  << "  p99: " << 1.e-3 * percentile(_sharded.shardLatencies(s),0.99) << " us" << std::endl;
+    std::cout << "  Merge p50: " << 1.e-3 * percentile(_sharded.mergeTimes(),0.5) << " us"
+              << "  p99: " << 1.e-3 * percentile(_sharded.mergeTimes(),0.99) << " us" << std::endl
+              << "  End-to-end p50: " << 1.e-3 * percentile(_sharded.endToEndTimes(),0.5) << " us"
+              << "  p90: " << 1.e-3 * percentile(_sharded.endToEndTimes(),0.9) << " us"
+              << "  p99: " << 1.e-3 * percentile(_sharded.endToEndTimes(),0.99) << " us" << std::endl;
+    if(_sharded.failedSearches() > 0)
+        std::cout << "  Searches without some shards: " << _sharded.failedSearches() << std::endl;
+    if(_sharded.unsortedLists() > 0)
+        std::cout << "  Shard lists sorted before the merge: " << _sharded.unsortedLists() << std::endl;
+    if(_sharded.restarts() > 0)
+        std::cout << "  Worker restarts: " << _sharded.restarts() << std::endl;
+}
+
+#endif // Q_OS_LINUX
+
+#endif // SHARDING_H
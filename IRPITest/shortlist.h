@@ -0,0 +1,92 @@
+#ifndef SHORTLIST_H
+#define SHORTLIST_H
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+#include "irpi.h"
+#include "irpihelper.h"
+
+//--------------------------------------------------
+// Exhaustive vs two-stage search of the same templates, accuracy is filled after CMC and DET computation
+struct ShortlistComparison
+{
+    ShortlistComparison() : shortlist(0), exactns(0), shortlistns(0), exactTPIR(0), shortlistTPIR(0),
+                            exactFNIR(1), shortlistFNIR(1) {}
+    size_t shortlist;
+    double exactns, shortlistns; // average search time
+    double exactTPIR, shortlistTPIR; // TPIR[1]
+    double exactFNIR, shortlistFNIR; // FNIR at the best FPIR
+    double speedup() const { return shortlistns > 0 ? exactns / shortlistns : 0.0; }
+};
+
+//--------------------------------------------------
+/* Runs all identification templates through the search once (by batches if _batchsize > 0),
+ * returns average wall time per template in ns. If _vcandidates is given, it gets candidates
+ * of each template, failed searches keep their place with no candidates */
+double searchPass(IRPI::IdentInterface *_recognizer,
+                  const std::vector<IRPI::TemplateView> &_vitempl,
+                  const size_t _candidates,
+                  const size_t _batchsize,
+                  std::vector<std::vector<IRPI::Candidate>> *_vcandidates)
+{
+    const size_t _batch = std::max<size_t>(_batchsize,1);
+    std::vector<IRPI::CandidateList> _vlists(_batch,IRPI::CandidateList(_candidates));
+    std::unique_ptr<bool[]> _decisions(new bool[_batch]);
+    if(_vcandidates)
+        _vcandidates->assign(_vitempl.size(),std::vector<IRPI::Candidate>(_candidates));
+    QElapsedTimer _elapsedtimer;
+    double _timens = 0;
+    for(size_t i = 0; i < _vitempl.size(); i += _batch) {
+        const size_t _count = std::min(_batch,_vitempl.size() - i);
+        _elapsedtimer.start();
+        if(_batchsize > 0) {
+            _recognizer->identifyTemplates(&_vitempl[i],_count,_vlists.data(),_decisions.get());
+        } else {
+            _vlists[0].clear();
+            if(_recognizer->identifyTemplate(_vitempl[i],_vlists[0],_decisions[0]).code != IRPI::ReturnCode::Success)
+                _vlists[0].clear();
+        }
+        _timens += _elapsedtimer.nsecsElapsed();
+        if(_vcandidates)
+            for(size_t j = 0; j < _count; ++j)
+                copyCandidates(_vlists[j],(*_vcandidates)[i + j]);
+    }
+    return _vitempl.size() > 0 ? _timens / _vitempl.size() : 0.0;
+}
+
+//--------------------------------------------------
+QJsonObject serializeShortlist(const ShortlistComparison &_comparison, bool _withFNIR)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Size"]             = static_cast<qint64>(_comparison.shortlist);
+    _jsonobj["Exact_us"]         = 1.e-3 * _comparison.exactns;
+    _jsonobj["Shortlist_us"]     = 1.e-3 * _comparison.shortlistns;
+    _jsonobj["Speedup"]          = _comparison.speedup();
+    _jsonobj["TPIR1_exact"]      = _comparison.exactTPIR;
+    _jsonobj["TPIR1_shortlist"]  = _comparison.shortlistTPIR;
+    _jsonobj["TPIR1_loss"]       = _comparison.exactTPIR - _comparison.shortlistTPIR;
+    if(_withFNIR) {
+        _jsonobj["FNIR_exact"]     = _comparison.exactFNIR;
+        _jsonobj["FNIR_shortlist"] = _comparison.shortlistFNIR;
+    }
+    return _jsonobj;
+}
+
+void showShortlist(const ShortlistComparison &_comparison, bool _withFNIR)
+{
+    std::cout << "  Shortlist of " << _comparison.shortlist << ": "
+              << 1.e-3 * _comparison.shortlistns << " us vs " << 1.e-3 * _comparison.exactns << " us exhaustive"
+              << " (speed-up " << _comparison.speedup() << "x)" << std::endl
+              << "  TPIR[1]: " << _comparison.shortlistTPIR << " vs " << _comparison.exactTPIR
+              << " (loss " << _comparison.exactTPIR - _comparison.shortlistTPIR << ")" << std::endl;
+    if(_withFNIR)
+        std::cout << "  FNIR: " << _comparison.shortlistFNIR << " vs " << _comparison.exactFNIR << std::endl;
+}
+
+#endif // SHORTLIST_H
@@ -0,0 +1,18 @@
+# Host instruction set code generation is opt-in: qmake CONFIG+=enablesimd
+# Binaries built with it run only on CPUs like the build host, so Vendor's libraries
+# meant to be shipped should not use it. Without it irpiproc.h kernels go with the
+# baseline instruction set of the target (SSE2 on x86-64, NEON on AArch64)
+enablesimd {
+    win32-msvc* {
+        QMAKE_CXXFLAGS += /arch:AVX2
+    }
+    win32-g++ {
+        QMAKE_CXXFLAGS += -march=native
+    }
+    linux {
+        QMAKE_CXXFLAGS += -march=native
+    }
+    message(SIMD enabled)
+} else {
+    message(SIMD disabled)
+}
@@ -0,0 +1,100 @@
+#ifndef TEMPLATEARENA_H
+#define TEMPLATEARENA_H
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "irpi.h"
+
+//--------------------------------------------------
+/* Bump allocator for the templates: memory comes in big blocks, templates are
+ * placed one after another and can not be freed one by one, only all at once by release().
+ * Each template starts at the 64-byte boundary, so Vendor's API may read it with aligned loads */
+class TemplateArena
+{
+public:
+    explicit TemplateArena(size_t _blocksize=(static_cast<size_t>(1) << 24)) :
+        blocksize(_blocksize),
+        offset(0),
+        capacity(0),
+        used(0) {}
+
+    // Returns pointer to at least _size bytes, call commit() with actual size when the template is ready
+    uint8_t *reserve(size_t _size) {
+        offset = (offset + alignment - 1) & ~(alignment - 1);
+        if(blocks.size() == 0 || offset + _size > capacity) {
+            capacity = std::max(blocksize, _size + alignment);
+            blocks.push_back(std::unique_ptr<uint8_t[]>(new uint8_t[capacity]));
+            // Align the beginning of the block
+            const size_t _address = reinterpret_cast<size_t>(blocks.back().get());
+            offset = ((_address + alignment - 1) & ~(alignment - 1)) - _address;
+        }
+        return blocks.back().get() + offset;
+    }
+
+    // Marks _size bytes of the last reservation as occupied
+    void commit(size_t _size) {
+        offset += _size;
+        used += _size;
+    }
+
+    // Copies template into the arena
+    IRPI::TemplateView push(const uint8_t *_data, size_t _size) {
+        uint8_t *_ptr = reserve(_size);
+        if(_size > 0)
+            std::memcpy(_ptr, _data, _size);
+        commit(_size);
+        return IRPI::TemplateView(_ptr, _size);
+    }
+
+    // Frees all templates at once
+    void release() {
+        blocks.clear();
+        blocks.shrink_to_fit();
+        offset = capacity = used = 0;
+    }
+
+    size_t bytes() const { return used; }
+    size_t allocations() const { return blocks.size(); }
+
+private:
+    TemplateArena(const TemplateArena &);
+    TemplateArena &operator=(const TemplateArena &);
+
+    static const size_t alignment = 64;
+    const size_t blocksize;
+    size_t offset, capacity, used;
+    std::vector<std::unique_ptr<uint8_t[]>> blocks;
+};
+
+//--------------------------------------------------
+/* Creates template straight in the arena when Vendor's API reports maximum template size (_maxsize > 0),
+ * otherwise goes through the vector based createTemplate() and copies the result into the arena */
+IRPI::ReturnStatus createTemplateInArena(IRPI::IdentInterface *_recognizer,
+                                         const IRPI::Image &_img,
+                                         IRPI::TemplateRole _role,
+                                         size_t _maxsize,
+                                         TemplateArena &_arena,
+                                         IRPI::TemplateView &_view)
+{
+    IRPI::ReturnStatus _status;
+    if(_maxsize > 0) {
+        uint8_t *_ptr = _arena.reserve(_maxsize);
+        size_t _length = 0;
+        _status = _recognizer->createTemplate(_img,_role,_ptr,_maxsize,_length);
+        if(_status.code == IRPI::ReturnCode::Success) {
+            _arena.commit(_length);
+            _view = IRPI::TemplateView(_ptr,_length);
+        }
+    } else {
+        std::vector<uint8_t> _templ;
+        _status = _recognizer->createTemplate(_img,_role,_templ);
+        if(_status.code == IRPI::ReturnCode::Success)
+            _view = _arena.push(_templ.data(),_templ.size());
+    }
+    return _status;
+}
+
+#endif // TEMPLATEARENA_H
@@ -0,0 +1,150 @@
+#ifndef TRACING_H
+#define TRACING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <QString>
+
+//--------------------------------------------------
+struct TraceEvent
+{
+    const char *name;     // must point to a string literal, we do not copy it
+    const char *category; // must point to a string literal too
+    qint64 beginns;
+    qint64 endns;
+};
+
+//--------------------------------------------------
+/* Each thread writes into its own ring buffer, so recording needs no locks.
+ * When the ring is full the oldest events are overwritten */
+class TraceBuffer
+{
+public:
+    TraceBuffer(size_t _capacitylog2, int _tid) :
+        events(static_cast<size_t>(1) << _capacitylog2),
+        mask((static_cast<size_t>(1) << _capacitylog2) - 1),
+        head(0),
+        tid(_tid),
+        name(nullptr) {}
+
+    void push(const TraceEvent &_event) {
+        const size_t _pos = head.load(std::memory_order_relaxed);
+        events[_pos & mask] = _event;
+        head.store(_pos + 1, std::memory_order_release);
+    }
+
+    std::vector<TraceEvent> events;
+    const size_t mask;
+    std::atomic<size_t> head;
+    const int tid;
+    const char *name;
+};
+
+//--------------------------------------------------
+/* Records begin/end pairs of the harness and Vendor's API calls and writes them
+ * in Chrome Trace Event format, so the file can be opened in chrome://tracing or ui.perfetto.dev */
+class Tracer
+{
+public:
+    static Tracer &instance() {
+        static Tracer _tracer;
+        return _tracer;
+    }
+
+    void enable(size_t _capacitylog2=18) {
+        capacitylog2 = _capacitylog2;
+        enabled.store(true, std::memory_order_release);
+    }
+    bool isEnabled() const { return enabled.load(std::memory_order_relaxed); }
+
+    // Returns 0 when tracing is disabled, so the clock is not even read
+    qint64 now() const {
+        if(!isEnabled())
+            return 0;
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - origin).count();
+    }
+
+    // Records event that has begun at _beginns (taken from now()) and ends right now
+    void record(const char *_name, const char *_category, qint64 _beginns) {
+        if(!isEnabled())
+            return;
+        TraceEvent _event;
+        _event.name = _name;
+        _event.category = _category;
+        _event.beginns = _beginns;
+        _event.endns = now();
+        threadBuffer()->push(_event);
+    }
+
+    void setThreadName(const char *_name) {
+        if(isEnabled())
+            threadBuffer()->name = _name;
+    }
+
+    // Should be called when all recording threads are done
+    bool write(const QString &_filename) {
+        std::FILE *_file = std::fopen(_filename.toLocal8Bit().constData(), "w");
+        if(_file == nullptr)
+            return false;
+        std::fprintf(_file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+        bool _first = true;
+        std::lock_guard<std::mutex> _lock(mutex);
+        for(size_t i = 0; i < buffers.size(); ++i) {
+            const TraceBuffer &_buffer = *buffers[i];
+            if(_buffer.name != nullptr) {
+                std::fprintf(_file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s\"}}",
+                             _first ? "" : ",\n", _buffer.tid, _buffer.name);
+                _first = false;
+            }
+            const size_t _head = _buffer.head.load(std::memory_order_acquire);
+            const size_t _capacity = _buffer.events.size();
+            for(size_t k = (_head > _capacity ? _head - _capacity : 0); k < _head; ++k) {
+                const TraceEvent &_event = _buffer.events[k & _buffer.mask];
+                std::fprintf(_file, "%s{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                             _first ? "" : ",\n", _event.name, _event.category, _buffer.tid,
+                             1.e-3 * _event.beginns, 1.e-3 * (_event.endns - _event.beginns));
+                _first = false;
+            }
+        }
+        std::fprintf(_file, "\n]}\n");
+        return std::fclose(_file) == 0;
+    }
+
+    size_t events() {
+        std::lock_guard<std::mutex> _lock(mutex);
+        size_t _total = 0;
+        for(size_t i = 0; i < buffers.size(); ++i)
+            _total += std::min(buffers[i]->head.load(std::memory_order_acquire), buffers[i]->events.size());
+        return _total;
+    }
+
+private:
+    Tracer() : enabled(false), capacitylog2(18), origin(std::chrono::steady_clock::now()) {}
+    Tracer(const Tracer &);
+    Tracer &operator=(const Tracer &);
+
+    // Buffer is created on the first event of the thread, this is the only place where we lock
+    TraceBuffer *threadBuffer() {
+        static thread_local TraceBuffer *_buffer = nullptr;
+        if(_buffer == nullptr) {
+            std::lock_guard<std::mutex> _lock(mutex);
+            buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer(capacitylog2, static_cast<int>(buffers.size()) + 1)));
+            _buffer = buffers.back().get();
+        }
+        return _buffer;
+    }
+
+    std::atomic<bool> enabled;
+    size_t capacitylog2;
+    const std::chrono::steady_clock::time_point origin;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer>> buffers;
+};
+
+#endif // TRACING_H
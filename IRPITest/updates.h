@@ -0,0 +1,134 @@
+#ifndef UPDATES_H
+#define UPDATES_H
+
+#include <algorithm>
+#include <iostream>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+
+#include "irpi.h"
+#include "warmup.h"
+
+//--------------------------------------------------
+/* Gallery updates mixed into the search: after every searchesperupdate searches one label is
+ * removed from the finalized gallery, after the next ones it is inserted back, then the next
+ * label goes. So the gallery is the same again when the workload ends. Updates and searches
+ * are called one after another from the same thread, so no search overlaps an update: the
+ * search latency measured is the one between updates, it shows the cost a changed gallery
+ * (e.g. uncompacted rows, tombstones) adds to the search, not the contention of a search
+ * running while an update does. The latter would need Vendor's API to allow concurrent calls,
+ * which irpi.h does not demand */
+struct MixedWorkload
+{
+    MixedWorkload() : searchesperupdate(0), labels(0), failed(0) {}
+    size_t searchesperupdate;
+    size_t labels; // how many labels have been cycled
+    size_t failed; // updates refused by Vendor's API
+    std::vector<double> vbaselinens, vbetweenns; // search latencies without the updates and between them
+    std::vector<double> vinsertns, vremovens;
+};
+
+// Labels of the enrollment templates, templates of the first _maxlabels labels are copied as they are released after finalization
+std::vector<std::vector<std::pair<size_t,IRPI::TemplateView>>> groupUpdateTemplates(const std::vector<std::pair<size_t,IRPI::TemplateView>> &_vetempl,
+                                                                                    size_t _maxlabels,
+                                                                                    std::vector<std::vector<uint8_t>> &_vcopies)
+{
+    std::vector<std::vector<std::pair<size_t,IRPI::TemplateView>>> _vgroups;
+    size_t _count = 0;
+    for(size_t i = 0; i < _vetempl.size(); ++i) {
+        if(i == 0 || _vetempl[i].first != _vetempl[i - 1].first) {
+            if(_vgroups.size() == _maxlabels)
+                break;
+            _vgroups.push_back(std::vector<std::pair<size_t,IRPI::TemplateView>>());
+        }
+        _vgroups.back().push_back(_vetempl[i]);
+        _count++;
+    }
+    // Views are pointed to the copies when all of them are made, so the copies are not moved any more
+    _vcopies.resize(_count);
+    _count = 0;
+    for(size_t g = 0; g < _vgroups.size(); ++g)
+        for(size_t i = 0; i < _vgroups[g].size(); ++i, ++_count) {
+            _vcopies[_count].assign(_vgroups[g][i].second.data(),_vgroups[g][i].second.data() + _vgroups[g][i].second.size());
+            _vgroups[g][i].second = IRPI::TemplateView(_vcopies[_count]);
+        }
+    return _vgroups;
+}
+
+//--------------------------------------------------
+// Searches and updates go one by one on the calling thread, each template is searched once without updates and once between them
+void runMixedWorkload(IRPI::IdentInterface *_recognizer,
+                      const std::vector<IRPI::TemplateView> &_vitempl,
+                      const size_t _candidates,
+                      const std::vector<std::vector<std::pair<size_t,IRPI::TemplateView>>> &_vgroups,
+                      MixedWorkload &_workload)
+{
+    IRPI::CandidateList _candidatelist(_candidates);
+    QElapsedTimer _elapsedtimer;
+    bool _decision;
+    for(size_t i = 0; i < _vitempl.size(); ++i) {
+        _candidatelist.clear();
+        _elapsedtimer.start();
+        _recognizer->identifyTemplate(_vitempl[i],_candidatelist,_decision);
+        _workload.vbaselinens.push_back(_elapsedtimer.nsecsElapsed());
+    }
+    size_t _group = 0;
+    bool _removed = false;
+    auto _update = [&]() {
+        if(_vgroups.size() == 0)
+            return;
+        IRPI::ReturnStatus _status;
+        std::vector<size_t> _labels(1,_vgroups[_group].front().first);
+        _elapsedtimer.start();
+        _status = _removed ? _recognizer->insertTemplates(_vgroups[_group]) : _recognizer->removeLabels(_labels);
+        (_removed ? _workload.vinsertns : _workload.vremovens).push_back(_elapsedtimer.nsecsElapsed());
+        if(_status.code != IRPI::ReturnCode::Success)
+            _workload.failed++;
+        if(_removed)
+            _group = (_group + 1) % _vgroups.size();
+        _removed = !_removed;
+    };
+    for(size_t i = 0; i < _vitempl.size(); ++i) {
+        _candidatelist.clear();
+        _elapsedtimer.start();
+        _recognizer->identifyTemplate(_vitempl[i],_candidatelist,_decision);
+        _workload.vbetweenns.push_back(_elapsedtimer.nsecsElapsed());
+        if((i + 1) % _workload.searchesperupdate == 0)
+            _update();
+    }
+    if(_removed)
+        _update();
+    _workload.labels = std::min(_vgroups.size(),_workload.vremovens.size());
+}
+
+//--------------------------------------------------
+QJsonObject serializeMixedWorkload(const MixedWorkload &_workload)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["Searches_per_update"] = static_cast<qint64>(_workload.searchesperupdate);
+    _jsonobj["Labels"]              = static_cast<qint64>(_workload.labels);
+    _jsonobj["Failed"]              = static_cast<qint64>(_workload.failed);
+    _jsonobj["Search_without_updates"] = serializePercentiles(_workload.vbaselinens);
+    _jsonobj["Search_between_updates"] = serializePercentiles(_workload.vbetweenns);
+    _jsonobj["Insert"]              = serializePercentiles(_workload.vinsertns);
+    _jsonobj["Remove"]              = serializePercentiles(_workload.vremovens);
+    return _jsonobj;
+}
+
+void showMixedWorkload(const MixedWorkload &_workload)
+{
+    std::cout << "  Updates: " << _workload.vinsertns.size() << " inserts and " << _workload.vremovens.size()
+              << " removes over " << _workload.labels << " labels, " << _workload.failed << " failed" << std::endl
+              << "  Search p50: " << 1.e-3 * percentile(_workload.vbetweenns,0.5) << " us between updates vs "
+              << 1.e-3 * percentile(_workload.vbaselinens,0.5) << " us without updates" << std::endl
+              << "  Search p99: " << 1.e-3 * percentile(_workload.vbetweenns,0.99) << " us between updates vs "
+              << 1.e-3 * percentile(_workload.vbaselinens,0.99) << " us without updates" << std::endl
+              << "  Insert p50: " << 1.e-3 * percentile(_workload.vinsertns,0.5) << " us"
+              << "  p99: " << 1.e-3 * percentile(_workload.vinsertns,0.99) << " us" << std::endl
+              << "  Remove p50: " << 1.e-3 * percentile(_workload.vremovens,0.5) << " us"
+              << "  p99: " << 1.e-3 * percentile(_workload.vremovens,0.99) << " us" << std::endl;
+}
+
+#endif // UPDATES_H
@@ -0,0 +1,120 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include <algorithm>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QString>
+
+#include "tracing.h"
+
+//--------------------------------------------------
+/* Keeps latency of every call of the stage in the order they were made.
+ * First warmupcalls entries belong to untimed warm-up calls, so they do not go to averages,
+ * but they still count when we look for the moment the stage reaches steady state */
+struct LatencyTrace
+{
+    LatencyTrace() : warmupcalls(0) {}
+    size_t warmupcalls;
+    std::vector<double> vlatencyns;
+
+    bool isCold() const { return vlatencyns.size() == 0; }
+    void add(double _ns) { vlatencyns.push_back(_ns); }
+    void addWarmup(double _ns) {
+        vlatencyns.push_back(_ns);
+        warmupcalls++;
+    }
+    double firstCall() const { return vlatencyns.size() > 0 ? vlatencyns[0] : 0.0; }
+};
+
+//--------------------------------------------------
+// Makes _calls untimed calls of the functor, latencies go to the trace as warm-up
+template <typename Call>
+void warmUp(Call _call, size_t _calls, LatencyTrace &_trace)
+{
+    Tracer &_tracer = Tracer::instance();
+    QElapsedTimer _timer;
+    for(size_t i = 0; i < _calls; ++i) {
+        const qint64 _tracebegin = _tracer.now();
+        _timer.start();
+        _call();
+        _trace.addWarmup(_timer.nsecsElapsed());
+        _tracer.record("warm-up call","vendor",_tracebegin);
+    }
+}
+
+//--------------------------------------------------
+struct SteadyState
+{
+    SteadyState() : calls(0), timens(0), latencyns(0) {}
+    size_t calls;     // how many calls (warm-up included) it took to reach steady state
+    double timens;    // how long it took to reach steady state
+    double latencyns; // steady state latency (median of the second half of the calls)
+};
+
+/* Steady state is reached at the first call since which _window consecutive calls
+ * all stay within _tolerance of the steady state latency */
+SteadyState findSteadyState(const LatencyTrace &_trace, size_t _window=8, double _tolerance=1.25)
+{
+    SteadyState _steady;
+    const std::vector<double> &_v = _trace.vlatencyns;
+    if(_v.size() == 0)
+        return _steady;
+    std::vector<double> _tail(_v.begin() + _v.size() / 2, _v.end());
+    std::nth_element(_tail.begin(), _tail.begin() + _tail.size() / 2, _tail.end());
+    _steady.latencyns = _tail[_tail.size() / 2];
+    const double _threshold = _tolerance * _steady.latencyns;
+    _window = std::min(_window, _v.size());
+    size_t _inrow = 0;
+    for(size_t i = 0; i < _v.size(); ++i) {
+        _inrow = (_v[i] <= _threshold) ? _inrow + 1 : 0;
+        if(_inrow == _window) {
+            _steady.calls = i + 1 - _window;
+            break;
+        }
+    }
+    for(size_t i = 0; i < _steady.calls; ++i)
+        _steady.timens += _v[i];
+    return _steady;
+}
+
+//--------------------------------------------------
+// Latencies go in milliseconds or in microseconds (_inmicroseconds == true)
+QJsonObject serializeWarmup(const LatencyTrace &_trace, bool _inmicroseconds=false)
+{
+    const SteadyState _steady = findSteadyState(_trace);
+    const double _scale = _inmicroseconds ? 1.e-3 : 1.e-6;
+    const QString _units = _inmicroseconds ? "_us" : "_ms";
+    QJsonObject _jsonobj;
+    _jsonobj["Warmup_calls"]      = static_cast<qint64>(_trace.warmupcalls);
+    _jsonobj["Firstcall" + _units] = _scale * _trace.firstCall();
+    _jsonobj["Steady" + _units]    = _scale * _steady.latencyns;
+    _jsonobj["Calls_to_steady"]   = static_cast<qint64>(_steady.calls);
+    _jsonobj["Time_to_steady_ms"] = 1.e-6 * _steady.timens;
+    return _jsonobj;
+}
+
+//--------------------------------------------------
+// Returns _q quantile (0..1) of the values, nearest rank
+double percentile(std::vector<double> _values, double _q)
+{
+    if(_values.size() == 0)
+        return 0.0;
+    const size_t _rank = std::min(_values.size() - 1, static_cast<size_t>(_q * _values.size()));
+    std::nth_element(_values.begin(), _values.begin() + _rank, _values.end());
+    return _values[_rank];
+}
+
+QJsonObject serializePercentiles(const std::vector<double> &_valuesns)
+{
+    QJsonObject _jsonobj;
+    _jsonobj["P50_us"] = 1.e-3 * percentile(_valuesns, 0.50);
+    _jsonobj["P90_us"] = 1.e-3 * percentile(_valuesns, 0.90);
+    _jsonobj["P99_us"] = 1.e-3 * percentile(_valuesns, 0.99);
+    _jsonobj["Max_us"] = 1.e-3 * percentile(_valuesns, 1.00);
+    return _jsonobj;
+}
+
+#endif // WARMUP_H
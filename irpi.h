@@ -11,6 +11,8 @@
 #ifndef IRPI_H_
 #define IRPI_H_
 
+#include <algorithm>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
 #include <memory>
@@ -200,6 +202,104 @@ typedef struct Candidate {
         {}
 } Candidate;
 
+/**
+ * @brief
+ * Non-owning reference to a template that lives in caller's memory
+ *
+ * @details
+ * IRPITest keeps templates contiguously in its own memory arena and passes
+ * them to the implementation by reference, so no copies are made.  Data
+ * behind the view is valid only for the duration of the call.
+ */
+typedef struct TemplateView {
+    /** @brief Pointer to the first byte of the template */
+    const uint8_t *ptr;
+    /** @brief Size of the template in bytes */
+    size_t length;
+
+    TemplateView() :
+        ptr{nullptr},
+        length{0}
+        {}
+
+    TemplateView(
+        const uint8_t *ptr,
+        size_t length) :
+        ptr{ptr},
+        length{length}
+        {}
+
+    TemplateView(
+        const std::vector<uint8_t> &templ) :
+        ptr{templ.data()},
+        length{templ.size()}
+        {}
+
+    const uint8_t*
+    data() const { return ptr; }
+
+    size_t
+    size() const { return length; }
+} TemplateView;
+
+/**
+ * @brief
+ * Caller allocated list of the candidates for an identification search
+ *
+ * @details
+ * Structure of arrays alternative to std::vector<Candidate>: labels go in
+ * one array and scores in another one, so a candidate takes 16 bytes with
+ * no padding instead of 24.  Labels and scores keep the types of
+ * Candidate::label and Candidate::similarityScore, so results converted
+ * between the two forms are exactly the same; a 32-bit label array would
+ * truncate labels the vector form accepts.  The caller allocates the list once
+ * with the capacity equal to candidateListLength and reuses it for every
+ * search, so the search itself does not need to allocate any memory.
+ * Only the first length entries are assigned candidates; they shall appear
+ * in descending order of similarity score.
+ */
+typedef struct CandidateList {
+    /** @brief Labels of the candidates from the enrollment set, same type as Candidate::label */
+    std::vector<size_t> labels;
+    /** @brief Similarity scores of the candidates, same type as Candidate::similarityScore */
+    std::vector<double> scores;
+    /** @brief Number of assigned candidates, they occupy first length entries */
+    size_t length;
+
+    CandidateList() :
+        length{0}
+        {}
+
+    explicit CandidateList(
+        size_t capacity) :
+        labels(capacity, 0),
+        scores(capacity, 0.0),
+        length{0}
+        {}
+
+    /** @brief Maximum number of candidates the list can hold */
+    size_t
+    capacity() const { return labels.size(); }
+
+    /** @brief Drops all candidates, memory is kept for the next search */
+    void
+    clear() { length = 0; }
+
+    /** @brief Appends candidate to the end of the list, returns false if the list is full */
+    bool
+    push(
+        size_t label,
+        double similarityScore)
+    {
+        if(length == labels.size())
+            return false;
+        labels[length] = label;
+        scores[length] = similarityScore;
+        length++;
+        return true;
+    }
+} CandidateList;
+
 /** =================================================================
  * @brief
  * The interface to IRPI 1:N implementation (1:N means one to many recognition scheme)
@@ -207,6 +307,15 @@ typedef struct Candidate {
  * @details
  * The submission software under test will implement this interface by
  * sub-classing this class and implementing each method therein.
+ * <br>Optional members with default implementations are only ever added
+ * after all existing virtual members, so with the Itanium C++ ABI (GCC,
+ * Clang) the members of an older version of this header keep their vtable
+ * slots.  The vtable of a library built against an older version ends before
+ * the appended members, so they shall not be called on it: applications
+ * find out the version with irpiGetImplementation() and call only the
+ * members that version has.  MSVC places overloads of one name next to each
+ * other in the vtable, so on Windows libraries shall be rebuilt with this
+ * header.
  */
 class DLLSPEC IdentInterface {
 public:
@@ -262,7 +371,8 @@ public:
     /**
      * @brief This function will be called after all enrollment templates have
      * been created and freezes the enrollment data.
-     * After this call, the enrollment dataset will be read-only.
+     * After this call, the enrollment dataset will be read-only, except for
+     * insertTemplates() and removeLabels() if the implementation supports them.
      *
      * @details This function allows the implementation to conduct,
      * for example, statistical processing of the feature data, indexing and
@@ -329,6 +439,274 @@ public:
         std::vector<Candidate> &candidateList,
         bool &decision) = 0;
 
+    /** @brief Allocation free form of the identifyTemplate() above.
+     *
+     * @details The search shall fill candidateList which is allocated by the
+     * caller and is reused between the calls, so implementations should not
+     * allocate memory here.  The number of candidates the search should return
+     * is candidateList.capacity(); candidateList will be cleared when passed
+     * into this function.  Default implementation copies the template into
+     * a vector, calls the vector based identifyTemplate() and converts its
+     * output, so it allocates memory and its time includes the copy;
+     * implementations are encouraged to override it.  IRPITest calls the
+     * vector based form directly on libraries built against a header
+     * without this member.
+     *
+     * @param[in] idTemplate
+     * A template from createTemplate(), passed by reference to the memory
+     * of IRPITest.
+     * @param[out] candidateList
+     * Caller allocated list; the candidates shall appear in descending
+     * order of similarity score.
+     * @param[out] decision
+     * A best guess at whether there is a mate within the enrollment database.
+     */
+    virtual ReturnStatus
+    identifyTemplate(
+        const TemplateView &idTemplate,
+        CandidateList &candidateList,
+        bool &decision)
+    {
+        std::vector<Candidate> _candidates;
+        _candidates.reserve(candidateList.capacity());
+        ReturnStatus _status = identifyTemplate(std::vector<uint8_t>(idTemplate.data(), idTemplate.data() + idTemplate.size()),
+                                                candidateList.capacity(), _candidates, decision);
+        candidateList.clear();
+        for(size_t i = 0; i < _candidates.size(); ++i)
+            if(_candidates[i].isAssigned)
+                candidateList.push(_candidates[i].label, _candidates[i].similarityScore);
+        return _status;
+    }
+
+    /**
+     * @brief This function returns the maximum size in bytes of the template
+     * that createTemplate() may produce for the given role.
+     *
+     * @details IRPITest uses it to reserve space for the templates in its own
+     * memory arena.  Value 0 means the size is not known in advance, in such
+     * case IRPITest will use the vector based createTemplate().
+     */
+    virtual size_t
+    maxTemplateSize(
+        TemplateRole role) const
+    {
+        (void)role;
+        return 0;
+    }
+
+    /**
+     * @brief This function takes an Image and writes the template into the
+     * caller supplied memory.
+     *
+     * @details Same as the vector based createTemplate(), but the output goes
+     * to the space of capacity bytes reserved by IRPITest in its memory arena,
+     * so no heap allocation is needed for the template.  Capacity is
+     * maxTemplateSize(role).  Default implementation calls the vector based
+     * createTemplate() and copies the result.
+     *
+     * @param[in] img
+     * The input image.
+     * @param[in] role
+     * A value from the TemplateRole enumeration.
+     * @param[out] templ
+     * Caller supplied memory of capacity bytes.
+     * @param[in] capacity
+     * Size of the memory behind templ.
+     * @param[out] length
+     * Actual size of the template in bytes.
+     */
+    virtual ReturnStatus
+    createTemplate(
+        const Image &img,
+        TemplateRole role,
+        uint8_t *templ,
+        size_t capacity,
+        size_t &length)
+    {
+        std::vector<uint8_t> _templ;
+        ReturnStatus _status = createTemplate(img, role, _templ);
+        length = 0;
+        if(_templ.size() > capacity)
+            return ReturnStatus(ReturnCode::VendorError, "Template exceeds maxTemplateSize()");
+        std::copy(_templ.begin(), _templ.end(), templ);
+        length = _templ.size();
+        return _status;
+    }
+
+    /**
+     * @brief Same as the vector based finalizeEnrollment(), but the templates are passed
+     * by reference to the memory arena of IRPITest.
+     *
+     * @details The same rules apply: implementations must copy what is needed
+     * for search, the data behind the views will be released after the call.
+     * Default implementation copies templates into vectors and calls the
+     * vector based finalizeEnrollment().
+     *
+     * @param[in] vtempl
+     * Vector of enrollment templates along with the labels identifiers
+     */
+    virtual ReturnStatus
+    finalizeEnrollment(
+        const std::vector<std::pair<size_t,TemplateView>> &vtempl)
+    {
+        std::vector<std::pair<size_t,std::vector<uint8_t>>> _vtempl;
+        _vtempl.reserve(vtempl.size());
+        for(size_t i = 0; i < vtempl.size(); ++i)
+            _vtempl.push_back(std::make_pair(vtempl[i].first,
+                                             std::vector<uint8_t>(vtempl[i].second.data(),
+                                                                  vtempl[i].second.data() + vtempl[i].second.size())));
+        return finalizeEnrollment(_vtempl);
+    }
+
+    /** @brief Searches a batch of identification templates at once.
+     * @details Lets the implementation score several templates in one pass
+     * over the enrollment data, e.g. as a matrix-matrix product.  Results of
+     * idTemplates[i] go to candidateLists[i] and decisions[i] exactly as
+     * identifyTemplate() would give them; the lists are allocated by the
+     * caller with the capacity equal to candidateListLength.  A failed search
+     * leaves its list empty and its decision false.  Default implementation
+     * calls the allocation free identifyTemplate() for each template in turn.
+     * @param[in] idTemplates
+     * Array of count templates from createTemplate().
+     * @param[in] count
+     * Number of templates in the batch.
+     * @param[out] candidateLists
+     * Array of count caller allocated lists.
+     * @param[out] decisions
+     * Array of count decisions.
+     * @return Success if all searches succeed, otherwise the status of the last failed one.
+     */
+    virtual ReturnStatus
+    identifyTemplates(
+        const TemplateView *idTemplates,
+        size_t count,
+        CandidateList *candidateLists,
+        bool *decisions)
+    {
+        ReturnStatus _result(ReturnCode::Success);
+        for(size_t i = 0; i < count; ++i) {
+            candidateLists[i].clear();
+            decisions[i] = false;
+            ReturnStatus _status = identifyTemplate(idTemplates[i], candidateLists[i], decisions[i]);
+            if(_status.code != ReturnCode::Success) {
+                candidateLists[i].clear();
+                decisions[i] = false;
+                _result = _status;
+            }
+        }
+        return _result;
+    }
+
+    /** @brief Sets implementation specific parameter by name.
+     * @details IRPITest passes the parameters given with its -v option
+     * before initializeEnrollmentSession(); some of them may also be changed
+     * between the searches.  Besides those IRPITest itself may set the
+     * parameters below.  They are optional hints: implementation returns
+     * ConfigError for the ones it does not support, then IRPITest skips the
+     * comparison that needs them.  Only gallery_file, which is set when the
+     * -O option asks for it, excludes a vendor that refuses it.  Names an
+     * implementation adds on its own are documented by that implementation.
+     * <br>shortlist - size of the shortlist of a two-stage search, where a
+     * fast approximate scan picks the entries that are then scored exactly;
+     * 0 means exhaustive search.
+     * <br>gallery_file - path of the file where finalizeEnrollment() may put
+     * the gallery, searches then read it from storage instead of memory.
+     * <br>gallery_io - how the gallery file is read: "mmap" or "direct"
+     * (unbuffered reads that bypass the page cache).
+     * <br>Default implementation knows no parameters.
+     * @param[in] name
+     * Name of the parameter.
+     * @param[in] value
+     * Value of the parameter as text.
+     * @return ConfigError if the parameter or its value is not supported.
+     */
+    virtual ReturnStatus
+    setParameter(
+        const std::string &name,
+        const std::string &value)
+    {
+        (void)value;
+        return ReturnStatus(ReturnCode::ConfigError, "Unknown parameter " + name);
+    }
+
+    /**
+     * @brief Adds templates to the finalized enrollment dataset.
+     *
+     * @details May be called any time after finalizeEnrollment(), also
+     * between the searches; templates shall be found by the searches that
+     * start after the call returns.  Calls are never made concurrently with
+     * other calls of the interface, but the implementation may reorganize its
+     * data in the background.  The same rules as for finalizeEnrollment()
+     * apply to the input data.  A label may get more templates this way.
+     * Default implementation does not support updates.
+     *
+     * @param[in] vtempl
+     * Vector of enrollment templates along with the labels identifiers
+     * @return VendorError if updates are not supported.
+     */
+    virtual ReturnStatus
+    insertTemplates(
+        const std::vector<std::pair<size_t,TemplateView>> &vtempl)
+    {
+        (void)vtempl;
+        return ReturnStatus(ReturnCode::VendorError, "Enrollment dataset can not be updated");
+    }
+
+    /**
+     * @brief Removes all templates of the labels from the finalized enrollment dataset.
+     *
+     * @details Same call rules as for insertTemplates(); searches that start
+     * after the call returns shall not return removed labels, unless their
+     * templates have been inserted again.  Unknown labels are ignored.
+     * Default implementation does not support updates.
+     *
+     * @param[in] labels
+     * Labels identifiers to remove
+     * @return VendorError if updates are not supported.
+     */
+    virtual ReturnStatus
+    removeLabels(
+        const std::vector<size_t> &labels)
+    {
+        (void)labels;
+        return ReturnStatus(ReturnCode::VendorError, "Enrollment dataset can not be updated");
+    }
+
+    /** @brief Deadline bounded form of the allocation free identifyTemplate().
+     *
+     * @details The caller gives the point in time by which it wants the
+     * answer.  Implementations with approximate indexes or early-exit scans
+     * may stop when the deadline comes and return the best candidates found
+     * so far; such a result shall be flagged as partial.  A search that
+     * starts after the deadline may return no candidates at all.  Default
+     * implementation ignores the deadline and runs the full search, so its
+     * results are never partial.
+     *
+     * @param[in] idTemplate
+     * A template from createTemplate().
+     * @param[in] deadline
+     * Point in time of std::chrono::steady_clock the search should end by.
+     * @param[out] candidateList
+     * Caller allocated list; the candidates shall appear in descending
+     * order of similarity score.
+     * @param[out] decision
+     * A best guess at whether there is a mate within the enrollment database.
+     * @param[out] partial
+     * Set to true if the search was cut short by the deadline.
+     */
+    virtual ReturnStatus
+    identifyTemplate(
+        const TemplateView &idTemplate,
+        std::chrono::steady_clock::time_point deadline,
+        CandidateList &candidateList,
+        bool &decision,
+        bool &partial)
+    {
+        (void)deadline;
+        partial = false;
+        return identifyTemplate(idTemplate, candidateList, decision);
+    }
+
     /**
      * @brief
      * Factory method to return a managed pointer to the IdentInterface
@@ -348,5 +726,42 @@ public:
 /* End of IdentInterface */
 }
 
+/**
+ * @brief
+ * Version of the IdentInterface declared in this header, it is incremented
+ * every time optional members are appended to the interface.
+ */
+#define IRPI_INTERFACE_VERSION 1
+
+/**
+ * @brief
+ * Entry point for the applications that load the library at run time.
+ *
+ * @details
+ * Unlike IdentInterface::getImplementation() its name does not depend on
+ * the name mangling of the compiler.  The library defines it by placing
+ * IRPI_EXPORT_IMPLEMENTATION in one of its source files.  Libraries built
+ * against a header without this function implement the pure virtual
+ * members of IdentInterface only.
+ *
+ * @param[out] implementation
+ * Managed pointer returned by IdentInterface::getImplementation().
+ *
+ * @return
+ * IRPI_INTERFACE_VERSION the library was built with.
+ */
+extern "C" DLLSPEC int
+irpiGetImplementation(
+    std::shared_ptr<IRPI::IdentInterface> *implementation);
+
+#define IRPI_EXPORT_IMPLEMENTATION \
+    extern "C" DLLSPEC int \
+    irpiGetImplementation( \
+        std::shared_ptr<IRPI::IdentInterface> *implementation) \
+    { \
+        *implementation = IRPI::IdentInterface::getImplementation(); \
+        return IRPI_INTERFACE_VERSION; \
+    }
+
 #endif /* IRPI_H_ */
 
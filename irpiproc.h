@@ -0,0 +1,612 @@
+/*
+ * Image Recognition Performance Identification
+ *
+ * This file contains header-only preprocessing routines for IRPI::Image
+ * that are shared by IRPITest and the image recognition software vendors:
+ * RGB to gray conversion, crop, bilinear and area resize, conversion of
+ * uint8 pixels to normalized float CHW tensor.
+ *
+ * Kernels are selected at compile time: AVX2, SSE4.1/SSSE3/SSE2 or NEON when
+ * the compiler targets them, plain C++ otherwise.  MSVC does not define the
+ * SSE macros, so /arch:AVX and /arch:AVX2 are recognized by __AVX__ and
+ * __AVX2__.  Scalar versions are always available in IRPI::proc::scalar and
+ * give bit exact results, so SIMD kernels can be verified against them.
+ *
+ * Resizing goes row by row: bilinear resize interpolates source rows
+ * horizontally (a gather, so it stays scalar) and blends two of them
+ * with the SIMD kernel, area resize sums source rows with the SIMD kernel.
+ *
+ * This software is not subject to copyright protection
+ */
+
+#ifndef IRPIPROC_H_
+#define IRPIPROC_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "irpi.h"
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+    #define IRPI_PROC_AVX2
+#endif
+#if defined(__SSE4_1__) || defined(__AVX__)
+    #include <smmintrin.h>
+    #define IRPI_PROC_SSE41
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+    #include <tmmintrin.h>
+    #define IRPI_PROC_SSSE3
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define IRPI_PROC_SSE2
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define IRPI_PROC_NEON
+#endif
+
+namespace IRPI {
+namespace proc {
+
+/** @brief Returns name of the instruction set the kernels have been compiled for */
+inline const char*
+simdName()
+{
+#if defined(IRPI_PROC_AVX2)
+    return "AVX2";
+#elif defined(IRPI_PROC_SSE41)
+    return "SSE4.1";
+#elif defined(IRPI_PROC_SSSE3)
+    return "SSSE3";
+#elif defined(IRPI_PROC_SSE2)
+    return "SSE2";
+#elif defined(IRPI_PROC_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+/** =================================================================
+ * Scalar reference kernels, they work on a single row of pixels
+ */
+namespace scalar {
+
+/** @brief Gray = (77R + 150G + 29B + 128) >> 8 */
+inline void
+rgbToGrayRow(
+    const uint8_t *rgb,
+    uint8_t *gray,
+    size_t pixels)
+{
+    for(size_t i = 0; i < pixels; ++i)
+        gray[i] = static_cast<uint8_t>((77 * rgb[3*i] + 150 * rgb[3*i+1] + 29 * rgb[3*i+2] + 128) >> 8);
+}
+
+/** @brief Splits RGBRGB... row into three planes */
+inline void
+deinterleaveRow(
+    const uint8_t *rgb,
+    uint8_t *r,
+    uint8_t *g,
+    uint8_t *b,
+    size_t pixels)
+{
+    for(size_t i = 0; i < pixels; ++i) {
+        r[i] = rgb[3*i];
+        g[i] = rgb[3*i+1];
+        b[i] = rgb[3*i+2];
+    }
+}
+
+/** @brief dst = (src - mean) * scale */
+inline void
+normalizeRow(
+    const uint8_t *src,
+    float *dst,
+    size_t n,
+    float mean,
+    float scale)
+{
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = (static_cast<float>(src[i]) - mean) * scale;
+}
+
+/** @brief sum += src */
+inline void
+accumulateRow(
+    const uint8_t *src,
+    uint32_t *sum,
+    size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+        sum[i] += src[i];
+}
+
+/** @brief dst = (top * (2048 - fy) + bottom * fy + 2^21) >> 22, rows are interpolated with 11-bit weights already */
+inline void
+blendRows(
+    const int32_t *top,
+    const int32_t *bottom,
+    int32_t fy,
+    uint8_t *dst,
+    size_t n)
+{
+    for(size_t i = 0; i < n; ++i)
+        dst[i] = static_cast<uint8_t>((top[i] * (2048 - fy) + bottom[i] * fy + (1 << 21)) >> 22);
+}
+
+} // namespace scalar
+
+/** =================================================================
+ * SIMD kernels, tails are processed by the scalar ones
+ */
+inline void
+rgbToGrayRow(
+    const uint8_t *rgb,
+    uint8_t *gray,
+    size_t pixels)
+{
+    size_t i = 0;
+#if defined(IRPI_PROC_SSSE3)
+    const __m128i _r0 = _mm_setr_epi8(0,3,6,9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m128i _r1 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,2,5,8,11,14,-1,-1,-1,-1,-1);
+    const __m128i _r2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,4,7,10,13);
+    const __m128i _g0 = _mm_setr_epi8(1,4,7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m128i _g1 = _mm_setr_epi8(-1,-1,-1,-1,-1,0,3,6,9,12,15,-1,-1,-1,-1,-1);
+    const __m128i _g2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,2,5,8,11,14);
+    const __m128i _b0 = _mm_setr_epi8(2,5,8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m128i _b1 = _mm_setr_epi8(-1,-1,-1,-1,-1,1,4,7,10,13,-1,-1,-1,-1,-1,-1);
+    const __m128i _b2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,0,3,6,9,12,15);
+#if defined(IRPI_PROC_AVX2)
+    const __m256i _wr256 = _mm256_set1_epi16(77), _wg256 = _mm256_set1_epi16(150), _wb256 = _mm256_set1_epi16(29);
+    const __m256i _round256 = _mm256_set1_epi16(128);
+#else
+    const __m128i _wr = _mm_set1_epi16(77), _wg = _mm_set1_epi16(150), _wb = _mm_set1_epi16(29);
+    const __m128i _round = _mm_set1_epi16(128), _zero = _mm_setzero_si128();
+#endif
+    for(; i + 16 <= pixels; i += 16) {
+        const __m128i _a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 3*i));
+        const __m128i _b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 3*i + 16));
+        const __m128i _c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 3*i + 32));
+        const __m128i _r = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(_a,_r0),_mm_shuffle_epi8(_b,_r1)),_mm_shuffle_epi8(_c,_r2));
+        const __m128i _g = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(_a,_g0),_mm_shuffle_epi8(_b,_g1)),_mm_shuffle_epi8(_c,_g2));
+        const __m128i _bl = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(_a,_b0),_mm_shuffle_epi8(_b,_b1)),_mm_shuffle_epi8(_c,_b2));
+#if defined(IRPI_PROC_AVX2)
+        // 16 pixels are weighted in one 256-bit register
+        __m256i _sum = _mm256_add_epi16(_mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_r),_wr256),
+                                                         _mm256_mullo_epi16(_mm256_cvtepu8_epi16(_g),_wg256)),
+                                        _mm256_add_epi16(_mm256_mullo_epi16(_mm256_cvtepu8_epi16(_bl),_wb256),_round256));
+        _sum = _mm256_srli_epi16(_sum,8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i),_mm_packus_epi16(_mm256_castsi256_si128(_sum),_mm256_extracti128_si256(_sum,1)));
+#else
+        __m128i _lo = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_r,_zero),_wr),
+                                                  _mm_mullo_epi16(_mm_unpacklo_epi8(_g,_zero),_wg)),
+                                    _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(_bl,_zero),_wb),_round));
+        __m128i _hi = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(_r,_zero),_wr),
+                                                  _mm_mullo_epi16(_mm_unpackhi_epi8(_g,_zero),_wg)),
+                                    _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(_bl,_zero),_wb),_round));
+        _lo = _mm_srli_epi16(_lo,8);
+        _hi = _mm_srli_epi16(_hi,8);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(gray + i),_mm_packus_epi16(_lo,_hi));
+#endif
+    }
+#elif defined(IRPI_PROC_NEON)
+    const uint8x8_t _wr = vdup_n_u8(77), _wg = vdup_n_u8(150), _wb = vdup_n_u8(29);
+    for(; i + 16 <= pixels; i += 16) {
+        const uint8x16x3_t _px = vld3q_u8(rgb + 3*i);
+        uint16x8_t _lo = vmull_u8(vget_low_u8(_px.val[0]),_wr);
+        _lo = vmlal_u8(_lo,vget_low_u8(_px.val[1]),_wg);
+        _lo = vmlal_u8(_lo,vget_low_u8(_px.val[2]),_wb);
+        uint16x8_t _hi = vmull_u8(vget_high_u8(_px.val[0]),_wr);
+        _hi = vmlal_u8(_hi,vget_high_u8(_px.val[1]),_wg);
+        _hi = vmlal_u8(_hi,vget_high_u8(_px.val[2]),_wb);
+        vst1q_u8(gray + i,vcombine_u8(vrshrn_n_u16(_lo,8),vrshrn_n_u16(_hi,8)));
+    }
+#endif
+    scalar::rgbToGrayRow(rgb + 3*i, gray + i, pixels - i);
+}
+
+inline void
+deinterleaveRow(
+    const uint8_t *rgb,
+    uint8_t *r,
+    uint8_t *g,
+    uint8_t *b,
+    size_t pixels)
+{
+    size_t i = 0;
+#if defined(IRPI_PROC_SSSE3)
+    const __m128i _r0 = _mm_setr_epi8(0,3,6,9,12,15,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m128i _r1 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,2,5,8,11,14,-1,-1,-1,-1,-1);
+    const __m128i _r2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,1,4,7,10,13);
+    const __m128i _g0 = _mm_setr_epi8(1,4,7,10,13,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m128i _g1 = _mm_setr_epi8(-1,-1,-1,-1,-1,0,3,6,9,12,15,-1,-1,-1,-1,-1);
+    const __m128i _g2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,2,5,8,11,14);
+    const __m128i _b0 = _mm_setr_epi8(2,5,8,11,14,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+    const __m128i _b1 = _mm_setr_epi8(-1,-1,-1,-1,-1,1,4,7,10,13,-1,-1,-1,-1,-1,-1);
+    const __m128i _b2 = _mm_setr_epi8(-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,0,3,6,9,12,15);
+    for(; i + 16 <= pixels; i += 16) {
+        const __m128i _a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 3*i));
+        const __m128i _b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 3*i + 16));
+        const __m128i _c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 3*i + 32));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(r + i),
+                         _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(_a,_r0),_mm_shuffle_epi8(_b,_r1)),_mm_shuffle_epi8(_c,_r2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(g + i),
+                         _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(_a,_g0),_mm_shuffle_epi8(_b,_g1)),_mm_shuffle_epi8(_c,_g2)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(b + i),
+                         _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(_a,_b0),_mm_shuffle_epi8(_b,_b1)),_mm_shuffle_epi8(_c,_b2)));
+    }
+#elif defined(IRPI_PROC_NEON)
+    for(; i + 16 <= pixels; i += 16) {
+        const uint8x16x3_t _px = vld3q_u8(rgb + 3*i);
+        vst1q_u8(r + i,_px.val[0]);
+        vst1q_u8(g + i,_px.val[1]);
+        vst1q_u8(b + i,_px.val[2]);
+    }
+#endif
+    scalar::deinterleaveRow(rgb + 3*i, r + i, g + i, b + i, pixels - i);
+}
+
+inline void
+normalizeRow(
+    const uint8_t *src,
+    float *dst,
+    size_t n,
+    float mean,
+    float scale)
+{
+    size_t i = 0;
+#if defined(IRPI_PROC_AVX2)
+    const __m256 _mean = _mm256_set1_ps(mean), _scale = _mm256_set1_ps(scale);
+    for(; i + 8 <= n; i += 8) {
+        const __m256i _px = _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)));
+        _mm256_storeu_ps(dst + i,_mm256_mul_ps(_mm256_sub_ps(_mm256_cvtepi32_ps(_px),_mean),_scale));
+    }
+#elif defined(IRPI_PROC_SSE2)
+    const __m128 _mean = _mm_set1_ps(mean), _scale = _mm_set1_ps(scale);
+    const __m128i _zero = _mm_setzero_si128();
+    for(; i + 8 <= n; i += 8) {
+        const __m128i _px = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src + i)),_zero);
+        const __m128 _lo = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_px,_zero));
+        const __m128 _hi = _mm_cvtepi32_ps(_mm_unpackhi_epi16(_px,_zero));
+        _mm_storeu_ps(dst + i,_mm_mul_ps(_mm_sub_ps(_lo,_mean),_scale));
+        _mm_storeu_ps(dst + i + 4,_mm_mul_ps(_mm_sub_ps(_hi,_mean),_scale));
+    }
+#elif defined(IRPI_PROC_NEON)
+    const float32x4_t _mean = vdupq_n_f32(mean), _scale = vdupq_n_f32(scale);
+    for(; i + 8 <= n; i += 8) {
+        const uint16x8_t _px = vmovl_u8(vld1_u8(src + i));
+        const float32x4_t _lo = vcvtq_f32_u32(vmovl_u16(vget_low_u16(_px)));
+        const float32x4_t _hi = vcvtq_f32_u32(vmovl_u16(vget_high_u16(_px)));
+        vst1q_f32(dst + i,vmulq_f32(vsubq_f32(_lo,_mean),_scale));
+        vst1q_f32(dst + i + 4,vmulq_f32(vsubq_f32(_hi,_mean),_scale));
+    }
+#endif
+    scalar::normalizeRow(src + i, dst + i, n - i, mean, scale);
+}
+
+inline void
+accumulateRow(
+    const uint8_t *src,
+    uint32_t *sum,
+    size_t n)
+{
+    size_t i = 0;
+#if defined(IRPI_PROC_AVX2)
+    for(; i + 16 <= n; i += 16) {
+        const __m128i _px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m256i *_sum = reinterpret_cast<__m256i*>(sum + i);
+        _mm256_storeu_si256(_sum,_mm256_add_epi32(_mm256_loadu_si256(_sum),_mm256_cvtepu8_epi32(_px)));
+        _mm256_storeu_si256(_sum + 1,_mm256_add_epi32(_mm256_loadu_si256(_sum + 1),_mm256_cvtepu8_epi32(_mm_srli_si128(_px,8))));
+    }
+#elif defined(IRPI_PROC_SSE2)
+    const __m128i _zero = _mm_setzero_si128();
+    for(; i + 16 <= n; i += 16) {
+        const __m128i _px = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        const __m128i _lo = _mm_unpacklo_epi8(_px,_zero), _hi = _mm_unpackhi_epi8(_px,_zero);
+        const __m128i _px32[4] = {_mm_unpacklo_epi16(_lo,_zero), _mm_unpackhi_epi16(_lo,_zero),
+                                  _mm_unpacklo_epi16(_hi,_zero), _mm_unpackhi_epi16(_hi,_zero)};
+        __m128i *_sum = reinterpret_cast<__m128i*>(sum + i);
+        for(int k = 0; k < 4; ++k)
+            _mm_storeu_si128(_sum + k,_mm_add_epi32(_mm_loadu_si128(_sum + k),_px32[k]));
+    }
+#elif defined(IRPI_PROC_NEON)
+    for(; i + 16 <= n; i += 16) {
+        const uint8x16_t _px = vld1q_u8(src + i);
+        const uint16x8_t _lo = vmovl_u8(vget_low_u8(_px)), _hi = vmovl_u8(vget_high_u8(_px));
+        vst1q_u32(sum + i,vaddw_u16(vld1q_u32(sum + i),vget_low_u16(_lo)));
+        vst1q_u32(sum + i + 4,vaddw_u16(vld1q_u32(sum + i + 4),vget_high_u16(_lo)));
+        vst1q_u32(sum + i + 8,vaddw_u16(vld1q_u32(sum + i + 8),vget_low_u16(_hi)));
+        vst1q_u32(sum + i + 12,vaddw_u16(vld1q_u32(sum + i + 12),vget_high_u16(_hi)));
+    }
+#endif
+    scalar::accumulateRow(src + i, sum + i, n - i);
+}
+
+/* Products fit into int32: 255 * 2048 * 2048 + 2^21 < 2^31 */
+inline void
+blendRows(
+    const int32_t *top,
+    const int32_t *bottom,
+    int32_t fy,
+    uint8_t *dst,
+    size_t n)
+{
+    size_t i = 0;
+#if defined(IRPI_PROC_AVX2)
+    const __m256i _w0 = _mm256_set1_epi32(2048 - fy), _w1 = _mm256_set1_epi32(fy), _round = _mm256_set1_epi32(1 << 21);
+    for(; i + 8 <= n; i += 8) {
+        const __m256i _t = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(top + i));
+        const __m256i _b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(bottom + i));
+        const __m256i _v = _mm256_srli_epi32(_mm256_add_epi32(_mm256_add_epi32(_mm256_mullo_epi32(_t,_w0),_mm256_mullo_epi32(_b,_w1)),_round),22);
+        const __m128i _v16 = _mm_packus_epi32(_mm256_castsi256_si128(_v),_mm256_extracti128_si256(_v,1));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i),_mm_packus_epi16(_v16,_v16));
+    }
+#elif defined(IRPI_PROC_SSE41)
+    const __m128i _w0 = _mm_set1_epi32(2048 - fy), _w1 = _mm_set1_epi32(fy), _round = _mm_set1_epi32(1 << 21);
+    for(; i + 8 <= n; i += 8) {
+        __m128i _v[2];
+        for(int k = 0; k < 2; ++k) {
+            const __m128i _t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(top + i + 4*k));
+            const __m128i _b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bottom + i + 4*k));
+            _v[k] = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(_mm_mullo_epi32(_t,_w0),_mm_mullo_epi32(_b,_w1)),_round),22);
+        }
+        const __m128i _v16 = _mm_packus_epi32(_v[0],_v[1]);
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(dst + i),_mm_packus_epi16(_v16,_v16));
+    }
+#elif defined(IRPI_PROC_NEON)
+    const int32x4_t _w0 = vdupq_n_s32(2048 - fy), _w1 = vdupq_n_s32(fy), _round = vdupq_n_s32(1 << 21);
+    for(; i + 8 <= n; i += 8) {
+        const int32x4_t _lo = vmlaq_s32(vmlaq_s32(_round,vld1q_s32(top + i),_w0),vld1q_s32(bottom + i),_w1);
+        const int32x4_t _hi = vmlaq_s32(vmlaq_s32(_round,vld1q_s32(top + i + 4),_w0),vld1q_s32(bottom + i + 4),_w1);
+        const uint16x8_t _v16 = vcombine_u16(vqmovun_s32(vshrq_n_s32(_lo,22)),vqmovun_s32(vshrq_n_s32(_hi,22)));
+        vst1_u8(dst + i,vqmovn_u16(_v16));
+    }
+#endif
+    scalar::blendRows(top + i, bottom + i, fy, dst + i, n - i);
+}
+
+/** =================================================================
+ * Image level routines, specialized at compile time for depth 8 (Channels == 1)
+ * and depth 24 (Channels == 3).  Output images get freshly allocated buffers,
+ * routines with uint8_t *dst write into caller supplied memory instead.
+ */
+namespace detail {
+
+inline std::shared_ptr<uint8_t>
+allocate(
+    size_t bytes)
+{
+    return std::shared_ptr<uint8_t>(new uint8_t[bytes], std::default_delete<uint8_t[]>());
+}
+
+template <int Channels>
+void
+crop(
+    const uint8_t *src,
+    size_t srcwidth,
+    size_t x,
+    size_t y,
+    size_t width,
+    size_t height,
+    uint8_t *dst)
+{
+    for(size_t row = 0; row < height; ++row)
+        std::memcpy(dst + row * width * Channels, src + ((y + row) * srcwidth + x) * Channels, width * Channels);
+}
+
+/* Fixed point bilinear interpolation with 11-bit weights and pixel centers aligned (like OpenCV's INTER_LINEAR).
+ * Source rows are interpolated horizontally into a pair of buffers by row parity, so the row that is shared
+ * by neighbouring destination rows is interpolated once, then two rows are blended into the destination one */
+template <int Channels>
+void
+resizeBilinear(
+    const uint8_t *src,
+    size_t srcwidth,
+    size_t srcheight,
+    uint8_t *dst,
+    size_t width,
+    size_t height)
+{
+    const int32_t _one = 1 << 11;
+    const size_t _n = width * Channels;
+    std::vector<size_t> _x0(_n), _x1(_n);
+    std::vector<int32_t> _fx(_n);
+    const double _sx = static_cast<double>(srcwidth) / width, _sy = static_cast<double>(srcheight) / height;
+    for(size_t x = 0; x < width; ++x) {
+        double _pos = std::max(0.0, (x + 0.5) * _sx - 0.5);
+        const size_t _left = std::min(static_cast<size_t>(_pos), srcwidth - 1);
+        const size_t _right = std::min(_left + 1, srcwidth - 1);
+        const int32_t _weight = (_left == srcwidth - 1) ? 0 : static_cast<int32_t>((_pos - _left) * _one + 0.5);
+        for(int c = 0; c < Channels; ++c) {
+            _x0[x*Channels + c] = _left*Channels + c;
+            _x1[x*Channels + c] = _right*Channels + c;
+            _fx[x*Channels + c] = _weight;
+        }
+    }
+    std::vector<int32_t> _rows(2 * _n);
+    size_t _rowy[2] = {srcheight, srcheight}; // source row held by each buffer, srcheight means none
+    for(size_t y = 0; y < height; ++y) {
+        double _pos = std::max(0.0, (y + 0.5) * _sy - 0.5);
+        const size_t _y0 = std::min(static_cast<size_t>(_pos), srcheight - 1);
+        const size_t _y1 = std::min(_y0 + 1, srcheight - 1);
+        const int32_t _fy = (_y0 == srcheight - 1) ? 0 : static_cast<int32_t>((_pos - _y0) * _one + 0.5);
+        const size_t _srcrows[2] = {_y0, _y1};
+        for(int k = 0; k < 2; ++k) {
+            const size_t _b = _srcrows[k] & 1;
+            if(_rowy[_b] == _srcrows[k])
+                continue;
+            const uint8_t *_row = src + _srcrows[k] * srcwidth * Channels;
+            int32_t *_h = &_rows[_b * _n];
+            for(size_t i = 0; i < _n; ++i)
+                _h[i] = _row[_x0[i]] * (_one - _fx[i]) + _row[_x1[i]] * _fx[i];
+            _rowy[_b] = _srcrows[k];
+        }
+        blendRows(&_rows[(_y0 & 1) * _n], &_rows[(_y1 & 1) * _n], _fy, dst + y * _n, _n);
+    }
+}
+
+/* Box filter over the source pixels covered by the destination pixel, boundaries are snapped to the integer grid.
+ * It is the right choice for downscaling, for upscaling it degrades to the nearest neighbour */
+template <int Channels>
+void
+resizeArea(
+    const uint8_t *src,
+    size_t srcwidth,
+    size_t srcheight,
+    uint8_t *dst,
+    size_t width,
+    size_t height)
+{
+    std::vector<size_t> _xbegin(width), _xend(width);
+    for(size_t x = 0; x < width; ++x) {
+        _xbegin[x] = x * srcwidth / width;
+        _xend[x] = std::max(_xbegin[x] + 1, (x + 1) * srcwidth / width);
+    }
+    // Source rows are summed into per column sums first, so each source pixel is read once per destination row
+    std::vector<uint32_t> _colsum(srcwidth * Channels);
+    for(size_t y = 0; y < height; ++y) {
+        const size_t _ybegin = y * srcheight / height;
+        const size_t _yend = std::max(_ybegin + 1, (y + 1) * srcheight / height);
+        std::fill(_colsum.begin(), _colsum.end(), 0);
+        for(size_t sy = _ybegin; sy < _yend; ++sy)
+            accumulateRow(src + sy * srcwidth * Channels, _colsum.data(), _colsum.size());
+        uint8_t *_out = dst + y * width * Channels;
+        for(size_t x = 0; x < width; ++x) {
+            const uint32_t _count = static_cast<uint32_t>((_xend[x] - _xbegin[x]) * (_yend - _ybegin));
+            for(int c = 0; c < Channels; ++c) {
+                uint32_t _sum = 0;
+                for(size_t sx = _xbegin[x]; sx < _xend[x]; ++sx)
+                    _sum += _colsum[sx*Channels + c];
+                _out[x*Channels + c] = static_cast<uint8_t>((_sum + _count / 2) / _count);
+            }
+        }
+    }
+}
+
+template <int Channels>
+void
+toTensorCHW(
+    const uint8_t *src,
+    size_t width,
+    size_t height,
+    float *dst,
+    const float *mean,
+    const float *scale)
+{
+    const size_t _plane = width * height;
+    if(Channels == 1) {
+        for(size_t y = 0; y < height; ++y)
+            normalizeRow(src + y * width, dst + y * width, width, mean[0], scale[0]);
+    } else {
+        std::vector<uint8_t> _planes(3 * width);
+        for(size_t y = 0; y < height; ++y) {
+            deinterleaveRow(src + y * width * 3, &_planes[0], &_planes[width], &_planes[2 * width], width);
+            for(int c = 0; c < 3; ++c)
+                normalizeRow(&_planes[c * width], dst + c * _plane + y * width, width, mean[c], scale[c]);
+        }
+    }
+}
+
+} // namespace detail
+
+/** @brief Converts 24-bit image to 8-bit gray, 8-bit images are returned as is */
+inline Image
+toGray(
+    const Image &img)
+{
+    if(img.depth == 8 || !img.data)
+        return img;
+    Image _gray(img.width, img.height, 8, detail::allocate(static_cast<size_t>(img.width) * img.height));
+    rgbToGrayRow(img.data.get(), _gray.data.get(), static_cast<size_t>(img.width) * img.height);
+    return _gray;
+}
+
+/** @brief Crops the rectangle, returns empty Image if the rectangle does not fit */
+inline Image
+crop(
+    const Image &img,
+    uint16_t x,
+    uint16_t y,
+    uint16_t width,
+    uint16_t height)
+{
+    if(!img.data || width == 0 || height == 0 || x + width > img.width || y + height > img.height)
+        return Image();
+    Image _out(width, height, img.depth, detail::allocate(static_cast<size_t>(width) * height * (img.depth / 8)));
+    if(img.depth == 8)
+        detail::crop<1>(img.data.get(), img.width, x, y, width, height, _out.data.get());
+    else
+        detail::crop<3>(img.data.get(), img.width, x, y, width, height, _out.data.get());
+    return _out;
+}
+
+/** @brief Bilinear resize, good for moderate scale changes and upscaling */
+inline Image
+resizeBilinear(
+    const Image &img,
+    uint16_t width,
+    uint16_t height)
+{
+    if(!img.data || width == 0 || height == 0 || img.width == 0 || img.height == 0)
+        return Image();
+    Image _out(width, height, img.depth, detail::allocate(static_cast<size_t>(width) * height * (img.depth / 8)));
+    if(img.depth == 8)
+        detail::resizeBilinear<1>(img.data.get(), img.width, img.height, _out.data.get(), width, height);
+    else
+        detail::resizeBilinear<3>(img.data.get(), img.width, img.height, _out.data.get(), width, height);
+    return _out;
+}
+
+/** @brief Area (box filter) resize, good for downscaling */
+inline Image
+resizeArea(
+    const Image &img,
+    uint16_t width,
+    uint16_t height)
+{
+    if(!img.data || width == 0 || height == 0 || img.width == 0 || img.height == 0)
+        return Image();
+    Image _out(width, height, img.depth, detail::allocate(static_cast<size_t>(width) * height * (img.depth / 8)));
+    if(img.depth == 8)
+        detail::resizeArea<1>(img.data.get(), img.width, img.height, _out.data.get(), width, height);
+    else
+        detail::resizeArea<3>(img.data.get(), img.width, img.height, _out.data.get(), width, height);
+    return _out;
+}
+
+/** @brief Converts image to planar float tensor: dst[c][y][x] = (pixel - mean[c]) * scale[c]
+ *
+ * @param[out] dst
+ * Caller supplied memory of (depth / 8) * width * height floats
+ * @param[in] mean
+ * Per channel mean, one value for 8-bit images and three for 24-bit images
+ * @param[in] scale
+ * Per channel scale (i.e. 1/std), same layout as mean
+ */
+inline void
+toTensorCHW(
+    const Image &img,
+    float *dst,
+    const float *mean,
+    const float *scale)
+{
+    if(!img.data)
+        return;
+    if(img.depth == 8)
+        detail::toTensorCHW<1>(img.data.get(), img.width, img.height, dst, mean, scale);
+    else
+        detail::toTensorCHW<3>(img.data.get(), img.width, img.height, dst, mean, scale);
+}
+
+} // namespace proc
+} // namespace IRPI
+
+#endif /* IRPIPROC_H_ */
@@ -0,0 +1,137 @@
+/*
+ * Binary sketches of float feature vectors for the two-stage search of the reference implementation
+ *
+ * Sketch bit b is the sign of the projection of the vector onto the random
+ * hyperplane b (random-hyperplane LSH), so the Hamming distance between two
+ * sketches estimates the angle between the vectors.  A sketch of SketchBits
+ * bits takes SketchWords 64-bit words, the scan over the gallery is XOR and
+ * hardware popcount of a few words per entry.  Entries with the smallest
+ * distances make the shortlist that is then scored exactly.
+ *
+ * This software is not subject to copyright protection
+ */
+
+#ifndef BINARYSKETCH_H_
+#define BINARYSKETCH_H_
+
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+    #include <intrin.h>
+#endif
+
+#include "blockedscoring.h"
+
+namespace IRPI {
+namespace scoring {
+
+/** @brief Bits in one sketch */
+const size_t SketchBits = 256;
+/** @brief 64-bit words in one sketch */
+const size_t SketchWords = SketchBits / 64;
+
+/** @brief Number of set bits, popcnt instruction when the compiler targets it */
+inline unsigned
+popcount64(
+    uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    return static_cast<unsigned>(__popcnt64(x));
+#elif defined(__GNUC__)
+    return static_cast<unsigned>(__builtin_popcountll(x));
+#else
+    x = x - ((x >> 1) & 0x5555555555555555ULL);
+    x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+    x = (x + (x >> 4)) & 0x0F0F0F0F0F0F0F0FULL;
+    return static_cast<unsigned>((x * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/** =================================================================
+ * @brief Makes sketches of vectors of the given dimension, hyperplanes are the same for the same seed
+ */
+class SketchProjector {
+public:
+    void
+    init(
+        size_t dim,
+        unsigned int seed = 1)
+    {
+        std::vector<float> _planes(SketchBits * dim);
+        std::mt19937 _gen(seed);
+        std::normal_distribution<float> _dist;
+        for(size_t i = 0; i < _planes.size(); ++i)
+            _planes[i] = _dist(_gen);
+        planes.pack(_planes.data(), SketchBits, dim);
+    }
+
+    /** @brief Writes SketchWords words of vectors[i] sketch to sketches + i * SketchWords */
+    void
+    sketch(
+        const float *const *vectors,
+        size_t count,
+        uint64_t *sketches) const
+    {
+        float _tile[ProbeBlock * PanelWidth];
+        for(size_t m0 = 0; m0 < count; m0 += ProbeBlock) {
+            const size_t _rows = std::min(ProbeBlock, count - m0);
+            for(size_t m = 0; m < _rows; ++m)
+                std::fill(sketches + (m0 + m) * SketchWords, sketches + (m0 + m + 1) * SketchWords, 0);
+            for(size_t p = 0; p < planes.panels(); ++p) {
+                runMicroKernel(_rows, vectors + m0, planes.panel(p), planes.dimension(), _tile);
+                for(size_t m = 0; m < _rows; ++m)
+                    for(size_t j = 0; j < PanelWidth; ++j)
+                        if(_tile[m * PanelWidth + j] > 0.0f) {
+                            const size_t _bit = p * PanelWidth + j;
+                            sketches[(m0 + m) * SketchWords + _bit / 64] |= static_cast<uint64_t>(1) << (_bit % 64);
+                        }
+            }
+        }
+    }
+
+private:
+    PackedGallery planes;
+};
+
+/** =================================================================
+ * @brief Picks up to shortlist gallery entries nearest to the probe by Hamming distance
+ * @details Distances of all entries go to the caller supplied distances buffer of count
+ * values, their histogram gives the cutoff distance, so the selection is two linear passes.
+ * Entries at the cutoff distance are taken in gallery order.  Selected indices are written
+ * in ascending order.
+ * @return Number of selected entries, min(shortlist, count)
+ */
+inline size_t
+hammingShortlist(
+    const uint64_t *gallery,
+    size_t count,
+    const uint64_t *probe,
+    size_t shortlist,
+    uint16_t *distances,
+    uint32_t *selected)
+{
+    size_t _histogram[SketchBits + 1] = {};
+    for(size_t i = 0; i < count; ++i, gallery += SketchWords) {
+        unsigned _distance = 0;
+        for(size_t w = 0; w < SketchWords; ++w)
+            _distance += popcount64(gallery[w] ^ probe[w]);
+        distances[i] = static_cast<uint16_t>(_distance);
+        _histogram[_distance]++;
+    }
+    shortlist = std::min(shortlist, count);
+    size_t _cutoff = 0, _below = 0;
+    while(_cutoff < SketchBits && _below + _histogram[_cutoff] < shortlist)
+        _below += _histogram[_cutoff++];
+    size_t _atcutoff = shortlist - _below, _selected = 0;
+    for(size_t i = 0; i < count && _selected < shortlist; ++i)
+        if(distances[i] < _cutoff || (distances[i] == _cutoff && _atcutoff > 0 && _atcutoff--))
+            selected[_selected++] = static_cast<uint32_t>(i);
+    return _selected;
+}
+
+} // namespace scoring
+} // namespace IRPI
+
+#endif /* BINARYSKETCH_H_ */
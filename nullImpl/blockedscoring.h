@@ -0,0 +1,597 @@
+/*
+ * Cache-blocked scoring of float feature vectors for the reference implementation
+ *
+ * Scores are dot products of L2 normalized vectors.  One probe against the
+ * gallery is a matrix-vector product bounded by memory bandwidth; a batch of
+ * probes turns it into a matrix-matrix product, where each gallery block is
+ * read from memory once and reused from L2 by all probes of the batch.
+ *
+ * Gallery is packed into panels of PanelWidth rows stored k-major, so the
+ * micro-kernel loads PanelWidth gallery values with contiguous vector loads,
+ * broadcasts one value of each probe and keeps ProbeBlock x PanelWidth sums
+ * in registers.  Best scores of every probe go straight from the tile into
+ * its top-K heap, the full score matrix is never stored.
+ *
+ * Each score is accumulated in the same order whatever the number of probes
+ * in the batch, so batched and single probe searches give equal results.
+ *
+ * When a subject is enrolled with several rows, they are stored next to each
+ * other and their scores may be fused (max or mean) as the tile is read, so
+ * the heaps keep K subjects instead of K rows.
+ *
+ * This software is not subject to copyright protection
+ */
+
+#ifndef BLOCKEDSCORING_H_
+#define BLOCKEDSCORING_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// MSVC does not define __FMA__, its /arch:AVX2 allows FMA instructions anyway
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+    #include <immintrin.h>
+    #define IRPI_SCORING_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #define IRPI_SCORING_SSE2
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define IRPI_SCORING_NEON
+#endif
+
+namespace IRPI {
+namespace scoring {
+
+/** @brief Gallery rows in one packed panel */
+const size_t PanelWidth = 16;
+/** @brief Probes scored at once by the micro-kernel, SSE2 has too few registers for 4 x 16 sums */
+#if defined(IRPI_SCORING_SSE2)
+const size_t ProbeBlock = 2;
+#else
+const size_t ProbeBlock = 4;
+#endif
+/** @brief Size of the gallery block that is kept in L2 while all probes of the batch go over it */
+const size_t L2BlockBytes = 256 * 1024;
+
+/** @brief Returns name of the instruction set the micro-kernel has been compiled for */
+inline const char*
+simdName()
+{
+#if defined(IRPI_SCORING_AVX2)
+    return "AVX2+FMA";
+#elif defined(IRPI_SCORING_SSE2)
+    return "SSE2";
+#elif defined(IRPI_SCORING_NEON)
+    return "NEON";
+#else
+    return "scalar";
+#endif
+}
+
+/** =================================================================
+ * @brief Gallery matrix packed into panels: panel[k * PanelWidth + j] is element k of row j.
+ * The last panel is padded with zero rows, they are never reported.
+ */
+class PackedGallery {
+public:
+    PackedGallery() :
+        count{0},
+        dim{0}
+        {}
+
+    /** @brief Packs _count row-major vectors of _dim floats */
+    void
+    pack(
+        const float *rows,
+        size_t _count,
+        size_t _dim)
+    {
+        pack(rows, nullptr, _count, _dim);
+    }
+
+    /** @brief Packs rows[indices[i]] for i < _count, memory is reused if the size does not grow */
+    void
+    pack(
+        const float *rows,
+        const uint32_t *indices,
+        size_t _count,
+        size_t _dim)
+    {
+        count = _count;
+        dim = _dim;
+        data.resize(panels() * PanelWidth * dim);
+        for(size_t p = 0; p < panels(); ++p) {
+            float *_panel = &data[p * PanelWidth * dim];
+            for(size_t j = 0; j < PanelWidth; ++j) {
+                const size_t i = p * PanelWidth + j;
+                const float *_row = i < count ? rows + (indices ? indices[i] : i) * dim : nullptr;
+                for(size_t k = 0; k < dim; ++k)
+                    _panel[k * PanelWidth + j] = _row ? _row[k] : 0.0f;
+            }
+        }
+    }
+
+    /** @brief Packs rows indices[i] for i < _count taken from the other packed gallery given by its panels */
+    void
+    packFromPanels(
+        const float *panels,
+        const uint32_t *indices,
+        size_t _count,
+        size_t _dim)
+    {
+        count = _count;
+        dim = _dim;
+        data.resize(this->panels() * PanelWidth * dim);
+        for(size_t p = 0; p < this->panels(); ++p) {
+            float *_panel = &data[p * PanelWidth * dim];
+            for(size_t j = 0; j < PanelWidth; ++j) {
+                const size_t i = p * PanelWidth + j;
+                const float *_source = i < count ? panels + (indices[i] / PanelWidth) * PanelWidth * dim + indices[i] % PanelWidth : nullptr;
+                for(size_t k = 0; k < dim; ++k)
+                    _panel[k * PanelWidth + j] = _source ? _source[k * PanelWidth] : 0.0f;
+            }
+        }
+    }
+
+    /** @brief Adds the row of dimension() floats at the end, a new panel is started when the last one is full */
+    void
+    append(
+        const float *row)
+    {
+        if(count % PanelWidth == 0)
+            data.resize(data.size() + PanelWidth * dim, 0.0f);
+        float *_panel = &data[(count / PanelWidth) * PanelWidth * dim];
+        const size_t j = count % PanelWidth;
+        for(size_t k = 0; k < dim; ++k)
+            _panel[k * PanelWidth + j] = row[k];
+        ++count;
+    }
+
+    /** @brief Same as append(), the row is taken from the column of the other packed gallery */
+    void
+    appendColumn(
+        const float *column)
+    {
+        if(count % PanelWidth == 0)
+            data.resize(data.size() + PanelWidth * dim, 0.0f);
+        float *_panel = &data[(count / PanelWidth) * PanelWidth * dim];
+        const size_t j = count % PanelWidth;
+        for(size_t k = 0; k < dim; ++k)
+            _panel[k * PanelWidth + j] = column[k * PanelWidth];
+        ++count;
+    }
+
+    size_t
+    rows() const { return count; }
+
+    size_t
+    dimension() const { return dim; }
+
+    size_t
+    panels() const { return (count + PanelWidth - 1) / PanelWidth; }
+
+    const float*
+    panel(size_t p) const { return &data[p * PanelWidth * dim]; }
+
+    size_t
+    bytes() const { return data.size() * sizeof(float); }
+
+    /** @brief Empties the gallery and gives its memory back */
+    void
+    release()
+    {
+        count = dim = 0;
+        std::vector<float>().swap(data);
+    }
+
+private:
+    size_t count, dim;
+    std::vector<float> data;
+};
+
+/** =================================================================
+ * @brief Keeps K best scores of one probe, it is a min-heap so the root is the worst kept score.
+ * Memory is reused when reset() is called with the same or smaller K.
+ */
+class TopK {
+public:
+    TopK() :
+        k{0},
+        length{0}
+        {}
+
+    void
+    reset(
+        size_t _k)
+    {
+        k = _k;
+        length = 0;
+        if(scores.size() < k) {
+            scores.resize(k);
+            indices.resize(k);
+        }
+    }
+
+    /** @brief K the heap has been reset with */
+    size_t
+    capacity() const { return k; }
+
+    /** @brief Score a new entry has to beat to get into the heap */
+    float
+    threshold() const { return length < k ? -std::numeric_limits<float>::infinity() : scores[0]; }
+
+    /** @brief Adds entry, caller has already checked that score > threshold() */
+    void
+    push(
+        float score,
+        uint32_t index)
+    {
+        if(length < k) {
+            size_t i = length++;
+            while(i > 0 && worse(score, index, scores[(i - 1) / 2], indices[(i - 1) / 2])) {
+                scores[i] = scores[(i - 1) / 2];
+                indices[i] = indices[(i - 1) / 2];
+                i = (i - 1) / 2;
+            }
+            scores[i] = score;
+            indices[i] = index;
+        } else {
+            siftDown(score, index, length);
+        }
+    }
+
+    size_t
+    size() const { return length; }
+
+    /** @brief Sorts the heap in place by descending score, heap is empty after the call.
+     * Returned pointers stay valid until the next reset() */
+    void
+    sortDescending(
+        const float *&_scores,
+        const uint32_t *&_indices)
+    {
+        for(size_t n = length; n > 1; --n) {
+            const float _score = scores[n - 1];
+            const uint32_t _index = indices[n - 1];
+            scores[n - 1] = scores[0];
+            indices[n - 1] = indices[0];
+            siftDown(_score, _index, n - 1);
+        }
+        _scores = scores.data();
+        _indices = indices.data();
+    }
+
+private:
+    // Lower score is worse, of equal scores the later gallery entry is worse
+    static bool
+    worse(
+        float score1,
+        uint32_t index1,
+        float score2,
+        uint32_t index2)
+    {
+        return score1 < score2 || (score1 == score2 && index1 > index2);
+    }
+
+    // Places the entry to the root of the heap of n entries and moves it down
+    void
+    siftDown(
+        float score,
+        uint32_t index,
+        size_t n)
+    {
+        size_t i = 0;
+        for(size_t c = 1; c < n; c = 2 * i + 1) {
+            if(c + 1 < n && worse(scores[c + 1], indices[c + 1], scores[c], indices[c]))
+                c++;
+            if(worse(score, index, scores[c], indices[c]))
+                break;
+            scores[i] = scores[c];
+            indices[i] = indices[c];
+            i = c;
+        }
+        scores[i] = score;
+        indices[i] = index;
+    }
+
+    size_t k, length;
+    std::vector<float> scores;
+    std::vector<uint32_t> indices;
+};
+
+/** =================================================================
+ * @brief Scores Rows (1..4) probes against one panel: tile[m * PanelWidth + j] = <probes[m], row j>
+ * @details Sums are kept in named registers instead of arrays, so they stay in registers
+ * without relying on the compiler to unroll the loops over rows.
+ */
+template <size_t Rows>
+inline void
+microKernel(
+    const float *const *probes,
+    const float *panel,
+    size_t dim,
+    float *tile)
+{
+    const float *_p0 = probes[0];
+    const float *_p1 = probes[Rows > 1 ? 1 : 0];
+    const float *_p2 = probes[Rows > 2 ? 2 : 0];
+    const float *_p3 = probes[Rows > 3 ? 3 : 0];
+#if defined(IRPI_SCORING_AVX2)
+    __m256 _a00 = _mm256_setzero_ps(), _a01 = _a00, _a10 = _a00, _a11 = _a00,
+           _a20 = _a00, _a21 = _a00, _a30 = _a00, _a31 = _a00;
+    for(size_t k = 0; k < dim; ++k, panel += PanelWidth) {
+        const __m256 _g0 = _mm256_loadu_ps(panel);
+        const __m256 _g1 = _mm256_loadu_ps(panel + 8);
+        __m256 _p = _mm256_broadcast_ss(_p0 + k);
+        _a00 = _mm256_fmadd_ps(_p, _g0, _a00);
+        _a01 = _mm256_fmadd_ps(_p, _g1, _a01);
+        if(Rows > 1) {
+            _p = _mm256_broadcast_ss(_p1 + k);
+            _a10 = _mm256_fmadd_ps(_p, _g0, _a10);
+            _a11 = _mm256_fmadd_ps(_p, _g1, _a11);
+        }
+        if(Rows > 2) {
+            _p = _mm256_broadcast_ss(_p2 + k);
+            _a20 = _mm256_fmadd_ps(_p, _g0, _a20);
+            _a21 = _mm256_fmadd_ps(_p, _g1, _a21);
+        }
+        if(Rows > 3) {
+            _p = _mm256_broadcast_ss(_p3 + k);
+            _a30 = _mm256_fmadd_ps(_p, _g0, _a30);
+            _a31 = _mm256_fmadd_ps(_p, _g1, _a31);
+        }
+    }
+    const __m256 _acc[4][2] = {{_a00, _a01}, {_a10, _a11}, {_a20, _a21}, {_a30, _a31}};
+    for(size_t m = 0; m < Rows; ++m) {
+        _mm256_storeu_ps(tile + m * PanelWidth, _acc[m][0]);
+        _mm256_storeu_ps(tile + m * PanelWidth + 8, _acc[m][1]);
+    }
+#elif defined(IRPI_SCORING_SSE2) || defined(IRPI_SCORING_NEON)
+  #if defined(IRPI_SCORING_SSE2)
+    typedef __m128 Vec;
+    #define IRPI_SCORING_ZERO()        _mm_setzero_ps()
+    #define IRPI_SCORING_LOAD(p)       _mm_loadu_ps(p)
+    #define IRPI_SCORING_SET1(v)       _mm_set1_ps(v)
+    #define IRPI_SCORING_MADD(a, b, c) _mm_add_ps(c, _mm_mul_ps(a, b))
+    #define IRPI_SCORING_STORE(p, v)   _mm_storeu_ps(p, v)
+  #else
+    typedef float32x4_t Vec;
+    #define IRPI_SCORING_ZERO()        vdupq_n_f32(0.0f)
+    #define IRPI_SCORING_LOAD(p)       vld1q_f32(p)
+    #define IRPI_SCORING_SET1(v)       vdupq_n_f32(v)
+    #define IRPI_SCORING_MADD(a, b, c) vmlaq_f32(c, a, b)
+    #define IRPI_SCORING_STORE(p, v)   vst1q_f32(p, v)
+  #endif
+    // 4-lane vectors: a row of the panel takes 4 of them
+    Vec _a00 = IRPI_SCORING_ZERO(), _a01 = _a00, _a02 = _a00, _a03 = _a00,
+        _a10 = _a00, _a11 = _a00, _a12 = _a00, _a13 = _a00,
+        _a20 = _a00, _a21 = _a00, _a22 = _a00, _a23 = _a00,
+        _a30 = _a00, _a31 = _a00, _a32 = _a00, _a33 = _a00;
+    for(size_t k = 0; k < dim; ++k, panel += PanelWidth) {
+        const Vec _g0 = IRPI_SCORING_LOAD(panel), _g1 = IRPI_SCORING_LOAD(panel + 4),
+                  _g2 = IRPI_SCORING_LOAD(panel + 8), _g3 = IRPI_SCORING_LOAD(panel + 12);
+        Vec _p = IRPI_SCORING_SET1(_p0[k]);
+        _a00 = IRPI_SCORING_MADD(_p, _g0, _a00);
+        _a01 = IRPI_SCORING_MADD(_p, _g1, _a01);
+        _a02 = IRPI_SCORING_MADD(_p, _g2, _a02);
+        _a03 = IRPI_SCORING_MADD(_p, _g3, _a03);
+        if(Rows > 1) {
+            _p = IRPI_SCORING_SET1(_p1[k]);
+            _a10 = IRPI_SCORING_MADD(_p, _g0, _a10);
+            _a11 = IRPI_SCORING_MADD(_p, _g1, _a11);
+            _a12 = IRPI_SCORING_MADD(_p, _g2, _a12);
+            _a13 = IRPI_SCORING_MADD(_p, _g3, _a13);
+        }
+        if(Rows > 2) {
+            _p = IRPI_SCORING_SET1(_p2[k]);
+            _a20 = IRPI_SCORING_MADD(_p, _g0, _a20);
+            _a21 = IRPI_SCORING_MADD(_p, _g1, _a21);
+            _a22 = IRPI_SCORING_MADD(_p, _g2, _a22);
+            _a23 = IRPI_SCORING_MADD(_p, _g3, _a23);
+        }
+        if(Rows > 3) {
+            _p = IRPI_SCORING_SET1(_p3[k]);
+            _a30 = IRPI_SCORING_MADD(_p, _g0, _a30);
+            _a31 = IRPI_SCORING_MADD(_p, _g1, _a31);
+            _a32 = IRPI_SCORING_MADD(_p, _g2, _a32);
+            _a33 = IRPI_SCORING_MADD(_p, _g3, _a33);
+        }
+    }
+    const Vec _acc[4][4] = {{_a00, _a01, _a02, _a03}, {_a10, _a11, _a12, _a13},
+                            {_a20, _a21, _a22, _a23}, {_a30, _a31, _a32, _a33}};
+    for(size_t m = 0; m < Rows; ++m)
+        for(size_t v = 0; v < 4; ++v)
+            IRPI_SCORING_STORE(tile + m * PanelWidth + 4 * v, _acc[m][v]);
+    #undef IRPI_SCORING_ZERO
+    #undef IRPI_SCORING_LOAD
+    #undef IRPI_SCORING_SET1
+    #undef IRPI_SCORING_MADD
+    #undef IRPI_SCORING_STORE
+#else
+    const float *_p[4] = {_p0, _p1, _p2, _p3};
+    float _acc[Rows][PanelWidth] = {};
+    for(size_t k = 0; k < dim; ++k, panel += PanelWidth)
+        for(size_t m = 0; m < Rows; ++m)
+            for(size_t j = 0; j < PanelWidth; ++j)
+                _acc[m][j] += _p[m][k] * panel[j];
+    for(size_t m = 0; m < Rows; ++m)
+        std::copy(_acc[m], _acc[m] + PanelWidth, tile + m * PanelWidth);
+#endif
+}
+
+inline void
+runMicroKernel(
+    size_t rows,
+    const float *const *probes,
+    const float *panel,
+    size_t dim,
+    float *tile)
+{
+    switch(rows) {
+        case 1: microKernel<1>(probes, panel, dim, tile); break;
+        case 2: microKernel<2>(probes, panel, dim, tile); break;
+        case 3: microKernel<3>(probes, panel, dim, tile); break;
+        default: microKernel<ProbeBlock>(probes, panel, dim, tile); break;
+    }
+}
+
+/** =================================================================
+ * @brief Scores count probes against panelcount panels that start with panel firstpanel
+ * of the gallery of rows entries and keeps best entries of probe i in heaps[i]
+ * @details Heaps shall be reset() with the wanted K before the first call, so a gallery
+ * may be searched piece by piece (i.e. as it is read from the file).  Entries are reported
+ * with base added to their index, so several galleries may share the heaps.  Panels are walked by
+ * blocks of L2BlockBytes, inside a block by ProbeBlock probes and then by panels.
+ */
+inline void
+searchPanels(
+    const float *panels,
+    size_t firstpanel,
+    size_t panelcount,
+    size_t rows,
+    size_t dim,
+    const float *const *probes,
+    size_t count,
+    TopK *heaps,
+    size_t base = 0)
+{
+    const size_t _panelsize = PanelWidth * dim;
+    const size_t _blockpanels = std::max<size_t>(1, L2BlockBytes / (std::max<size_t>(_panelsize, 1) * sizeof(float)));
+    float _tile[ProbeBlock * PanelWidth];
+    for(size_t b = 0; b < panelcount; b += _blockpanels) {
+        const size_t _blockend = std::min(panelcount, b + _blockpanels);
+        for(size_t m0 = 0; m0 < count; m0 += ProbeBlock) {
+            const size_t _rows = std::min(ProbeBlock, count - m0);
+            for(size_t p = b; p < _blockend; ++p) {
+                runMicroKernel(_rows, probes + m0, panels + p * _panelsize, dim, _tile);
+                const size_t _first = (firstpanel + p) * PanelWidth;
+                const size_t _valid = std::min(PanelWidth, rows - _first);
+                for(size_t m = 0; m < _rows; ++m) {
+                    TopK &_heap = heaps[m0 + m];
+                    float _threshold = _heap.threshold();
+                    const float *_scores = _tile + m * PanelWidth;
+                    for(size_t j = 0; j < _valid; ++j)
+                        if(_scores[j] > _threshold) {
+                            _heap.push(_scores[j], static_cast<uint32_t>(base + _first + j));
+                            _threshold = _heap.threshold();
+                        }
+                }
+            }
+        }
+    }
+}
+
+/** @brief How scores of the rows of one subject are combined into the score of the subject */
+enum class Fusion {
+    None, // each row is an entry of its own
+    Max,
+    Mean
+};
+
+/** =================================================================
+ * @brief Running score of the subject whose rows a probe is going over, rows of a subject shall
+ * be next to each other in the gallery.  Subject ids go to the heap instead of row indices.
+ */
+struct SubjectScore {
+    SubjectScore() :
+        subject{0},
+        score{0.0f},
+        rows{0}
+        {}
+
+    uint32_t subject;
+    float score;
+    uint32_t rows; // 0 when there is no subject to report
+};
+
+/** @brief Puts the subject to the heap if its fused score is good enough, accumulator is emptied */
+inline void
+pushSubject(
+    TopK &heap,
+    SubjectScore &accumulator,
+    Fusion fusion)
+{
+    if(accumulator.rows == 0)
+        return;
+    const float _score = fusion == Fusion::Mean ? accumulator.score / accumulator.rows : accumulator.score;
+    if(_score > heap.threshold())
+        heap.push(_score, accumulator.subject);
+    accumulator.rows = 0;
+}
+
+/** =================================================================
+ * @brief Scores count probes against panels as searchPanels() does, but scores of the rows
+ * are fused per subject right after the micro-kernel: subjects[i] is the subject of row i
+ * and heaps[i] keeps best subjects of probe i.
+ * @details A subject is pushed when the scan goes past its last row, so its rows may span
+ * several panels and several calls; accumulators keep the subject being scanned in between
+ * and pushSubject() shall be called for each probe when the whole gallery is scanned.
+ * The same subject id may not appear again after other subjects.
+ */
+inline void
+searchSubjects(
+    const float *panels,
+    size_t firstpanel,
+    size_t panelcount,
+    size_t rows,
+    size_t dim,
+    const uint32_t *subjects,
+    Fusion fusion,
+    const float *const *probes,
+    size_t count,
+    TopK *heaps,
+    SubjectScore *accumulators)
+{
+    const size_t _panelsize = PanelWidth * dim;
+    const size_t _blockpanels = std::max<size_t>(1, L2BlockBytes / (std::max<size_t>(_panelsize, 1) * sizeof(float)));
+    float _tile[ProbeBlock * PanelWidth];
+    for(size_t b = 0; b < panelcount; b += _blockpanels) {
+        const size_t _blockend = std::min(panelcount, b + _blockpanels);
+        for(size_t m0 = 0; m0 < count; m0 += ProbeBlock) {
+            const size_t _rows = std::min(ProbeBlock, count - m0);
+            for(size_t p = b; p < _blockend; ++p) {
+                runMicroKernel(_rows, probes + m0, panels + p * _panelsize, dim, _tile);
+                const size_t _first = (firstpanel + p) * PanelWidth;
+                const size_t _valid = std::min(PanelWidth, rows - _first);
+                const uint32_t *_subjects = subjects + _first;
+                for(size_t m = 0; m < _rows; ++m) {
+                    SubjectScore &_accumulator = accumulators[m0 + m];
+                    const float *_scores = _tile + m * PanelWidth;
+                    for(size_t j = 0; j < _valid; ++j) {
+                        if(_accumulator.rows == 0 || _subjects[j] != _accumulator.subject) {
+                            pushSubject(heaps[m0 + m], _accumulator, fusion);
+                            _accumulator.subject = _subjects[j];
+                            _accumulator.score = _scores[j];
+                        } else if(fusion == Fusion::Mean) {
+                            _accumulator.score += _scores[j];
+                        } else {
+                            _accumulator.score = std::max(_accumulator.score, _scores[j]);
+                        }
+                        _accumulator.rows++;
+                    }
+                }
+            }
+        }
+    }
+}
+
+/** @brief Scores count probes against the whole gallery, see searchPanels() */
+inline void
+searchBatch(
+    const PackedGallery &gallery,
+    const float *const *probes,
+    size_t count,
+    TopK *heaps,
+    size_t base = 0)
+{
+    if(gallery.panels() > 0)
+        searchPanels(gallery.panel(0), 0, gallery.panels(), gallery.rows(), gallery.dimension(), probes, count, heaps, base);
+}
+
+} // namespace scoring
+} // namespace IRPI
+
+#endif /* BLOCKEDSCORING_H_ */
@@ -0,0 +1,342 @@
+/*
+ * Out-of-core gallery of the reference implementation
+ *
+ * Packed gallery panels are written to a file and the search scans the file
+ * block by block instead of the memory copy, so the gallery may be larger
+ * than RAM.  The file is always memory-mapped; in Mapped mode the scan reads
+ * through the mapping with sequential access advice and asks the kernel to
+ * start reading the next block while the current one is scored.  In Direct
+ * mode the scan reads with O_DIRECT into two aligned buffers: the next block
+ * is read in the background while the current one is scored, and the page
+ * cache is neither used nor polluted.  Random accesses (the shortlist rows)
+ * always go through the mapping.
+ *
+ * Blocks hold whole panels and start at multiples of the page size, the file
+ * is padded to a page size multiple, as O_DIRECT requires.
+ *
+ * This software is not subject to copyright protection
+ */
+
+#ifndef GALLERYFILE_H_
+#define GALLERYFILE_H_
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <string>
+#include <utility>
+
+#ifdef Q_OS_LINUX
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+#endif
+
+#include "blockedscoring.h"
+
+namespace IRPI {
+namespace scoring {
+
+/** @brief Alignment of O_DIRECT offsets, sizes and buffers */
+const size_t FilePageBytes = 4096;
+/** @brief Size of the block the file is scanned by */
+const size_t FileBlockBytes = 4 * 1024 * 1024;
+
+/** =================================================================
+ * @brief Packed gallery stored in a file
+ */
+class GalleryFile {
+public:
+    enum class Access { Mapped, Direct };
+
+    GalleryFile() :
+        fd{-1},
+        directfd{-1},
+        mapping{nullptr},
+        length{0},
+        count{0},
+        dim{0},
+        blockpanels{0},
+        access{Access::Mapped}
+        {
+            buffers[0] = buffers[1] = nullptr;
+        }
+
+    ~GalleryFile() { close(); }
+
+    GalleryFile(const GalleryFile&) = delete;
+    GalleryFile& operator=(const GalleryFile&) = delete;
+
+    /** @brief Writes the gallery to the file at path and maps it, error gets the reason of a failure */
+    bool
+    create(
+        const std::string &path,
+        const PackedGallery &gallery,
+        std::string &error)
+    {
+        close();
+#ifdef Q_OS_LINUX
+        const size_t _bytes = gallery.panels() * PanelWidth * gallery.dimension() * sizeof(float);
+        const size_t _padded = std::max(FilePageBytes, (_bytes + FilePageBytes - 1) / FilePageBytes * FilePageBytes);
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        if(fd < 0) {
+            error = "Can not create gallery file " + path + ": " + std::strerror(errno);
+            return false;
+        }
+        const char *_data = gallery.panels() > 0 ? reinterpret_cast<const char*>(gallery.panel(0)) : nullptr;
+        for(size_t _written = 0; _written < _bytes;) {
+            const ssize_t _chunk = ::write(fd, _data + _written, std::min<size_t>(_bytes - _written, FileBlockBytes));
+            if(_chunk <= 0) {
+                error = "Can not write gallery file " + path + ": " + std::strerror(errno);
+                close();
+                return false;
+            }
+            _written += static_cast<size_t>(_chunk);
+        }
+        if(::ftruncate(fd, static_cast<off_t>(_padded)) != 0 || ::fdatasync(fd) != 0) {
+            error = "Can not write gallery file " + path + ": " + std::strerror(errno);
+            close();
+            return false;
+        }
+        mapping = ::mmap(nullptr, _padded, PROT_READ, MAP_SHARED, fd, 0);
+        if(mapping == MAP_FAILED) {
+            mapping = nullptr;
+            error = "Can not map gallery file " + path + ": " + std::strerror(errno);
+            close();
+            return false;
+        }
+        ::madvise(mapping, _padded, MADV_SEQUENTIAL);
+        ::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        filepath = path;
+        length = _padded;
+        count = gallery.rows();
+        dim = gallery.dimension();
+        // Whole panels in a block, blocks at page size multiples
+        const size_t _panelbytes = PanelWidth * dim * sizeof(float);
+        blockpanels = std::max<size_t>(1, FileBlockBytes / _panelbytes);
+        while((blockpanels * _panelbytes) % FilePageBytes != 0)
+            ++blockpanels;
+        access = Access::Mapped;
+        return true;
+#else
+        (void)path;
+        (void)gallery;
+        error = "Gallery file is supported on Linux only";
+        return false;
+#endif
+    }
+
+    /** @brief Switches the way the file is scanned, pages mapped so far are dropped from the mapping */
+    bool
+    setAccess(
+        Access _access,
+        std::string &error)
+    {
+        if(!isOpen()) {
+            error = "No gallery file";
+            return false;
+        }
+#ifdef Q_OS_LINUX
+        closeDirect();
+        // Fresh mapping, so the pages may be evicted from the page cache by the caller
+        void *_mapping = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        if(_mapping == MAP_FAILED) {
+            error = std::string("Can not map gallery file: ") + std::strerror(errno);
+            return false;
+        }
+        ::munmap(mapping, length);
+        mapping = _mapping;
+        ::madvise(mapping, length, MADV_SEQUENTIAL);
+        access = Access::Mapped;
+        if(_access == Access::Direct) {
+            const size_t _blockbytes = blockpanels * PanelWidth * dim * sizeof(float);
+            directfd = ::open(filepath.c_str(), O_RDONLY | O_DIRECT);
+            if(directfd < 0) {
+                error = "File system does not support direct reads of " + filepath + ": " + std::strerror(errno);
+                return false;
+            }
+            for(size_t i = 0; i < 2; ++i)
+                if(::posix_memalign(&buffers[i], FilePageBytes, _blockbytes) != 0) {
+                    buffers[i] = nullptr;
+                    error = "Can not allocate direct read buffers";
+                    closeDirect();
+                    return false;
+                }
+            // Some file systems accept O_DIRECT at open and refuse the reads
+            if(::pread(directfd, buffers[0], FilePageBytes, 0) < 0) {
+                error = "File system does not support direct reads of " + filepath + ": " + std::strerror(errno);
+                closeDirect();
+                return false;
+            }
+            access = Access::Direct;
+        }
+        return true;
+#else
+        (void)_access;
+        error = "Gallery file is supported on Linux only";
+        return false;
+#endif
+    }
+
+    /** @brief Calls visit(panels, firstpanel, panelcount) block by block over the whole file,
+     * the scan stops early when visit returns false */
+    template<typename Visitor>
+    bool
+    scan(
+        Visitor visit) const
+    {
+#ifdef Q_OS_LINUX
+        const size_t _panelbytes = PanelWidth * dim * sizeof(float);
+        const size_t _panels = panels();
+        if(access == Access::Mapped) {
+            const char *_data = static_cast<const char*>(mapping);
+            for(size_t p = 0; p < _panels; p += blockpanels) {
+                const size_t _next = p + blockpanels;
+                if(_next < _panels)
+                    ::madvise(const_cast<char*>(_data) + _next * _panelbytes,
+                              std::min(blockpanels, _panels - _next) * _panelbytes, MADV_WILLNEED);
+                if(!visit(reinterpret_cast<const float*>(_data + p * _panelbytes), p, std::min(blockpanels, _panels - p)))
+                    break;
+            }
+            return true;
+        }
+        // Direct: block b + 1 is read in the background while block b is scored
+        const size_t _blockbytes = blockpanels * _panelbytes;
+        const int _fd = directfd;
+        auto _read = [_fd, _blockbytes, this](void *buffer, size_t offset) {
+            const size_t _bytes = std::min(_blockbytes, length - offset);
+            return ::pread(_fd, buffer, _bytes, static_cast<off_t>(offset)) == static_cast<ssize_t>(_bytes);
+        };
+        bool _ok = _panels == 0 || _read(buffers[0], 0);
+        for(size_t p = 0, b = 0; _ok && p < _panels; p += blockpanels, b ^= 1) {
+            const size_t _next = p + blockpanels;
+            std::future<bool> _pending;
+            if(_next < _panels)
+                _pending = std::async(std::launch::async, _read, buffers[b ^ 1], _next * _panelbytes);
+            const bool _more = visit(static_cast<const float*>(buffers[b]), p, std::min(blockpanels, _panels - p));
+            // Read in flight uses the buffer, so it is awaited even if the scan stops
+            if(_pending.valid())
+                _ok = _pending.get();
+            if(!_more)
+                break;
+        }
+        return _ok;
+#else
+        (void)visit;
+        return false;
+#endif
+    }
+
+    /** @brief Moves the file to path, the mapping stays valid */
+    bool
+    rename(
+        const std::string &path,
+        std::string &error)
+    {
+#ifdef Q_OS_LINUX
+        if(::rename(filepath.c_str(), path.c_str()) != 0) {
+            error = "Can not rename gallery file " + filepath + ": " + std::strerror(errno);
+            return false;
+        }
+        filepath = path;
+        return true;
+#else
+        (void)path;
+        error = "Gallery file is supported on Linux only";
+        return false;
+#endif
+    }
+
+    void
+    swap(
+        GalleryFile &other)
+    {
+        std::swap(fd, other.fd);
+        std::swap(directfd, other.directfd);
+        std::swap(mapping, other.mapping);
+        std::swap(buffers[0], other.buffers[0]);
+        std::swap(buffers[1], other.buffers[1]);
+        std::swap(filepath, other.filepath);
+        std::swap(length, other.length);
+        std::swap(count, other.count);
+        std::swap(dim, other.dim);
+        std::swap(blockpanels, other.blockpanels);
+        std::swap(access, other.access);
+    }
+
+    void
+    close()
+    {
+#ifdef Q_OS_LINUX
+        closeDirect();
+        if(mapping)
+            ::munmap(mapping, length);
+        if(fd >= 0)
+            ::close(fd);
+#endif
+        mapping = nullptr;
+        fd = -1;
+        length = count = dim = blockpanels = 0;
+        filepath.clear();
+        access = Access::Mapped;
+    }
+
+    bool
+    isOpen() const { return mapping != nullptr; }
+
+    const std::string&
+    path() const { return filepath; }
+
+    Access
+    mode() const { return access; }
+
+    size_t
+    rows() const { return count; }
+
+    size_t
+    dimension() const { return dim; }
+
+    size_t
+    panels() const { return (count + PanelWidth - 1) / PanelWidth; }
+
+    /** @brief Panels of the file through the mapping */
+    const float*
+    data() const { return static_cast<const float*>(mapping); }
+
+    size_t
+    bytes() const { return length; }
+
+private:
+    void
+    closeDirect()
+    {
+#ifdef Q_OS_LINUX
+        if(directfd >= 0)
+            ::close(directfd);
+#endif
+        directfd = -1;
+        for(size_t i = 0; i < 2; ++i) {
+            std::free(buffers[i]);
+            buffers[i] = nullptr;
+        }
+    }
+
+    int fd;
+    int directfd;
+    void *mapping;
+    void *buffers[2];
+    std::string filepath;
+    size_t length;
+    size_t count;
+    size_t dim;
+    size_t blockpanels;
+    Access access;
+};
+
+} // namespace scoring
+} // namespace IRPI
+
+#endif /* GALLERYFILE_H_ */
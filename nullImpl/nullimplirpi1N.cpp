@@ -5,16 +5,36 @@
 #include <iostream>
 #include <fstream>
 #include <cstring>
+#include <cstdio>
 #include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <chrono>
+#include <unordered_set>
 
 #include "nullimplirpi1N.h"
+#include "irpiproc.h"
 
 using namespace std;
 using namespace IRPI;
 
-NullImplIRPI1N::NullImplIRPI1N() {}
+NullImplIRPI1N::NullImplIRPI1N() :
+    shortlist(0),
+    threshold(DecisionThreshold),
+    fusion(DefaultFusion),
+    mainSubjects(0),
+    removed(0),
+    compactionRows(CompactionRows)
+{
+    projector.init(Dim);
+    delta.pack(nullptr, 0, Dim);
+}
 
-NullImplIRPI1N::~NullImplIRPI1N() {}
+NullImplIRPI1N::~NullImplIRPI1N()
+{
+    if(compaction.valid())
+        compaction.wait();
+}
 
 ReturnStatus
 NullImplIRPI1N::initializeEnrollmentSession(const string &configDir)
@@ -23,26 +43,316 @@ NullImplIRPI1N::initializeEnrollmentSession(const string &configDir)
     return ReturnStatus(ReturnCode::Success);
 }
 
+ReturnStatus
+NullImplIRPI1N::makeTemplate(const Image &img, float *embedding) const
+{
+    if(!img.data || img.width == 0 || img.height == 0)
+        return ReturnStatus(ReturnCode::TemplateCreationError, "Empty image");
+    const Image small = proc::resizeArea(proc::toGray(img), Side, Side);
+    const uint8_t *pixels = small.data.get();
+    float mean = 0.0f;
+    for(size_t i = 0; i < Dim; ++i)
+        mean += pixels[i];
+    mean /= Dim;
+    float norm = 0.0f;
+    for(size_t i = 0; i < Dim; ++i) {
+        embedding[i] = pixels[i] - mean;
+        norm += embedding[i] * embedding[i];
+    }
+    if(norm < 1.0f)
+        return ReturnStatus(ReturnCode::TemplateCreationError, "Flat image");
+    norm = 1.0f / sqrt(norm);
+    for(size_t i = 0; i < Dim; ++i)
+        embedding[i] *= norm;
+    return ReturnStatus(ReturnCode::Success);
+}
+
 ReturnStatus
 NullImplIRPI1N::createTemplate(const Image &img,
         TemplateRole role,
         vector<uint8_t> &templ)
 {
-    string blurb{"Long time ago in a galaxy far far away..."};
+    (void)role;
+    float embedding[Dim];
+    ReturnStatus status = makeTemplate(img, embedding);
+    if(status.code != ReturnCode::Success) {
+        templ.clear();
+        return status;
+    }
+    templ.resize(sizeof(embedding));
+    memcpy(templ.data(), embedding, sizeof(embedding));
+    return status;
+}
 
-    templ.resize(blurb.size());
-    memcpy(templ.data(), blurb.c_str(), blurb.size());
+size_t
+NullImplIRPI1N::maxTemplateSize(TemplateRole role) const
+{
+    (void)role;
+    return Dim * sizeof(float);
+}
 
-    return ReturnStatus(ReturnCode::Success);
+ReturnStatus
+NullImplIRPI1N::createTemplate(const Image &img,
+        TemplateRole role,
+        uint8_t *templ,
+        size_t capacity,
+        size_t &length)
+{
+    (void)role;
+    float embedding[Dim];
+    length = 0;
+    if(capacity < sizeof(embedding))
+        return ReturnStatus(ReturnCode::VendorError, "Not enough space for the template");
+    ReturnStatus status = makeTemplate(img, embedding);
+    if(status.code != ReturnCode::Success)
+        return status;
+    memcpy(templ, embedding, sizeof(embedding));
+    length = sizeof(embedding);
+    return status;
 }
 
 ReturnStatus NullImplIRPI1N::finalizeEnrollment(const std::vector<std::pair<size_t, std::vector<uint8_t>>> &vtempl)
 {
+    std::vector<std::pair<size_t, TemplateView>> views;
+    views.reserve(vtempl.size());
     for(size_t i = 0; i < vtempl.size(); ++i)
-        labels.push_back(vtempl[i].first);
+        views.push_back(std::make_pair(vtempl[i].first, TemplateView(vtempl[i].second)));
+    return finalizeEnrollment(views);
+}
+
+ReturnStatus
+NullImplIRPI1N::finalizeEnrollment(const std::vector<std::pair<size_t, TemplateView>> &vtempl)
+{
+    // Pending compaction belongs to the old gallery
+    if(compaction.valid()) {
+        MainSegment dropped = compaction.get();
+        if(dropped.galleryFile)
+            remove(dropped.galleryFile->path().c_str());
+    }
+    removedDuringCompaction.clear();
+    // Blank templates stay in the gallery as zero vectors, they score 0 against any probe
+    vector<float> rows(vtempl.size() * Dim, 0.0f);
+    vector<size_t> segmentLabels;
+    segmentLabels.reserve(vtempl.size());
+    for(size_t i = 0; i < vtempl.size(); ++i) {
+        segmentLabels.push_back(vtempl[i].first);
+        if(vtempl[i].second.size() == Dim * sizeof(float))
+            memcpy(&rows[i * Dim], vtempl[i].second.data(), Dim * sizeof(float));
+    }
+    // The file may be written at the same path, so the old one is unmapped first
+    galleryFile.close();
+    MainSegment segment = buildMainSegment(rows, segmentLabels, galleryPath);
+    if(!segment.error.empty())
+        return ReturnStatus(ReturnCode::VendorError, segment.error);
+    deltaRows.clear();
+    deltaLabels.clear();
+    delta.pack(nullptr, 0, Dim);
+    installMainSegment(segment);
     return ReturnCode::Success;
 }
 
+NullImplIRPI1N::MainSegment
+NullImplIRPI1N::buildMainSegment(
+        const vector<float> &rows,
+        vector<size_t> &segmentLabels,
+        const string &path) const
+{
+    MainSegment segment;
+    const size_t count = segmentLabels.size();
+    // Templates of one label go next to each other, in the order they came
+    vector<uint32_t> order(count);
+    for(size_t i = 0; i < count; ++i)
+        order[i] = static_cast<uint32_t>(i);
+    stable_sort(order.begin(), order.end(), [&segmentLabels](uint32_t a, uint32_t b) {
+        return segmentLabels[a] < segmentLabels[b];
+    });
+    segment.labels.resize(count);
+    segment.rowSubjects.resize(count);
+    for(size_t i = 0; i < count; ++i) {
+        segment.labels[i] = segmentLabels[order[i]];
+        if(i == 0 || segment.labels[i] != segment.labels[i - 1]) {
+            segment.subjectLabels.push_back(segment.labels[i]);
+            segment.subjectRows.push_back(i);
+        }
+        segment.rowSubjects[i] = static_cast<uint32_t>(segment.subjectLabels.size() - 1);
+    }
+    segment.gallery.pack(rows.data(), order.data(), count, Dim);
+    vector<const float*> vectors(count);
+    for(size_t i = 0; i < count; ++i)
+        vectors[i] = &rows[order[i] * Dim];
+    segment.sketches.resize(count * scoring::SketchWords);
+    projector.sketch(vectors.data(), count, segment.sketches.data());
+    if(!path.empty()) {
+        // Gallery lives in the file from now on, memory copy is released
+        segment.galleryFile.reset(new scoring::GalleryFile);
+        if(!segment.galleryFile->create(path, segment.gallery, segment.error))
+            return segment;
+        segment.gallery.release();
+    }
+    return segment;
+}
+
+void
+NullImplIRPI1N::installMainSegment(MainSegment &segment)
+{
+    const size_t oldRows = labels.size();
+    const size_t merged = segment.mergedDeltaRows;
+    if(segment.galleryFile) {
+        string error;
+        const scoring::GalleryFile::Access access = galleryFile.isOpen() ? galleryFile.mode()
+                                                                         : scoring::GalleryFile::Access::Mapped;
+        if(segment.galleryFile->path() != galleryPath && !segment.galleryFile->rename(galleryPath, error)) {
+            // Old segments keep serving, next update starts the compaction again
+            remove(segment.galleryFile->path().c_str());
+            return;
+        }
+        galleryFile.swap(*segment.galleryFile);
+        if(access == scoring::GalleryFile::Access::Direct)
+            galleryFile.setAccess(access, error);
+    } else {
+        galleryFile.close();
+    }
+    gallery = std::move(segment.gallery);
+    labels.swap(segment.labels);
+    sketches.swap(segment.sketches);
+    rowSubjects.swap(segment.rowSubjects);
+    subjectLabels.swap(segment.subjectLabels);
+    subjectRows.swap(segment.subjectRows);
+    mainSubjects = subjectLabels.size();
+    // Delta rows inserted after the compaction has started stay in the delta segment
+    deltaRows.erase(deltaRows.begin(), deltaRows.begin() + merged * Dim);
+    deltaLabels.erase(deltaLabels.begin(), deltaLabels.begin() + merged);
+    delta.pack(deltaRows.data(), deltaLabels.size(), Dim);
+    deltaSubjects.clear();
+    for(size_t j = 0; j < deltaLabels.size(); ++j)
+        appendDeltaSubject(deltaLabels[j]);
+    vector<uint8_t> marks(labels.size() + deltaLabels.size(), 0);
+    for(size_t j = 0; j < deltaLabels.size(); ++j)
+        marks[labels.size() + j] = tombstones[oldRows + merged + j];
+    // Compaction has seen tombstones as they were at its start, later removals are applied again
+    if(!removedDuringCompaction.empty()) {
+        const unordered_set<size_t> targets(removedDuringCompaction.begin(), removedDuringCompaction.end());
+        for(size_t i = 0; i < labels.size(); ++i)
+            if(targets.count(labels[i]))
+                marks[i] = 1;
+        removedDuringCompaction.clear();
+    }
+    tombstones.swap(marks);
+    removed = static_cast<size_t>(count(tombstones.begin(), tombstones.end(), 1));
+    distances.resize(labels.size());
+    selected.resize(labels.size() + deltaLabels.size());
+    selectedSubjects.resize(selected.size());
+    buildPartitions();
+}
+
+void
+NullImplIRPI1N::appendDelta(
+        size_t label,
+        const TemplateView &templ)
+{
+    const size_t row = deltaRows.size();
+    deltaRows.resize(row + Dim, 0.0f);
+    if(templ.size() == Dim * sizeof(float))
+        memcpy(&deltaRows[row], templ.data(), Dim * sizeof(float));
+    delta.append(&deltaRows[row]);
+    appendDeltaSubject(label);
+    deltaLabels.push_back(label);
+    tombstones.push_back(0);
+}
+
+void
+NullImplIRPI1N::appendDeltaSubject(size_t label)
+{
+    // Consecutive delta rows of one label make one subject; the label may have other
+    // subjects in both segments, fillCandidates() reports the best of them, so the mean
+    // is taken per subject until compaction merges them
+    if(deltaSubjects.empty() || subjectLabels.back() != label) {
+        subjectLabels.push_back(label);
+        subjectRows.push_back(labels.size() + deltaSubjects.size());
+    }
+    deltaSubjects.push_back(static_cast<uint32_t>(subjectLabels.size() - 1));
+}
+
+ReturnStatus
+NullImplIRPI1N::insertTemplates(const std::vector<std::pair<size_t, TemplateView>> &vtempl)
+{
+    finishCompaction(false);
+    // As in finalizeEnrollment(), blank templates go as zero vectors
+    for(size_t i = 0; i < vtempl.size(); ++i)
+        appendDelta(vtempl[i].first, vtempl[i].second);
+    selected.resize(labels.size() + deltaLabels.size());
+    selectedSubjects.resize(selected.size());
+    startCompaction();
+    return ReturnCode::Success;
+}
+
+ReturnStatus
+NullImplIRPI1N::removeLabels(const std::vector<size_t> &targets)
+{
+    finishCompaction(false);
+    const unordered_set<size_t> lookup(targets.begin(), targets.end());
+    for(size_t i = 0; i < tombstones.size(); ++i)
+        if(!tombstones[i] && lookup.count(i < labels.size() ? labels[i] : deltaLabels[i - labels.size()])) {
+            tombstones[i] = 1;
+            removed++;
+        }
+    if(compaction.valid())
+        removedDuringCompaction.insert(removedDuringCompaction.end(), targets.begin(), targets.end());
+    startCompaction();
+    return ReturnCode::Success;
+}
+
+void
+NullImplIRPI1N::startCompaction()
+{
+    const size_t pending = deltaLabels.size() + removed;
+    if(compaction.valid() || pending == 0 || pending < max(compactionRows, labels.size() / CompactionRatio))
+        return;
+    // Main segment is read in place, it does not change until the new one is installed;
+    // tombstones and delta rows are copied, as updates go on while compaction runs
+    const string path = galleryPath.empty() ? string() : galleryPath + ".next";
+    compaction = async(launch::async, [this, path](const vector<uint8_t> &marks,
+                                                          const vector<float> &rows,
+                                                          const vector<size_t> &rowLabels) {
+        const size_t mainRows = labels.size();
+        vector<float> live;
+        vector<size_t> liveLabels;
+        live.reserve((mainRows + rowLabels.size()) * Dim);
+        for(size_t i = 0; i < mainRows; ++i) {
+            if(marks[i])
+                continue;
+            const float *column = mainColumn(i);
+            for(size_t k = 0; k < Dim; ++k)
+                live.push_back(column[k * scoring::PanelWidth]);
+            liveLabels.push_back(labels[i]);
+        }
+        for(size_t j = 0; j < rowLabels.size(); ++j)
+            if(!marks[mainRows + j]) {
+                live.insert(live.end(), rows.begin() + j * Dim, rows.begin() + (j + 1) * Dim);
+                liveLabels.push_back(rowLabels[j]);
+            }
+        MainSegment segment = buildMainSegment(live, liveLabels, path);
+        segment.mergedDeltaRows = rowLabels.size();
+        return segment;
+    }, tombstones, deltaRows, deltaLabels);
+}
+
+void
+NullImplIRPI1N::finishCompaction(bool wait)
+{
+    if(!compaction.valid())
+        return;
+    if(!wait && compaction.wait_for(chrono::seconds(0)) != future_status::ready)
+        return;
+    MainSegment segment = compaction.get();
+    if(!segment.error.empty()) {
+        // Old segments keep serving, next update starts the compaction again
+        removedDuringCompaction.clear();
+        return;
+    }
+    installMainSegment(segment);
+}
+
 ReturnStatus
 NullImplIRPI1N::initializeIdentificationSession(const string &configDir)
 {
@@ -57,15 +367,444 @@ NullImplIRPI1N::identifyTemplate(
         vector<Candidate> &candidateList,
         bool &decision)
 {
-    for(size_t i = 0; i < candidateListLength; i++) {
-        if(i < labels.size())
-            candidateList.push_back(Candidate(true, labels[i], candidateListLength-i));
-        else
-            candidateList.push_back(Candidate(false, i, candidateListLength-i));
+    CandidateList list(candidateListLength);
+    ReturnStatus status = identifyTemplate(TemplateView(idTemplate), list, decision);
+    for(size_t i = 0; i < list.length; i++)
+        candidateList.push_back(Candidate(true, list.labels[i], list.scores[i]));
+    // List is padded to the requested length with unassigned candidates
+    for(size_t i = list.length; i < candidateListLength; i++)
+        candidateList.push_back(Candidate());
+    return status;
+}
+
+ReturnStatus
+NullImplIRPI1N::identifyTemplate(
+        const TemplateView &idTemplate,
+        CandidateList &candidateList,
+        bool &decision)
+{
+    return identifyTemplates(&idTemplate, 1, &candidateList, &decision);
+}
+
+ReturnStatus
+NullImplIRPI1N::identifyTemplate(
+        const TemplateView &idTemplate,
+        chrono::steady_clock::time_point deadline,
+        CandidateList &candidateList,
+        bool &decision,
+        bool &partial)
+{
+    return searchTemplates(&idTemplate, 1, &candidateList, &decision, deadline, partial);
+}
+
+ReturnStatus
+NullImplIRPI1N::identifyTemplates(
+        const TemplateView *idTemplates,
+        size_t count,
+        CandidateList *candidateLists,
+        bool *decisions)
+{
+    bool partial;
+    return searchTemplates(idTemplates, count, candidateLists, decisions, chrono::steady_clock::time_point::max(), partial);
+}
+
+ReturnStatus
+NullImplIRPI1N::searchTemplates(
+        const TemplateView *idTemplates,
+        size_t count,
+        CandidateList *candidateLists,
+        bool *decisions,
+        chrono::steady_clock::time_point deadline,
+        bool &partial)
+{
+    finishCompaction(false);
+    partial = false;
+    // Probes are copied to own memory, so they are aligned whatever memory the views point to
+    if(heaps.size() < count) {
+        heaps.resize(count);
+        accumulators.resize(count);
     }
+    if(probebuffer.size() < count * Dim)
+        probebuffer.resize(count * Dim);
+    probes.clear();
+    valid.clear();
+    ReturnStatus result(ReturnCode::Success);
+    for(size_t i = 0; i < count; ++i) {
+        candidateLists[i].clear();
+        decisions[i] = false;
+        if(idTemplates[i].size() != Dim * sizeof(float)) {
+            result = ReturnStatus(ReturnCode::VendorError, "Unexpected template size");
+            continue;
+        }
+        float *probe = &probebuffer[valid.size() * Dim];
+        memcpy(probe, idTemplates[i].data(), Dim * sizeof(float));
+        // Removed rows are dropped from the candidates, so as many more are kept;
+        // so are delta subjects, as their labels may have been reported already
+        const size_t extra = fusion == scoring::Fusion::None ? removed : removed + subjectLabels.size() - mainSubjects;
+        heaps[valid.size()].reset(candidateLists[i].capacity() + extra);
+        accumulators[valid.size()] = scoring::SubjectScore();
+        probes.push_back(probe);
+        valid.push_back(i);
+    }
+    const size_t entries = labels.size();
+    if(shortlist == 0 || shortlist >= entries) {
+        // Gallery is scanned in order, so a scan cut by the deadline has scored its first rows
+        bool scanned = true, complete = true;
+        if(galleryFile.isOpen())
+            scanned = galleryFile.scan([this, deadline, &complete](const float *panels, size_t firstpanel, size_t panelcount) {
+                complete = searchPanels(panels, firstpanel, panelcount, galleryFile.rows(), 0, rowSubjects.data(),
+                                        heaps.data(), accumulators.data(), deadline);
+                return complete;
+            });
+        else if(!partitions.empty())
+            complete = searchPartitions(deadline);
+        else if(gallery.panels() > 0)
+            complete = searchPanels(gallery.panel(0), 0, gallery.panels(), gallery.rows(), 0, rowSubjects.data(),
+                                    heaps.data(), accumulators.data(), deadline);
+        if(scanned) {
+            if(complete && delta.panels() > 0)
+                complete = searchPanels(delta.panel(0), 0, delta.panels(), delta.rows(), entries, deltaSubjects.data(),
+                                        heaps.data(), accumulators.data(), deadline);
+            partial = !complete;
+        } else {
+            for(size_t j = 0; j < valid.size(); ++j)
+                heaps[j].reset(0);
+            result = ReturnStatus(ReturnCode::VendorError, "Can not read gallery file");
+        }
+        // Subject of the last rows is reported by the scan cut by the deadline too, with the rows it has scored
+        for(size_t j = 0; j < valid.size(); ++j) {
+            scoring::pushSubject(heaps[j], accumulators[j], fusion);
+            fillCandidates(heaps[j], nullptr, candidateLists[valid[j]], decisions[valid[j]]);
+        }
+    } else {
+        // Each probe has its own shortlist, so two-stage search goes probe by probe
+        for(size_t j = 0; j < valid.size(); ++j) {
+            if(!searchShortlist(probes[j], heaps[j], accumulators[j], deadline))
+                partial = true;
+            fillCandidates(heaps[j], selected.data(), candidateLists[valid[j]], decisions[valid[j]]);
+        }
+    }
+    return result;
+}
 
-    decision = true;
-    return ReturnCode::Success;
+bool
+NullImplIRPI1N::searchPanels(
+        const float *panels,
+        size_t firstpanel,
+        size_t panelcount,
+        size_t rows,
+        size_t base,
+        const uint32_t *subjects,
+        scoring::TopK *probeHeaps,
+        scoring::SubjectScore *probeSubjects,
+        chrono::steady_clock::time_point deadline)
+{
+    if(deadline == chrono::steady_clock::time_point::max()) {
+        scorePanels(panels, firstpanel, panelcount, rows, base, subjects, probeHeaps, probeSubjects);
+        return true;
+    }
+    // Clock is read once per L2 block of panels, that costs nothing next to the scoring of the block
+    const size_t panelsize = scoring::PanelWidth * Dim;
+    const size_t step = max<size_t>(1, scoring::L2BlockBytes / (panelsize * sizeof(float)));
+    for(size_t p = 0; p < panelcount; p += step) {
+        if(chrono::steady_clock::now() >= deadline)
+            return false;
+        scorePanels(panels + p * panelsize, firstpanel + p, min(step, panelcount - p), rows, base, subjects,
+                    probeHeaps, probeSubjects);
+    }
+    return true;
+}
+
+void
+NullImplIRPI1N::scorePanels(
+        const float *panels,
+        size_t firstpanel,
+        size_t panelcount,
+        size_t rows,
+        size_t base,
+        const uint32_t *subjects,
+        scoring::TopK *probeHeaps,
+        scoring::SubjectScore *probeSubjects)
+{
+    if(fusion == scoring::Fusion::None)
+        scoring::searchPanels(panels, firstpanel, panelcount, rows, Dim, probes.data(), probes.size(), probeHeaps, base);
+    else
+        scoring::searchSubjects(panels, firstpanel, panelcount, rows, Dim, subjects, fusion,
+                                probes.data(), probes.size(), probeHeaps, probeSubjects);
+}
+
+bool
+NullImplIRPI1N::searchPartitions(chrono::steady_clock::time_point deadline)
+{
+    searchDeadline = deadline;
+    for(size_t w = 0; w < partitions.size(); ++w)
+        workers[w]->run(partitions[w]->search);
+    bool complete = true;
+    for(size_t w = 0; w < partitions.size(); ++w) {
+        workers[w]->wait();
+        complete = complete && partitions[w]->complete;
+    }
+    // Partitions hold consecutive rows and whole subjects, so merged heaps are the ones of a single scan
+    for(size_t j = 0; j < probes.size(); ++j)
+        for(size_t w = 0; w < partitions.size(); ++w) {
+            const float *scores;
+            const uint32_t *positions;
+            const size_t length = partitions[w]->heaps[j].size();
+            partitions[w]->heaps[j].sortDescending(scores, positions);
+            for(size_t i = 0; i < length && scores[i] > heaps[j].threshold(); ++i)
+                heaps[j].push(scores[i], positions[i]);
+        }
+    return complete;
+}
+
+void
+NullImplIRPI1N::searchPartition(Partition &partition)
+{
+    // Heaps and accumulators of the partition are touched here first, so they are on the node too
+    if(partition.heaps.size() < probes.size()) {
+        partition.heaps.resize(probes.size());
+        partition.accumulators.resize(probes.size());
+    }
+    for(size_t j = 0; j < probes.size(); ++j) {
+        partition.heaps[j].reset(heaps[j].capacity());
+        partition.accumulators[j] = scoring::SubjectScore();
+    }
+    partition.complete = partition.gallery.panels() == 0 ||
+            searchPanels(partition.gallery.panel(0), 0, partition.gallery.panels(), partition.gallery.rows(), partition.firstRow,
+                         rowSubjects.data() + partition.firstRow, partition.heaps.data(), partition.accumulators.data(), searchDeadline);
+    for(size_t j = 0; j < probes.size(); ++j)
+        scoring::pushSubject(partition.heaps[j], partition.accumulators[j], fusion);
+}
+
+void
+NullImplIRPI1N::buildPartitions()
+{
+    partitions.clear();
+    if(workers.empty() || galleryFile.isOpen() || gallery.rows() == 0)
+        return;
+    // Partitions of about equal size end at subject boundaries, so a subject is scored by one worker
+    vector<size_t> bounds(1, 0);
+    for(size_t w = 1; w < workers.size(); ++w) {
+        const size_t target = w * labels.size() / workers.size();
+        const vector<size_t>::const_iterator first = lower_bound(subjectRows.begin(), subjectRows.begin() + mainSubjects, target);
+        bounds.push_back(max(bounds.back(), first == subjectRows.begin() + mainSubjects ? labels.size() : *first));
+    }
+    bounds.push_back(labels.size());
+    vector<uint32_t> indices(labels.size());
+    for(size_t i = 0; i < indices.size(); ++i)
+        indices[i] = static_cast<uint32_t>(i);
+    const float *panels = gallery.panel(0);
+    vector<function<void()>> tasks(workers.size());
+    for(size_t w = 0; w < workers.size(); ++w) {
+        partitions.emplace_back(new Partition);
+        Partition *partition = partitions.back().get();
+        partition->firstRow = bounds[w];
+        partition->search = [this, partition]() { searchPartition(*partition); };
+        // Worker writes the panels first, so they are placed on its node
+        tasks[w] = [partition, panels, &indices, &bounds, w]() {
+            partition->gallery.packFromPanels(panels, indices.data() + bounds[w], bounds[w + 1] - bounds[w], Dim);
+        };
+        workers[w]->run(tasks[w]);
+    }
+    for(size_t w = 0; w < workers.size(); ++w)
+        workers[w]->wait();
+    gallery.release();
+}
+
+void
+NullImplIRPI1N::restoreGallery()
+{
+    if(partitions.empty())
+        return;
+    // Rows go back in the order of the main segment, partitions hold consecutive rows
+    gallery.pack(nullptr, 0, Dim);
+    for(size_t i = 0; i < labels.size(); ++i)
+        gallery.appendColumn(mainColumn(i));
+    partitions.clear();
+}
+
+const float*
+NullImplIRPI1N::mainColumn(size_t row) const
+{
+    const float *panels;
+    if(galleryFile.isOpen()) {
+        panels = galleryFile.data();
+    } else if(!partitions.empty()) {
+        // Row belongs to the last partition that starts at or before it, empty partitions are passed over
+        size_t w = partitions.size() - 1;
+        while(partitions[w]->firstRow > row)
+            --w;
+        panels = partitions[w]->gallery.panel(0);
+        row -= partitions[w]->firstRow;
+    } else {
+        panels = gallery.panel(0);
+    }
+    return panels + (row / scoring::PanelWidth) * scoring::PanelWidth * Dim + row % scoring::PanelWidth;
+}
+
+bool
+NullImplIRPI1N::searchShortlist(
+        const float *probe,
+        scoring::TopK &heap,
+        scoring::SubjectScore &accumulator,
+        chrono::steady_clock::time_point deadline)
+{
+    // Deadline is checked before each stage, a probe past it gets no candidates
+    const bool bounded = deadline != chrono::steady_clock::time_point::max();
+    if(bounded && chrono::steady_clock::now() >= deadline)
+        return false;
+    uint64_t probesketch[scoring::SketchWords];
+    projector.sketch(&probe, 1, probesketch);
+    const size_t count = scoring::hammingShortlist(sketches.data(), labels.size(), probesketch, shortlist,
+                                                   distances.data(), selected.data());
+    if(bounded && chrono::steady_clock::now() >= deadline)
+        return false;
+    // Selected rows are in gallery order, so ties are broken the same way as in exhaustive search
+    if(partitions.empty() && count > 0) {
+        const float *panels = galleryFile.isOpen() ? galleryFile.data() : gallery.panel(0);
+        selectedrows.packFromPanels(panels, selected.data(), count, Dim);
+    } else {
+        // NUMA partitions are read in place, each row comes from the partition that holds it
+        selectedrows.pack(nullptr, 0, Dim);
+        for(size_t i = 0; i < count; ++i)
+            selectedrows.appendColumn(mainColumn(selected[i]));
+    }
+    // Delta segment is small, all its rows are scored exactly
+    size_t total = count;
+    for(size_t j = 0; j < deltaLabels.size(); ++j)
+        if(!tombstones[labels.size() + j]) {
+            selected[total++] = static_cast<uint32_t>(labels.size() + j);
+            selectedrows.append(&deltaRows[j * Dim]);
+        }
+    if(fusion == scoring::Fusion::None) {
+        scoring::searchBatch(selectedrows, &probe, 1, &heap);
+        return true;
+    }
+    // Only the shortlisted rows of a subject are fused
+    for(size_t i = 0; i < total; ++i)
+        selectedSubjects[i] = selected[i] < labels.size() ? rowSubjects[selected[i]] : deltaSubjects[selected[i] - labels.size()];
+    if(total > 0)
+        scoring::searchSubjects(selectedrows.panel(0), 0, selectedrows.panels(), total, Dim, selectedSubjects.data(), fusion,
+                                &probe, 1, &heap, &accumulator);
+    scoring::pushSubject(heap, accumulator, fusion);
+    return true;
+}
+
+void
+NullImplIRPI1N::fillCandidates(
+        scoring::TopK &heap,
+        const uint32_t *indices,
+        CandidateList &candidateList,
+        bool &decision) const
+{
+    const float *scores;
+    const uint32_t *positions;
+    const size_t length = heap.size();
+    heap.sortDescending(scores, positions);
+    decision = false;
+    for(size_t i = 0; i < length && candidateList.length < candidateList.capacity(); i++) {
+        if(fusion != scoring::Fusion::None) {
+            // Heap keeps subjects, of several subjects of one label the best one goes
+            const size_t subject = positions[i];
+            if(tombstones[subjectRows[subject]] ||
+               find(candidateList.labels.begin(), candidateList.labels.begin() + candidateList.length, subjectLabels[subject])
+                    != candidateList.labels.begin() + candidateList.length)
+                continue;
+            if(candidateList.length == 0)
+                decision = scores[i] >= threshold;
+            candidateList.push(subjectLabels[subject], scores[i]);
+            continue;
+        }
+        const size_t row = indices ? indices[positions[i]] : positions[i];
+        if(tombstones[row])
+            continue;
+        if(candidateList.length == 0)
+            decision = scores[i] >= threshold;
+        candidateList.push(row < labels.size() ? labels[row] : deltaLabels[row - labels.size()], scores[i]);
+    }
+}
+
+ReturnStatus
+NullImplIRPI1N::setParameter(
+        const string &name,
+        const string &value)
+{
+    char *end = nullptr;
+    if(name == "shortlist") {
+        const unsigned long long size = strtoull(value.c_str(), &end, 10);
+        if(value.empty() || *end != '\0')
+            return ReturnStatus(ReturnCode::ConfigError, "Shortlist size should be an integer");
+        shortlist = static_cast<size_t>(size);
+        return ReturnCode::Success;
+    }
+    if(name == "threshold") {
+        const float score = strtof(value.c_str(), &end);
+        if(value.empty() || *end != '\0')
+            return ReturnStatus(ReturnCode::ConfigError, "Threshold should be a number");
+        threshold = score;
+        return ReturnCode::Success;
+    }
+    if(name == "fusion") {
+        if(value == "none")
+            fusion = scoring::Fusion::None;
+        else if(value == "max")
+            fusion = scoring::Fusion::Max;
+        else if(value == "mean")
+            fusion = scoring::Fusion::Mean;
+        else
+            return ReturnStatus(ReturnCode::ConfigError, "Fusion should be none, max or mean");
+        return ReturnCode::Success;
+    }
+    if(name == "numa") {
+        size_t count = 0;
+        const vector<scoring::NumaNode> nodes = scoring::numaNodes();
+        if(value == "off")
+            count = 0;
+        else if(value == "on")
+            count = nodes.size();
+        else {
+            const unsigned long long workerCount = strtoull(value.c_str(), &end, 10);
+            if(value.empty() || *end != '\0')
+                return ReturnStatus(ReturnCode::ConfigError, "NUMA mode should be on, off or the number of workers");
+            count = static_cast<size_t>(workerCount);
+        }
+        // Compaction reads the partitions that are replaced here
+        finishCompaction(true);
+        // Workers go to the nodes round robin, more workers than nodes share them
+        restoreGallery();
+        workers.clear();
+        for(size_t w = 0; w < count; ++w)
+            workers.emplace_back(new scoring::NodeWorker(nodes[w % nodes.size()]));
+        buildPartitions();
+        return ReturnCode::Success;
+    }
+    if(name == "gallery_file") {
+        galleryPath = value;
+        return ReturnCode::Success;
+    }
+    if(name == "compaction_rows") {
+        const unsigned long long rows = strtoull(value.c_str(), &end, 10);
+        if(value.empty() || *end != '\0')
+            return ReturnStatus(ReturnCode::ConfigError, "Compaction rows should be an integer");
+        compactionRows = static_cast<size_t>(rows);
+        return ReturnCode::Success;
+    }
+    if(name == "gallery_io") {
+        // Compaction reads the mapping that is replaced here
+        finishCompaction(true);
+        scoring::GalleryFile::Access access;
+        if(value == "mmap")
+            access = scoring::GalleryFile::Access::Mapped;
+        else if(value == "direct")
+            access = scoring::GalleryFile::Access::Direct;
+        else
+            return ReturnStatus(ReturnCode::ConfigError, "Gallery file access should be mmap or direct");
+        string error;
+        if(!galleryFile.setAccess(access, error))
+            return ReturnStatus(ReturnCode::ConfigError, error);
+        return ReturnCode::Success;
+    }
+    return ReturnStatus(ReturnCode::ConfigError, "Unknown parameter " + name);
 }
 
 shared_ptr<IdentInterface>
@@ -74,3 +813,5 @@ IdentInterface::getImplementation()
     return make_shared<NullImplIRPI1N>();
 }
 
+IRPI_EXPORT_IMPLEMENTATION
+
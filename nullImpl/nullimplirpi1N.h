@@ -5,7 +5,16 @@
 #ifndef NULLIMPLIRPI1N_H_
 #define NULLIMPLIRPI1N_H_
 
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+
 #include "irpi.h"
+#include "blockedscoring.h"
+#include "binarysketch.h"
+#include "galleryfile.h"
+#include "numanodes.h"
 
 /*
  * Declare the implementation class of the IRPI IDENT (1:N) Interface
@@ -26,10 +35,33 @@ public:
             TemplateRole role,
             std::vector<uint8_t> &templ) override;
 
+    size_t
+    maxTemplateSize(TemplateRole role) const override;
+
+    ReturnStatus
+    createTemplate(
+            const Image &img,
+            TemplateRole role,
+            uint8_t *templ,
+            size_t capacity,
+            size_t &length) override;
+
     ReturnStatus
     finalizeEnrollment(
             const std::vector<std::pair<size_t,std::vector<uint8_t>>> &vtempl) override;
 
+    ReturnStatus
+    finalizeEnrollment(
+            const std::vector<std::pair<size_t,TemplateView>> &vtempl) override;
+
+    ReturnStatus
+    insertTemplates(
+            const std::vector<std::pair<size_t,TemplateView>> &vtempl) override;
+
+    ReturnStatus
+    removeLabels(
+            const std::vector<size_t> &labels) override;
+
     ReturnStatus
     initializeIdentificationSession(
             const std::string &configDir) override;
@@ -40,15 +72,206 @@ public:
             std::vector<Candidate> &candidateList,
             bool &decision) override;
 
+    ReturnStatus
+    identifyTemplate(const TemplateView &idTemplate,
+            CandidateList &candidateList,
+            bool &decision) override;
+
+    ReturnStatus
+    identifyTemplate(const TemplateView &idTemplate,
+            std::chrono::steady_clock::time_point deadline,
+            CandidateList &candidateList,
+            bool &decision,
+            bool &partial) override;
+
+    ReturnStatus
+    identifyTemplates(const TemplateView *idTemplates,
+            size_t count,
+            CandidateList *candidateLists,
+            bool *decisions) override;
+
+    /** Besides shortlist, gallery_file and gallery_io of irpi.h the parameters are:
+     * <br>threshold - best score at or above which the decision is positive (DecisionThreshold).
+     * <br>fusion - how scores of the templates of one label are combined into one candidate:
+     * "none", "max" or "mean" (DefaultFusion).
+     * <br>numa - "on" splits the gallery between NUMA nodes, each part is placed on its node and
+     * scanned by a worker pinned there; "off" or the number of such workers.
+     * <br>compaction_rows - least number of inserted and removed rows that makes the background
+     * compaction merge them into the main segment (CompactionRows). */
+    ReturnStatus
+    setParameter(const std::string &name,
+            const std::string &value) override;
+
     static std::shared_ptr<IRPI::IdentInterface>
     getImplementation();
 
+    /** Template is the downsampled gray image: Side x Side floats, zero mean and unit L2 norm */
+    static const uint16_t Side = 16;
+    static const size_t Dim = static_cast<size_t>(Side) * Side;
+    /** Best score at or above this gives positive decision, "threshold" parameter changes it */
+    static constexpr float DecisionThreshold = 0.9f;
+    /** Compaction starts when delta and removed rows reach 1/CompactionRatio of the main segment,
+     * but not before there are "compaction_rows" of them (default CompactionRows) */
+    static const size_t CompactionRatio = 16;
+    static const size_t CompactionRows = 1024;
+    /** Scores of the templates of one label are fused to one candidate, "fusion" parameter
+     * ("none", "max" or "mean") changes it */
+    static const scoring::Fusion DefaultFusion = scoring::Fusion::Max;
+
 private:
+    /** Searchable gallery built by finalizeEnrollment() or by the background compaction */
+    struct MainSegment {
+        MainSegment() : mergedDeltaRows(0) {}
+        scoring::PackedGallery gallery;
+        std::unique_ptr<scoring::GalleryFile> galleryFile;
+        std::vector<size_t> labels;
+        std::vector<uint64_t> sketches;
+        std::vector<uint32_t> rowSubjects;
+        std::vector<size_t> subjectLabels;
+        std::vector<size_t> subjectRows; // first row of each subject
+        size_t mergedDeltaRows; // compaction merges first rows of the delta segment
+        std::string error;
+    };
+
+    /** Rows of the main segment scanned by one NUMA worker, its memory is on the worker's node */
+    struct Partition {
+        Partition() : firstRow(0), complete(true) {}
+        scoring::PackedGallery gallery;
+        size_t firstRow;
+        std::vector<scoring::TopK> heaps;
+        std::vector<scoring::SubjectScore> accumulators;
+        std::function<void()> search;
+        bool complete; // false if the scan has been cut by the deadline
+    };
+
+    ReturnStatus
+    makeTemplate(const Image &img, float *embedding) const;
+
+    void
+    appendDelta(size_t label,
+            const TemplateView &templ);
+
+    void
+    appendDeltaSubject(size_t label);
+
+    MainSegment
+    buildMainSegment(const std::vector<float> &rows,
+            std::vector<size_t> &segmentLabels,
+            const std::string &path) const;
+
+    void
+    installMainSegment(MainSegment &segment);
+
+    void
+    startCompaction();
+
+    void
+    finishCompaction(bool wait);
+
+    ReturnStatus
+    searchTemplates(const TemplateView *idTemplates,
+            size_t count,
+            CandidateList *candidateLists,
+            bool *decisions,
+            std::chrono::steady_clock::time_point deadline,
+            bool &partial);
+
+    bool
+    searchPanels(const float *panels,
+            size_t firstpanel,
+            size_t panelcount,
+            size_t rows,
+            size_t base,
+            const uint32_t *subjects,
+            scoring::TopK *probeHeaps,
+            scoring::SubjectScore *probeSubjects,
+            std::chrono::steady_clock::time_point deadline);
+
+    void
+    scorePanels(const float *panels,
+            size_t firstpanel,
+            size_t panelcount,
+            size_t rows,
+            size_t base,
+            const uint32_t *subjects,
+            scoring::TopK *probeHeaps,
+            scoring::SubjectScore *probeSubjects);
+
+    bool
+    searchPartitions(std::chrono::steady_clock::time_point deadline);
+
+    void
+    searchPartition(Partition &partition);
+
+    void
+    buildPartitions();
+
+    void
+    restoreGallery();
+
+    /** @brief Column of the main segment row wherever it is kept, its floats are PanelWidth apart */
+    const float*
+    mainColumn(size_t row) const;
+
+    bool
+    searchShortlist(const float *probe,
+            scoring::TopK &heap,
+            scoring::SubjectScore &accumulator,
+            std::chrono::steady_clock::time_point deadline);
+
+    void
+    fillCandidates(scoring::TopK &heap,
+            const uint32_t *indices,
+            CandidateList &candidateList,
+            bool &decision) const;
+
     std::string configDir;
     std::string enrollDir;
     std::vector<size_t> labels;
     int counter;
-    // Some other members
+    scoring::PackedGallery gallery;
+    // Out-of-core search: gallery is scanned from the file instead of memory
+    std::string galleryPath;
+    scoring::GalleryFile galleryFile;
+    // Two-stage search: sketches pick the shortlist, exact scores are computed for it only
+    size_t shortlist;
+    float threshold;
+    scoring::SketchProjector projector;
+    std::vector<uint64_t> sketches;
+    // Multi-template subjects: rows are grouped by label, so each subject is a run of rows
+    // (main subjects first, then delta subjects) and its scores may be fused in the scan
+    scoring::Fusion fusion;
+    std::vector<uint32_t> rowSubjects;
+    std::vector<uint32_t> deltaSubjects;
+    std::vector<size_t> subjectLabels;
+    std::vector<size_t> subjectRows;
+    size_t mainSubjects;
+    // Incremental updates: inserted rows go to the delta segment, removed rows of both segments
+    // get tombstones (main rows first, then delta rows), compaction merges them in the background
+    scoring::PackedGallery delta;
+    std::vector<float> deltaRows;
+    std::vector<size_t> deltaLabels;
+    std::vector<uint8_t> tombstones;
+    size_t removed;
+    size_t compactionRows;
+    std::future<MainSegment> compaction;
+    std::vector<size_t> removedDuringCompaction;
+    // NUMA mode: main segment is split into partitions by subjects, each worker is pinned to
+    // its node and has packed its partition there, so all nodes scan local memory at once;
+    // the monolithic gallery is released while the partitions hold its rows
+    std::vector<std::unique_ptr<scoring::NodeWorker>> workers;
+    std::vector<std::unique_ptr<Partition>> partitions;
+    std::chrono::steady_clock::time_point searchDeadline;
+    // Search buffers, they are reused from call to call
+    std::vector<scoring::TopK> heaps;
+    std::vector<float> probebuffer;
+    std::vector<const float*> probes;
+    std::vector<size_t> valid;
+    std::vector<uint16_t> distances;
+    std::vector<uint32_t> selected;
+    std::vector<uint32_t> selectedSubjects;
+    std::vector<scoring::SubjectScore> accumulators;
+    scoring::PackedGallery selectedrows;
 };
 }
 
@@ -10,11 +10,19 @@ DEFINES += BUILD_SHARED_LIBRARY
 
 SOURCES += nullimplirpi1N.cpp
 
-HEADERS += nullimplirpi1N.h
-           $${PWD}/../irpi.h
+HEADERS += nullimplirpi1N.h \
+           blockedscoring.h \
+           binarysketch.h \
+           galleryfile.h \
+           numanodes.h \
+           $${PWD}/../irpi.h \
+           $${PWD}/../irpiproc.h
 
 INCLUDEPATH += $${PWD}/..
 
+# Scoring micro-kernel is picked from the instruction set of the host CPU
+include($${PWD}/../IRPITest/simd.pri)
+
 # Installation paths
 win32 {
     win32-msvc2013: COMPILER = vc12
@@ -31,5 +39,7 @@ win32 {
 
 linux {
     DEFINES += Q_OS_LINUX
+    # Gallery file read-ahead, gallery compaction and NUMA workers run in background threads
+    LIBS += -lpthread
     DESTDIR = $${PWD}/../API_bin/$${TARGET}
 }
@@ -0,0 +1,186 @@
+/*
+ * NUMA nodes and search threads pinned to them for the reference implementation
+ *
+ * Nodes and their CPUs are read from sysfs.  A NodeWorker is a thread pinned
+ * to the CPUs of one node that runs one task at a time.  Memory is placed by
+ * first touch: a buffer allocated and written by the worker gets its pages
+ * from the worker's node, so the worker later scans it without going over the
+ * interconnect.  Without sysfs (or off Linux) the machine is a single node and
+ * workers are not pinned.
+ *
+ * This software is not subject to copyright protection
+ */
+
+#ifndef NUMANODES_H_
+#define NUMANODES_H_
+
+#include <condition_variable>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef Q_OS_LINUX
+    #include <sched.h>
+#endif
+
+namespace IRPI {
+namespace scoring {
+
+/** @brief NUMA node and its CPUs, empty cpus means the thread is not pinned */
+struct NumaNode {
+    NumaNode() :
+        id{0}
+        {}
+
+    int id;
+    std::vector<int> cpus;
+};
+
+/** @brief Parses sysfs cpu list, i.e. "0-3,8-11", returns empty vector if it can not be parsed */
+inline std::vector<int>
+parseCpuList(
+    const std::string &list)
+{
+    std::vector<int> _cpus;
+    std::stringstream _stream(list);
+    std::string _item;
+    while(std::getline(_stream, _item, ',')) {
+        int _first = 0, _last = 0;
+        char _dash = 0;
+        std::stringstream _range(_item);
+        if(!(_range >> _first))
+            return std::vector<int>();
+        _last = _first;
+        if(_range >> _dash && (_dash != '-' || !(_range >> _last)))
+            return std::vector<int>();
+        for(int c = _first; c <= _last; ++c)
+            _cpus.push_back(c);
+    }
+    return _cpus;
+}
+
+/** @brief Nodes of the machine that have CPUs, at least one is returned */
+inline std::vector<NumaNode>
+numaNodes()
+{
+    std::vector<NumaNode> _nodes;
+#ifdef Q_OS_LINUX
+    // Node ids may have gaps, so ids are probed up to the first few missing ones
+    for(int n = 0, _missing = 0; _missing < 8; ++n) {
+        std::ifstream _file("/sys/devices/system/node/node" + std::to_string(n) + "/cpulist");
+        std::string _list;
+        if(!_file || !std::getline(_file, _list)) {
+            ++_missing;
+            continue;
+        }
+        NumaNode _node;
+        _node.id = n;
+        _node.cpus = parseCpuList(_list);
+        if(!_node.cpus.empty())
+            _nodes.push_back(_node);
+    }
+#endif
+    if(_nodes.empty())
+        _nodes.push_back(NumaNode());
+    return _nodes;
+}
+
+/** =================================================================
+ * @brief Thread pinned to the CPUs of one node, runs tasks one by one.
+ * @details run() hands the task over and returns at once, wait() returns when it is done.
+ * The task is not copied, it shall live until wait() returns.
+ */
+class NodeWorker {
+public:
+    explicit NodeWorker(
+        const NumaNode &_node) :
+        node{_node},
+        task{nullptr},
+        pinned{false},
+        stop{false},
+        thread{&NodeWorker::loop, this}
+        {}
+
+    ~NodeWorker()
+    {
+        {
+            std::lock_guard<std::mutex> _lock(mutex);
+            stop = true;
+        }
+        wakeup.notify_all();
+        thread.join();
+    }
+
+    NodeWorker(const NodeWorker&) = delete;
+    NodeWorker& operator=(const NodeWorker&) = delete;
+
+    void
+    run(
+        const std::function<void()> &_task)
+    {
+        {
+            std::lock_guard<std::mutex> _lock(mutex);
+            task = &_task;
+        }
+        wakeup.notify_all();
+    }
+
+    void
+    wait()
+    {
+        std::unique_lock<std::mutex> _lock(mutex);
+        done.wait(_lock, [this]() { return task == nullptr; });
+    }
+
+    /** @brief Node id */
+    int
+    id() const { return node.id; }
+
+    /** @brief True if the thread runs on the CPUs of its node only, valid after the first wait() */
+    bool
+    isPinned() const { return pinned; }
+
+private:
+    void
+    loop()
+    {
+#ifdef Q_OS_LINUX
+        if(!node.cpus.empty()) {
+            cpu_set_t _set;
+            CPU_ZERO(&_set);
+            for(size_t i = 0; i < node.cpus.size(); ++i)
+                if(node.cpus[i] < CPU_SETSIZE)
+                    CPU_SET(node.cpus[i], &_set);
+            pinned = sched_setaffinity(0, sizeof(_set), &_set) == 0;
+        }
+#endif
+        std::unique_lock<std::mutex> _lock(mutex);
+        for(;;) {
+            wakeup.wait(_lock, [this]() { return stop || task != nullptr; });
+            if(stop)
+                return;
+            _lock.unlock();
+            (*task)();
+            _lock.lock();
+            task = nullptr;
+            done.notify_all();
+        }
+    }
+
+    const NumaNode node;
+    const std::function<void()> *task;
+    bool pinned;
+    bool stop;
+    std::mutex mutex;
+    std::condition_variable wakeup, done;
+    std::thread thread;
+};
+
+} // namespace scoring
+} // namespace IRPI
+
+#endif /* NUMANODES_H_ */